@@ -0,0 +1,210 @@
+/*
+ * Benchmark of the HT and SHT APIs over synthetic, reproducible workloads.
+ *
+ * Usage: ht_bench [records] [seed]
+ *
+ * For every bucket count it loads a primary and a secondary index, runs the workloads below
+ * and prints one line per workload with the throughput, the p50/p99 latency and the blocks
+ * read or written per operation. The block size is fixed by BF_64.a and only gets reported.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "workload.h"
+#include "../Include/BF.h"
+#include "../Include/HT.h"
+
+#define DEFAULT_RECORDS 20000U
+#define DEFAULT_SEED 42U
+#define OPS_PER_RUN 20000U
+#define DELETE_WAVES 3U
+#define ZIPF_THETA 0.99
+#define PRIMARY_FILE "bench.ht"
+#define SECONDARY_FILE "bench.sht"
+
+static const int bucket_counts[] = {16, 256, 2048};
+
+/* The results go to a duplicate of stdout, so they survive while stdout itself is silenced */
+static FILE *report;
+
+typedef struct {
+  HT_info *ht;
+  SHT_info *sht;
+  const int *ids;
+  const char **names;
+  rng_t rng;
+  int next_id;
+  size_t misses;
+} bench_t;
+
+typedef int (*bench_op)(bench_t *bench, size_t i);
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000U + (uint64_t) ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b) {
+  uint64_t lhs = *(const uint64_t *) a;
+  uint64_t rhs = *(const uint64_t *) b;
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+static unsigned long blocks_touched(const bench_t *bench) {
+  HT_metrics metrics;
+  unsigned long blocks = 0U;
+  if (HT_GetMetrics(bench->ht, &metrics) == 0) blocks += metrics.blockReads + metrics.blockWrites;
+  if (bench->sht != NULL && SHT_GetMetrics(bench->sht, &metrics) == 0) {
+    blocks += metrics.blockReads + metrics.blockWrites;
+  }
+  return blocks;
+}
+
+static int run(const char *workload, int buckets, bench_t *bench, bench_op op, size_t ops) {
+  uint64_t *latencies = malloc(ops * sizeof(uint64_t));
+  if (latencies == NULL) return -1;
+  unsigned long blocks_before = blocks_touched(bench);
+  uint64_t start = now_ns();
+  for (size_t i = 0U; i != ops; ++i) {
+    uint64_t op_start = now_ns();
+    if (op(bench, i) < 0) {
+      fprintf(stderr, "%s: operation %zu failed\n", workload, i);
+      free(latencies);
+      return -1;
+    }
+    latencies[i] = now_ns() - op_start;
+  }
+  double seconds = (double) (now_ns() - start) / 1e9;
+  unsigned long blocks = blocks_touched(bench) - blocks_before;
+  qsort(latencies, ops, sizeof(uint64_t), compare_u64);
+  fprintf(report, "%-16s %8d %10d %8zu %12.0f %10.2f %10.2f %10.2f\n", workload, buckets, BLOCK_SIZE, ops,
+         (double) ops / seconds, (double) latencies[ops / 2U] / 1e3, (double) latencies[ops * 99U / 100U] / 1e3,
+         (double) blocks / (double) ops);
+  free(latencies);
+  return 0;
+}
+
+static int op_load(bench_t *bench, size_t i) {
+  Record record = generate_record(bench->ids[i], &bench->rng);
+  int block_id = HT_InsertEntry(*bench->ht, record);
+  if (block_id < 0) return -1;
+  SecondaryRecord secondary_record = {.record = record, .blockId = block_id};
+  return SHT_SecondaryInsertEntry(*bench->sht, secondary_record);
+}
+
+static int op_get(bench_t *bench, size_t i) {
+  HT_result_set result;
+  int res = HT_GetMany(bench->ht, &bench->ids[i], 1U, &result);
+  HT_FreeResults(&result, 1U);
+  return res;
+}
+
+static int op_delete(bench_t *bench, size_t i) {
+  // Ids that are already gone are fine, the waves may pick the same id twice
+  bench->misses += HT_DeleteEntry(*bench->ht, (void *) &bench->ids[i]) < 0;
+  return 0;
+}
+
+static int op_mixed(bench_t *bench, size_t i) {
+  if (rng_next(&bench->rng) % 10U != 0U) return op_get(bench, i);
+  Record record = generate_record(bench->next_id++, &bench->rng);
+  return HT_InsertEntry(*bench->ht, record);
+}
+
+static int op_secondary_get(bench_t *bench, size_t i) {
+  return SHT_SecondaryGetAllEntries(*bench->sht, *bench->ht, (void *) bench->names[i]);
+}
+
+static int run_buckets(int buckets, size_t records, uint64_t seed) {
+  bench_t bench = {0};
+  rng_seed(&bench.rng, seed);
+  if (HT_CreateIndex(PRIMARY_FILE, 'i', "id", 2, buckets) < 0 ||
+      SHT_CreateSecondaryIndex(SECONDARY_FILE, "name", 4, buckets, PRIMARY_FILE) < 0) {
+    return -1;
+  }
+  bench.ht = HT_OpenIndex(PRIMARY_FILE);
+  bench.sht = SHT_OpenSecondaryIndex(SECONDARY_FILE);
+  int *ids = malloc(OPS_PER_RUN * sizeof(int) > records * sizeof(int) ? OPS_PER_RUN * sizeof(int)
+                                                                       : records * sizeof(int));
+  const char **names = malloc(OPS_PER_RUN * sizeof(char *));
+  zipf_t zipf = {0};
+  int res = -1;
+  if (bench.ht == NULL || bench.sht == NULL || ids == NULL || names == NULL ||
+      zipf_init(&zipf, records, ZIPF_THETA) < 0) {
+    goto __RUN_END;
+  }
+  bench.ids = ids;
+  bench.names = names;
+  bench.next_id = (int) (2U * records);
+
+  generate_ids(ids, records, ID_SEQUENTIAL, 0, records, NULL, &bench.rng);
+  shuffle_ids(ids, records, &bench.rng);
+  if (run("load", buckets, &bench, op_load, records) < 0) goto __RUN_END;
+
+  generate_ids(ids, OPS_PER_RUN, ID_UNIFORM, 0, records, NULL, &bench.rng);
+  if (run("get-hit-uniform", buckets, &bench, op_get, OPS_PER_RUN) < 0) goto __RUN_END;
+  generate_ids(ids, OPS_PER_RUN, ID_ZIPFIAN, 0, records, &zipf, &bench.rng);
+  if (run("get-hit-zipf", buckets, &bench, op_get, OPS_PER_RUN) < 0) goto __RUN_END;
+  generate_ids(ids, OPS_PER_RUN, ID_UNIFORM, (int) records, records, NULL, &bench.rng);
+  if (run("get-miss", buckets, &bench, op_get, OPS_PER_RUN) < 0) goto __RUN_END;
+
+  for (size_t i = 0U; i != OPS_PER_RUN; ++i) names[i] = popular_name(&bench.rng);
+  // The secondary lookup prints every match, which is not what we want to time on a terminal
+  fflush(stdout);
+  int saved_stdout = dup(STDOUT_FILENO);
+  int dev_null = open("/dev/null", O_WRONLY);
+  if (saved_stdout < 0 || dev_null < 0) goto __RUN_END;
+  dup2(dev_null, STDOUT_FILENO);
+  close(dev_null);
+  int secondary_res = run("sht-get", buckets, &bench, op_secondary_get, OPS_PER_RUN / 10U);
+  fflush(stdout);
+  dup2(saved_stdout, STDOUT_FILENO);
+  close(saved_stdout);
+  if (secondary_res < 0) goto __RUN_END;
+
+  generate_ids(ids, OPS_PER_RUN, ID_ZIPFIAN, 0, records, &zipf, &bench.rng);
+  if (run("mixed-90r-10w", buckets, &bench, op_mixed, OPS_PER_RUN) < 0) goto __RUN_END;
+
+  for (size_t wave = 0U; wave != DELETE_WAVES; ++wave) {
+    size_t wave_ops = records / 20U;
+    generate_ids(ids, wave_ops, ID_UNIFORM, 0, records, NULL, &bench.rng);
+    if (run("delete-wave", buckets, &bench, op_delete, wave_ops) < 0) goto __RUN_END;
+    generate_ids(ids, OPS_PER_RUN, ID_ZIPFIAN, 0, records, &zipf, &bench.rng);
+    if (run("get-after-delete", buckets, &bench, op_get, OPS_PER_RUN) < 0) goto __RUN_END;
+  }
+  res = 0;
+
+__RUN_END:
+  zipf_free(&zipf);
+  free(ids);
+  free(names);
+  if (bench.sht != NULL && SHT_CloseSecondaryIndex(bench.sht) < 0) res = -1;
+  if (bench.ht != NULL && HT_CloseIndex(bench.ht) < 0) res = -1;
+  return res;
+}
+
+int main(int argc, char **argv) {
+  size_t records = (argc > 1) ? strtoul(argv[1], NULL, 10) : DEFAULT_RECORDS;
+  uint64_t seed = (argc > 2) ? strtoull(argv[2], NULL, 10) : DEFAULT_SEED;
+  if (records == 0U) {
+    fprintf(stderr, "Usage: %s [records] [seed]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  BF_Init();
+  report = fdopen(dup(STDOUT_FILENO), "w");
+  if (report == NULL) return EXIT_FAILURE;
+  setvbuf(report, NULL, _IOLBF, 0);
+  fprintf(report, "%-16s %8s %10s %8s %12s %10s %10s %10s\n",
+         "workload", "buckets", "block_size", "ops", "ops/s", "p50(us)", "p99(us)", "blocks/op");
+  for (size_t i = 0U; i != sizeof(bucket_counts) / sizeof(bucket_counts[0]); ++i) {
+    if (run_buckets(bucket_counts[i], records, seed) < 0) {
+      fprintf(stderr, "Benchmark with %d buckets failed\n", bucket_counts[i]);
+      return EXIT_FAILURE;
+    }
+  }
+  fclose(report);
+  return EXIT_SUCCESS;
+}
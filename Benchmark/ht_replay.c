@@ -0,0 +1,457 @@
+/*
+ * Replays a trace recorded with HT_StartTrace against fresh indexes.
+ *
+ * Usage: ht_replay [-p] [-o prefix] [-b buckets] [-f plain|compact|compress] trace
+ *
+ *   -p  keeps the pacing of the trace, every call starting when it started in the trace
+ *   -o  the prefix of the replayed index files, replay_ by default
+ *   -b  the bucket count of the indexes the trace creates
+ *   -f  the format of the primary indexes the trace creates
+ *
+ * The indexes the trace creates get created again under the prefix, leftovers of an earlier replay removed.
+ * The ones it only opens must exist under the prefix. Calls on handles that did not open get skipped.
+ * A secondary insert of the record the primary insert right before it placed gets the block of the replayed
+ * insert, so that the secondary index keeps pointing at the record when the primary layout changes.
+ *
+ * Prints a line per operation with the number of calls, the skipped ones, the ones whose success differs
+ * from the trace, the p50/p99/max latency of the replay, the p50 latency of the trace and the blocks read
+ * or written per call.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "../Include/BF.h"
+#include "../Include/HT.h"
+#include "../Include/trace.h"
+
+#define DEFAULT_PREFIX "replay_"
+// Trace handles are BF file descriptors
+#define MAX_HANDLES 1024
+#define MAX_NAME 512
+#define MAX_KEY (sizeof(Record) + 1U)
+
+static const char *op_names[HT_TRACE_OP_N] = {
+        "ht-create", "ht-open", "ht-close", "ht-insert", "ht-insert-many", "ht-delete", "ht-get", "ht-get-many",
+        "ht-update", "ht-upsert", "sht-create", "sht-open", "sht-close", "sht-insert", "sht-get", "sht-count"
+};
+
+/* The results go to a duplicate of stdout, so they survive while stdout itself is silenced */
+static FILE *report;
+
+typedef struct {
+  HT_info *ht;
+  SHT_info *sht;
+} replay_handle_t;
+
+typedef struct {
+  uint64_t *latencies;
+  uint64_t *traced;
+  size_t calls;
+  size_t capacity;
+  size_t skipped;
+  size_t diverged;
+  unsigned long blocks;
+} op_stats_t;
+
+typedef struct {
+  const char *prefix;
+  int buckets;
+  int format_set;
+  unsigned int flags;
+  replay_handle_t handles[MAX_HANDLES];
+  /* The last primary insert: the id, the block of the trace and the block of the replay */
+  int last_id;
+  int last_traced_block;
+  int last_block;
+  op_stats_t stats[HT_TRACE_OP_N];
+} replay_t;
+
+typedef union {
+  int id;
+  char string[MAX_KEY];
+} replay_key_t;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000U + (uint64_t) ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b) {
+  uint64_t lhs = *(const uint64_t *) a;
+  uint64_t rhs = *(const uint64_t *) b;
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+static replay_handle_t *lookup(replay_t *replay, long handle) {
+  return (handle >= 0 && handle < MAX_HANDLES) ? &replay->handles[handle] : NULL;
+}
+
+static unsigned long blocks_touched(const replay_handle_t *handle) {
+  HT_metrics metrics;
+  unsigned long blocks = 0U;
+  if (handle == NULL) return 0U;
+  if (handle->ht != NULL && HT_GetMetrics(handle->ht, &metrics) == 0) {
+    blocks += metrics.blockReads + metrics.blockWrites;
+  }
+  if (handle->sht != NULL && SHT_GetMetrics(handle->sht, &metrics) == 0) {
+    blocks += metrics.blockReads + metrics.blockWrites;
+  }
+  return blocks;
+}
+
+/* The replayed file of a traced one: the prefix and the base name of the traced file */
+static int read_name(const replay_t *replay, HT_trace_event *event, char *name) {
+  char traced[MAX_NAME];
+  if (HT_TraceGetString(event, traced, sizeof(traced)) < 0) return -1;
+  const char *base = strrchr(traced, '/');
+  base = (base != NULL) ? base + 1 : traced;
+  return (snprintf(name, MAX_NAME, "%s%s", replay->prefix, base) < MAX_NAME) ? 0 : -1;
+}
+
+static int read_key(HT_trace_event *event, char attribute_type, replay_key_t *key) {
+  if (attribute_type == 'c') return HT_TraceGetString(event, key->string, sizeof(key->string));
+  long id;
+  if (HT_TraceGetInt(event, &id) < 0) return -1;
+  key->id = (int) id;
+  return 0;
+}
+
+static void overwrite_record(Record *record, void *context) {
+  *record = *(const Record *) context;
+}
+
+static void keep_record(Record *record, void *context) {
+  (void) record;
+  (void) context;
+}
+
+static int replay_create(replay_t *replay, HT_trace_event *event, int *result) {
+  char name[MAX_NAME];
+  char attribute_name[MAX_NAME];
+  long attribute_type, attribute_length, buckets, flags;
+  if (read_name(replay, event, name) < 0 || HT_TraceGetInt(event, &attribute_type) < 0 ||
+      HT_TraceGetString(event, attribute_name, sizeof(attribute_name)) < 0 ||
+      HT_TraceGetInt(event, &attribute_length) < 0 || HT_TraceGetInt(event, &buckets) < 0 ||
+      HT_TraceGetInt(event, &flags) < 0) {
+    return -1;
+  }
+  HT_create_options options = {.flags = replay->format_set ? replay->flags : (unsigned int) flags};
+  remove(name);
+  *result = HT_CreateIndexEx(name, (char) attribute_type, attribute_name, (int) attribute_length,
+                             replay->buckets ? replay->buckets : (int) buckets, &options);
+  return 0;
+}
+
+static int replay_secondary_create(replay_t *replay, HT_trace_event *event, int *result) {
+  char name[MAX_NAME];
+  char attribute_name[MAX_NAME];
+  char index_name[MAX_NAME];
+  long attribute_length, buckets;
+  if (read_name(replay, event, name) < 0 || HT_TraceGetString(event, attribute_name, sizeof(attribute_name)) < 0 ||
+      HT_TraceGetInt(event, &attribute_length) < 0 || HT_TraceGetInt(event, &buckets) < 0 ||
+      read_name(replay, event, index_name) < 0) {
+    return -1;
+  }
+  remove(name);
+  *result = SHT_CreateSecondaryIndex(name, attribute_name, (int) attribute_length,
+                                     replay->buckets ? replay->buckets : (int) buckets, index_name);
+  return 0;
+}
+
+static int replay_insert_many(HT_info *ht, HT_trace_event *event, int *result) {
+  long n;
+  if (HT_TraceGetInt(event, &n) < 0 || n < 0 || (size_t) n > event->payloadSize) return -1;
+  Record *records = malloc(((size_t) n ? (size_t) n : 1U) * sizeof(Record));
+  if (records == NULL) return -1;
+  for (long i = 0; i != n; ++i) {
+    if (HT_TraceGetRecord(event, &records[i]) < 0) {
+      free(records);
+      return -1;
+    }
+  }
+  *result = HT_InsertMany(ht, records, (size_t) n, NULL);
+  free(records);
+  return 0;
+}
+
+static int replay_get_many(HT_info *ht, HT_trace_event *event, int *result) {
+  long n;
+  if (HT_TraceGetInt(event, &n) < 0 || n < 0 || (size_t) n > event->payloadSize) return -1;
+  size_t count = (size_t) n ? (size_t) n : 1U;
+  replay_key_t *keys = malloc(count * sizeof(replay_key_t));
+  int *ids = malloc(count * sizeof(int));
+  char **strings = malloc(count * sizeof(char *));
+  HT_result_set *results = malloc(count * sizeof(HT_result_set));
+  int res = -1;
+  if (keys == NULL || ids == NULL || strings == NULL || results == NULL) goto __GET_MANY_END;
+  for (long i = 0; i != n; ++i) {
+    if (read_key(event, ht->attrType, &keys[i]) < 0) goto __GET_MANY_END;
+    ids[i] = keys[i].id;
+    strings[i] = keys[i].string;
+  }
+  *result = HT_GetMany(ht, (ht->attrType == 'c') ? (const void *) strings : (const void *) ids, (size_t) n, results);
+  if (*result >= 0) HT_FreeResults(results, (size_t) n);
+  res = 0;
+
+__GET_MANY_END:
+  free(keys);
+  free(ids);
+  free(strings);
+  free(results);
+  return res;
+}
+
+/**
+ * replay_event - Makes the call of an event again
+ * @param replay The replay state
+ * @param event The event
+ * @param result Receives the result of the call
+ * @return Returns 0 when the call got made, 1 when it got skipped and -1 when the event is malformed
+ */
+static int replay_event(replay_t *replay, HT_trace_event *event, int *result) {
+  replay_handle_t *handle = lookup(replay, event->handle);
+  char name[MAX_NAME];
+  Record record;
+  replay_key_t key;
+  long value;
+  switch (event->op) {
+    case HT_TRACE_CREATE:
+      return replay_create(replay, event, result);
+    case SHT_TRACE_CREATE:
+      return replay_secondary_create(replay, event, result);
+    case HT_TRACE_OPEN:
+    case SHT_TRACE_OPEN: {
+      if (read_name(replay, event, name) < 0) return -1;
+      replay_handle_t opened = {0};
+      if (event->op == HT_TRACE_OPEN) opened.ht = HT_OpenIndex(name);
+      else opened.sht = SHT_OpenSecondaryIndex(name);
+      *result = (opened.ht != NULL || opened.sht != NULL) ? 0 : -1;
+      if (*result < 0) return 0;
+      // The calls on handles the trace did not get are skipped, so the index is not needed
+      if (handle != NULL && event->result >= 0) *handle = opened;
+      else if (((opened.ht != NULL) ? HT_CloseIndex(opened.ht) : SHT_CloseSecondaryIndex(opened.sht)) < 0) *result = -1;
+      return 0;
+    }
+    default:
+      break;
+  }
+  if (handle == NULL) return 1;
+  if (event->op >= SHT_TRACE_CREATE) {
+    if (handle->sht == NULL) return 1;
+  } else if (handle->ht == NULL) {
+    return 1;
+  }
+  switch (event->op) {
+    case HT_TRACE_CLOSE:
+      *result = HT_CloseIndex(handle->ht);
+      handle->ht = NULL;
+      return 0;
+    case SHT_TRACE_CLOSE:
+      *result = SHT_CloseSecondaryIndex(handle->sht);
+      handle->sht = NULL;
+      return 0;
+    case HT_TRACE_INSERT:
+      if (HT_TraceGetRecord(event, &record) < 0) return -1;
+      *result = HT_InsertRecord(handle->ht, &record);
+      replay->last_id = record.id;
+      replay->last_traced_block = event->result;
+      replay->last_block = *result;
+      return 0;
+    case HT_TRACE_INSERT_MANY:
+      return replay_insert_many(handle->ht, event, result);
+    case HT_TRACE_DELETE:
+      if (read_key(event, handle->ht->attrType, &key) < 0) return -1;
+      *result = HT_DeleteEntry(*handle->ht, &key);
+      return 0;
+    case HT_TRACE_GET:
+      if (read_key(event, handle->ht->attrType, &key) < 0) return -1;
+      *result = HT_GetAllEntries(*handle->ht, &key);
+      return 0;
+    case HT_TRACE_GET_MANY:
+      return replay_get_many(handle->ht, event, result);
+    case HT_TRACE_UPDATE:
+      if (read_key(event, handle->ht->attrType, &key) < 0 || HT_TraceGetInt(event, &value) < 0 ||
+          (value && HT_TraceGetRecord(event, &record) < 0)) {
+        return -1;
+      }
+      *result = HT_Update(handle->ht, &key, value ? overwrite_record : keep_record, &record);
+      return 0;
+    case HT_TRACE_UPSERT:
+      if (HT_TraceGetRecord(event, &record) < 0) return -1;
+      *result = HT_Upsert(handle->ht, &record);
+      return 0;
+    case SHT_TRACE_INSERT: {
+      SecondaryRecord secondary_record;
+      if (HT_TraceGetRecord(event, &secondary_record.record) < 0 || HT_TraceGetInt(event, &value) < 0) return -1;
+      secondary_record.blockId = (int) value;
+      if (secondary_record.record.id == replay->last_id && secondary_record.blockId == replay->last_traced_block) {
+        secondary_record.blockId = replay->last_block;
+      }
+      *result = SHT_SecondaryInsertRecord(handle->sht, &secondary_record);
+      return 0;
+    }
+    case SHT_TRACE_GET: {
+      if (HT_TraceGetInt(event, &value) < 0 || read_key(event, 'c', &key) < 0) return -1;
+      replay_handle_t *primary = lookup(replay, value);
+      if (primary == NULL || primary->ht == NULL) return 1;
+      *result = SHT_SecondaryGetAllEntries(*handle->sht, *primary->ht, key.string);
+      return 0;
+    }
+    case SHT_TRACE_COUNT:
+      if (read_key(event, 'c', &key) < 0) return -1;
+      *result = SHT_Count(handle->sht, key.string);
+      return 0;
+    default:
+      return -1;
+  }
+}
+
+static int record_call(op_stats_t *stats, uint64_t latency, uint64_t traced, unsigned long blocks) {
+  if (stats->calls == stats->capacity) {
+    size_t capacity = stats->capacity ? 2U * stats->capacity : 64U;
+    uint64_t *latencies = realloc(stats->latencies, capacity * sizeof(uint64_t));
+    if (latencies == NULL) return -1;
+    stats->latencies = latencies;
+    uint64_t *traced_latencies = realloc(stats->traced, capacity * sizeof(uint64_t));
+    if (traced_latencies == NULL) return -1;
+    stats->traced = traced_latencies;
+    stats->capacity = capacity;
+  }
+  stats->latencies[stats->calls] = latency;
+  stats->traced[stats->calls] = traced;
+  ++stats->calls;
+  stats->blocks += blocks;
+  return 0;
+}
+
+static void print_report(replay_t *replay, size_t events, double seconds) {
+  fprintf(report, "%-15s %8s %8s %9s %10s %10s %10s %12s %10s\n",
+          "operation", "calls", "skipped", "diverged", "p50(us)", "p99(us)", "max(us)", "trace_p50(us)", "blocks/op");
+  for (int op = 0; op != HT_TRACE_OP_N; ++op) {
+    op_stats_t *stats = &replay->stats[op];
+    if (stats->calls == 0U && stats->skipped == 0U) continue;
+    size_t n = stats->calls;
+    if (n != 0U) {
+      qsort(stats->latencies, n, sizeof(uint64_t), compare_u64);
+      qsort(stats->traced, n, sizeof(uint64_t), compare_u64);
+    }
+    fprintf(report, "%-15s %8zu %8zu %9zu %10.2f %10.2f %10.2f %12.2f %10.2f\n", op_names[op], n, stats->skipped,
+            stats->diverged, n ? (double) stats->latencies[n / 2U] / 1e3 : 0.0,
+            n ? (double) stats->latencies[n * 99U / 100U] / 1e3 : 0.0,
+            n ? (double) stats->latencies[n - 1U] / 1e3 : 0.0,
+            n ? (double) stats->traced[n / 2U] / 1e3 : 0.0, n ? (double) stats->blocks / (double) n : 0.0);
+  }
+  fprintf(report, "%zu events in %.3f s\n", events, seconds);
+}
+
+static int replay_trace(replay_t *replay, HT_trace_reader *reader, int paced) {
+  HT_trace_event event;
+  size_t events = 0U;
+  int res;
+  uint64_t replay_start = now_ns();
+  while ((res = HT_NextTraceEvent(reader, &event)) == 1) {
+    if (paced) {
+      uint64_t target = replay_start + event.start;
+      uint64_t now = now_ns();
+      if (now < target) {
+        struct timespec wait = {(time_t) ((target - now) / 1000000000U), (long) ((target - now) % 1000000000U)};
+        nanosleep(&wait, NULL);
+      }
+    }
+    op_stats_t *stats = &replay->stats[event.op];
+    // The counters of the handle, which SHT gets also add the primary blocks they read to
+    unsigned long blocks_before = blocks_touched(lookup(replay, event.handle));
+    int result = 0;
+    uint64_t call_start = now_ns();
+    int made = replay_event(replay, &event, &result);
+    uint64_t latency = now_ns() - call_start;
+    if (made < 0) {
+      fprintf(stderr, "Event %zu (%s) is malformed\n", events, op_names[event.op]);
+      return -1;
+    }
+    ++events;
+    if (made == 1) {
+      ++stats->skipped;
+      continue;
+    }
+    if ((result < 0) != (event.result < 0)) ++stats->diverged;
+    // Closed handles have no counters left, so closes count no blocks
+    unsigned long blocks_after = blocks_touched(lookup(replay, event.handle));
+    unsigned long blocks = (blocks_after > blocks_before) ? blocks_after - blocks_before : 0U;
+    if (record_call(stats, latency, event.duration, blocks) < 0) return -1;
+  }
+  if (res < 0) {
+    fprintf(stderr, "The trace is malformed after %zu events\n", events);
+    return -1;
+  }
+  print_report(replay, events, (double) (now_ns() - replay_start) / 1e9);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  replay_t *replay = calloc(1U, sizeof(replay_t));
+  if (replay == NULL) return EXIT_FAILURE;
+  replay->prefix = DEFAULT_PREFIX;
+  int paced = 0;
+  int option;
+  while ((option = getopt(argc, argv, "po:b:f:")) != -1) {
+    switch (option) {
+      case 'p':
+        paced = 1;
+        break;
+      case 'o':
+        replay->prefix = optarg;
+        break;
+      case 'b':
+        replay->buckets = atoi(optarg);
+        break;
+      case 'f':
+        replay->format_set = 1;
+        if (!strcmp(optarg, "compact")) replay->flags = HT_FLAG_COMPACT;
+        else if (!strcmp(optarg, "compress")) replay->flags = HT_FLAG_COMPRESS_COLD;
+        else if (strcmp(optarg, "plain") != 0) option = '?';
+        break;
+      default:
+        break;
+    }
+    if (option == '?' || replay->buckets < 0) break;
+  }
+  if (option == '?' || replay->buckets < 0 || optind != argc - 1) {
+    fprintf(stderr, "Usage: %s [-p] [-o prefix] [-b buckets] [-f plain|compact|compress] trace\n", argv[0]);
+    free(replay);
+    return EXIT_FAILURE;
+  }
+  HT_trace_reader *reader = HT_OpenTrace(argv[optind]);
+  if (reader == NULL) {
+    fprintf(stderr, "%s is not a trace\n", argv[optind]);
+    free(replay);
+    return EXIT_FAILURE;
+  }
+  BF_Init();
+  report = fdopen(dup(STDOUT_FILENO), "w");
+  if (report == NULL) return EXIT_FAILURE;
+  // The lookups print every match, which is not what we want to time
+  fflush(stdout);
+  int dev_null = open("/dev/null", O_WRONLY);
+  if (dev_null >= 0) {
+    dup2(dev_null, STDOUT_FILENO);
+    close(dev_null);
+  }
+  int res = replay_trace(replay, reader, paced);
+  for (int i = 0; i != MAX_HANDLES; ++i) {
+    if (replay->handles[i].ht != NULL && HT_CloseIndex(replay->handles[i].ht) < 0) res = -1;
+    if (replay->handles[i].sht != NULL && SHT_CloseSecondaryIndex(replay->handles[i].sht) < 0) res = -1;
+  }
+  for (int op = 0; op != HT_TRACE_OP_N; ++op) {
+    free(replay->stats[op].latencies);
+    free(replay->stats[op].traced);
+  }
+  HT_CloseTrace(reader);
+  fclose(report);
+  free(replay);
+  return (res < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,135 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "workload.h"
+#include "../Include/macros.h"
+
+#define ARRAY_LEN(array) (sizeof(array) / sizeof((array)[0]))
+
+typedef struct {
+  const char *value;
+  unsigned int weight;
+} weighted_value_t;
+
+/* Rough shares of the most common names, so that a few of them dominate as they do in real data */
+static const weighted_value_t names[] = {
+        {"Maria", 110}, {"Georgios", 95}, {"Eleni", 80}, {"Ioannis", 75}, {"Dimitrios", 60},
+        {"Aikaterini", 55}, {"Konstantinos", 50}, {"Vasiliki", 40}, {"Nikolaos", 40}, {"Sofia", 30},
+        {"Panagiotis", 30}, {"Anna", 25}, {"Christos", 25}, {"Athina", 15}, {"Michail", 15},
+        {"Eirini", 12}, {"Spyridon", 10}, {"Ilias", 8}, {"Zoi", 5}, {"Stavros", 5}
+};
+
+static const weighted_value_t surnames[] = {
+        {"Papadopoulos", 60}, {"Papadopoulou", 55}, {"Georgiou", 40}, {"Papadakis", 35}, {"Oikonomou", 30},
+        {"Vasileiou", 28}, {"Ioannidis", 25}, {"Nikolaidis", 22}, {"Makris", 20}, {"Dimitriou", 20},
+        {"Pappas", 18}, {"Karagiannis", 15}, {"Konstantinou", 15}, {"Alexiou", 10}, {"Mavridis", 8}
+};
+
+static const char *streets[] = {
+        "Ermou", "Stadiou", "Panepistimiou", "Akadimias", "Patision",
+        "Egnatia", "Tsimiski", "Kifisias", "Syggrou", "Alexandras"
+};
+
+static const char *cities[] = {"Athens", "Thessaloniki", "Patra", "Heraklion", "Larisa"};
+
+void rng_seed(rng_t *rng, uint64_t seed) {
+  rng->state = seed ? seed : 0x9E3779B97F4A7C15ULL;
+}
+
+uint64_t rng_next(rng_t *rng) {
+  rng->state ^= rng->state >> 12;
+  rng->state ^= rng->state << 25;
+  rng->state ^= rng->state >> 27;
+  return rng->state * 0x2545F4914F6CDD1DULL;
+}
+
+static __INLINE inline
+double rng_unit(rng_t *rng) {
+  return (double) (rng_next(rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+int zipf_init(zipf_t *zipf, size_t n, double theta) {
+  zipf->n = n;
+  zipf->cdf = __MALLOC(n, double);
+  if (zipf->cdf == NULL) return -1;
+  double sum = 0.0;
+  for (size_t i = 0U; i != n; ++i) {
+    sum += 1.0 / pow((double) (i + 1U), theta);
+    zipf->cdf[i] = sum;
+  }
+  for (size_t i = 0U; i != n; ++i) {
+    zipf->cdf[i] /= sum;
+  }
+  return 0;
+}
+
+size_t zipf_next(const zipf_t *zipf, rng_t *rng) {
+  double u = rng_unit(rng);
+  size_t low = 0U;
+  size_t high = zipf->n - 1U;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2U;
+    if (zipf->cdf[middle] < u) low = middle + 1U;
+    else high = middle;
+  }
+  return low;
+}
+
+void zipf_free(zipf_t *zipf) {
+  free(zipf->cdf);
+  zipf->cdf = NULL;
+}
+
+void generate_ids(int *ids, size_t n, id_distribution distribution, int base, size_t key_space,
+                  const zipf_t *zipf, rng_t *rng) {
+  for (size_t i = 0U; i != n; ++i) {
+    size_t offset;
+    switch (distribution) {
+      case ID_SEQUENTIAL:
+        offset = i % key_space;
+        break;
+      case ID_UNIFORM:
+        offset = rng_next(rng) % key_space;
+        break;
+      default:
+        // Scatter the ranks so that the popular ids do not all land in neighbouring buckets
+        offset = (zipf_next(zipf, rng) * 2654435761U) % key_space;
+        break;
+    }
+    ids[i] = base + (int) offset;
+  }
+}
+
+void shuffle_ids(int *ids, size_t n, rng_t *rng) {
+  for (size_t i = n; i > 1U; --i) {
+    size_t j = rng_next(rng) % i;
+    int tmp = ids[i - 1U];
+    ids[i - 1U] = ids[j];
+    ids[j] = tmp;
+  }
+}
+
+static const char *pick_weighted(const weighted_value_t *values, size_t n, rng_t *rng) {
+  unsigned int total = 0U;
+  for (size_t i = 0U; i != n; ++i) total += values[i].weight;
+  unsigned int pick = (unsigned int) (rng_next(rng) % total);
+  for (size_t i = 0U; i != n; ++i) {
+    if (pick < values[i].weight) return values[i].value;
+    pick -= values[i].weight;
+  }
+  return values[n - 1U].value;
+}
+
+Record generate_record(int id, rng_t *rng) {
+  Record record = {.id = id};
+  snprintf(record.name, sizeof(record.name), "%s", popular_name(rng));
+  snprintf(record.surname, sizeof(record.surname), "%s", pick_weighted(surnames, ARRAY_LEN(surnames), rng));
+  snprintf(record.address, sizeof(record.address), "%s %u, %s",
+           streets[rng_next(rng) % ARRAY_LEN(streets)], (unsigned int) (rng_next(rng) % 200U) + 1U,
+           cities[rng_next(rng) % ARRAY_LEN(cities)]);
+  return record;
+}
+
+const char *popular_name(rng_t *rng) {
+  return pick_weighted(names, ARRAY_LEN(names), rng);
+}
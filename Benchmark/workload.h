@@ -0,0 +1,99 @@
+#ifndef DB_EX1_WORKLOAD_H
+#define DB_EX1_WORKLOAD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../Include/attributes.h"
+#include "../Include/record.h"
+
+typedef enum {
+  ID_SEQUENTIAL,
+  ID_UNIFORM,
+  ID_ZIPFIAN
+} id_distribution;
+
+typedef struct {
+  uint64_t state;
+} rng_t;
+
+typedef struct {
+  double *cdf;
+  size_t n;
+} zipf_t;
+
+/**
+ * rng_seed - Seeds a xorshift64* generator. The same seed always yields the same workload
+ * @param rng The generator
+ * @param seed Any value, 0 included
+ */
+void rng_seed(rng_t *rng, uint64_t seed) __NON_NULL(1);
+
+/**
+ * rng_next - Draws the next 64 random bits
+ * @param rng The generator
+ * @return The random bits
+ */
+__NO_DISCARD uint64_t rng_next(rng_t *rng) __NON_NULL(1);
+
+/**
+ * zipf_init - Prepares a Zipfian distribution over the ranks [0, n)
+ * @param zipf The distribution
+ * @param n The number of ranks
+ * @param theta The skew. 0.99 is the usual YCSB value
+ * @return On success returns 0, otherwise -1
+ */
+__NO_DISCARD int zipf_init(zipf_t *zipf, size_t n, double theta) __NON_NULL(1);
+
+/**
+ * zipf_next - Draws a rank. Rank 0 is the most popular one
+ * @param zipf The distribution
+ * @param rng The generator
+ * @return A rank in [0, n)
+ */
+__NO_DISCARD size_t zipf_next(const zipf_t *zipf, rng_t *rng) __NON_NULL(1, 2);
+
+/**
+ * zipf_free - Releases the distribution
+ * @param zipf The distribution
+ */
+void zipf_free(zipf_t *zipf) __NON_NULL(1);
+
+/**
+ * generate_ids - Fills ids with n ids drawn from [base, base + key_space).
+ * Sequential ids wrap around the key space, Zipfian ids scatter the popular ranks over it.
+ * @param ids The ids to fill
+ * @param n The number of ids
+ * @param distribution How the ids get drawn
+ * @param base The smallest id
+ * @param key_space The number of distinct ids
+ * @param zipf The distribution to use for ID_ZIPFIAN, prepared over key_space ranks
+ * @param rng The generator
+ */
+void generate_ids(int *ids, size_t n, id_distribution distribution, int base, size_t key_space,
+                  const zipf_t *zipf, rng_t *rng) __NON_NULL(1, 7);
+
+/**
+ * shuffle_ids - Shuffles the ids in place
+ * @param ids The ids
+ * @param n The number of ids
+ * @param rng The generator
+ */
+void shuffle_ids(int *ids, size_t n, rng_t *rng) __NON_NULL(1, 3);
+
+/**
+ * generate_record - Creates a record with the given id and a name, surname and address
+ * drawn with frequencies close to the ones of a real population
+ * @param id The id of the record
+ * @param rng The generator
+ * @return The record
+ */
+__NO_DISCARD Record generate_record(int id, rng_t *rng) __NON_NULL(2);
+
+/**
+ * popular_name - Draws a first name with the same frequencies generate_record uses
+ * @param rng The generator
+ * @return The name
+ */
+__NO_DISCARD const char *popular_name(rng_t *rng) __NON_NULL(1);
+
+#endif //DB_EX1_WORKLOAD_H
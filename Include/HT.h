@@ -4,10 +4,19 @@
 #include <stdlib.h>
 #include "attributes.h"
 #include "record.h"
+#include "metrics.h"
 
 #define HT_BLOCK_OVERFLOW -24
 #define HT_FILE_IDENTIFIER "STATIC_HASH_TABLE"
 #define SHT_FILE_IDENTIFIER "SECONDARY_STATIC_HASH_TABLE"
+#define HT_RESIZE_AUTO 0
+#define HT_RESIZE_TARGET_FILL 0.75
+
+/* Flags of an index, chosen when it gets created */
+// Store the records of the bucket blocks with variable length strings behind a slot directory
+#define HT_FLAG_COMPACT 0x1U
+// Compress overflow blocks once they are full, so that cold chains take fewer blocks. Not with HT_FLAG_COMPACT
+#define HT_FLAG_COMPRESS_COLD 0x2U
 
 typedef struct {
   int fileDesc;
@@ -15,6 +24,12 @@ typedef struct {
   size_t attrLength;
   char *attrName;
   unsigned long int numBuckets;
+  HT_metrics *metrics;
+  unsigned int flags;
+  /* The key matching of the index, picked by HT_OpenIndex */
+  const struct ht_key_kernel *kernel;
+  /* NULL unless HT_EnableRecordCache got called, see record_cache.h */
+  struct ht_record_cache *cache;
 } HT_info;
 
 typedef struct {
@@ -23,8 +38,41 @@ typedef struct {
   unsigned long int numBuckets;
   char *attrName;
   char *fileName;
+  HT_metrics *metrics;
 } SHT_info;
 
+typedef struct {
+  unsigned int flags;
+} HT_create_options;
+
+typedef struct {
+  Record *records;
+  size_t count;
+  size_t capacity;
+} HT_result_set;
+
+/*
+ * A lookup in progress. The records it hands out are borrowed views into the BF buffers,
+ * see HT_ViewNext for how long they stay valid.
+ */
+typedef struct {
+  HT_info *info;
+  const void *value;
+  size_t valueLength;
+  int blockId;
+  unsigned int nextRecord;
+  int blocksRead;
+  Record scratch;
+} HT_view;
+
+typedef int (*HT_scan_callback)(const Record *record, int block_id, void *context);
+
+/* Changes the record it gets in place */
+typedef void (*HT_update_callback)(Record *record, void *context);
+
+/* Gets a key of a secondary index with the number of records indexed under it. Returning non zero stops the walk */
+typedef int (*SHT_group_callback)(const char *key, unsigned long count, void *context);
+
 /**
  * HT_CreateIndex - Creates an index file
  * implementing static hashing techniques.
@@ -40,13 +88,33 @@ typedef struct {
 __NO_DISCARD int HT_CreateIndex(char *index_name, char attribute_type, char *attribute_name,
                                 int attribute_length, int bucket_n) __NON_NULL(1, 3);
 
+/**
+ * HT_CreateIndexEx - Same as HT_CreateIndex, with the options of the index.
+ * HT_FLAG_COMPACT fits two to three times as many records of typical data per block,
+ * at the cost of decoding the records that lookups return.
+ * HT_FLAG_COMPRESS_COLD keeps appending records to the last overflow block of a chain for as long as
+ * they fit compressed, while the bucket blocks stay plain. Reading a compressed block costs a decompression.
+ *
+ * @param index_name  A string of the index name.
+ * @param attribute_type  A character indicating key type.
+ * @param attribute_name  A string of the key name.
+ * @param attribute_length  The length of the key type in bytes.
+ * @param buckets  The number of buckets for the hash index.
+ * @param options  The options of the index, NULL picks the defaults.
+ * @return  On success returns 0.
+ * On failure returns the error values defined in BF.h
+ */
+__NO_DISCARD int HT_CreateIndexEx(char *index_name, char attribute_type, char *attribute_name,
+                                  int attribute_length, int bucket_n,
+                                  const HT_create_options *options) __NON_NULL(1, 3);
+
 /**
  * HT_OpenIndex - Opens an index file and reads the appropriate
  * info into an HT_info object.
  *
  * @param  index_name The name of the index file.
  * @return  On success returns a pointer to an HT_info object.
- * On failure returns NULL.
+ * On failure returns NULL, also for files of another format version.
  */
 __NO_DISCARD HT_info *HT_OpenIndex(char *index_name) __NON_NULL(1);
 
@@ -68,6 +136,30 @@ __NO_DISCARD int HT_CloseIndex(HT_info *header_info);
  */
 __NO_DISCARD int HT_InsertEntry(HT_info header_info, Record record);
 
+/**
+ * HT_InsertRecord - Same as HT_InsertEntry, without copying the handle and the record on the way in
+ * @param header_info The header info
+ * @param record The record to insert. It must not be a view into a block of an index
+ * @return On success returns the block number that the record got inserted
+ * On failure returns -1
+ */
+__NO_DISCARD int HT_InsertRecord(HT_info *header_info, const Record *record) __NON_NULL(1, 2);
+
+/**
+ * HT_InsertMany - Inserts many records at once.
+ * The records get grouped by bucket, so every bucket chain is walked once
+ * and every block gets written once, however many of the records land in it.
+ * Records of the same bucket keep their relative order.
+ * @param header_info The header info
+ * @param records An array of n records
+ * @param n The number of records
+ * @param block_ids If not NULL, block_ids[i] receives the block that records[i] got inserted
+ * @return On success returns the number of blocks written
+ * On failure returns -1, after which any prefix of the records may have been inserted
+ */
+__NO_DISCARD int HT_InsertMany(HT_info *header_info, const Record *records, size_t n,
+                               int *block_ids) __NON_NULL(1);
+
 /**
  * HT_DeleteEntry - Deletes the entry with id equal to value
  * @param header_info The header info from which we take the static hashing file information
@@ -77,6 +169,32 @@ __NO_DISCARD int HT_InsertEntry(HT_info header_info, Record record);
  */
 __NO_DISCARD int HT_DeleteEntry(HT_info header_info, void *value) __NON_NULL(2);
 
+/**
+ * HT_Update - Changes the first record whose key is equal to value, finding it in a single chain traversal.
+ * The record stays where it is when the mutator keeps its key and it still fits its block, so secondary
+ * indexes pointing at it stay valid. Otherwise it moves: to another block of the chain, or to the chain
+ * of its new key.
+ * @param header_info The header info
+ * @param value The key of the record to change
+ * @param mutator Gets a copy of the record to change
+ * @param context Passed untouched to the mutator
+ * @return On success returns the block the record lives in afterwards
+ * On failure, or when there is no such record, returns -1
+ */
+__NO_DISCARD int HT_Update(HT_info *header_info, const void *value, HT_update_callback mutator,
+                           void *context) __NON_NULL(1, 2, 3);
+
+/**
+ * HT_Upsert - Replaces the first record with the key of record, or inserts record when there is none,
+ * in a single chain traversal. Indexes only ever changed through HT_Upsert keep their keys unique.
+ * A replaced record stays in its block as long as the new one fits there, as with HT_Update.
+ * @param header_info The header info
+ * @param record The record to store
+ * @return On success returns the block the record got stored in
+ * On failure returns -1
+ */
+__NO_DISCARD int HT_Upsert(HT_info *header_info, const Record *record) __NON_NULL(1, 2);
+
 /**
  * HT_GetAllEntries - Prints all the records whose primary key is equal to value
  * @param header_info The header info from which we take the static hashing file information
@@ -86,6 +204,69 @@ __NO_DISCARD int HT_DeleteEntry(HT_info header_info, void *value) __NON_NULL(2);
  */
 __NO_DISCARD int HT_GetAllEntries(HT_info header_info, void *value) __NON_NULL(2);
 
+/**
+ * HT_Find - Starts a lookup of the records whose primary key is equal to value.
+ * Nothing gets read until the first HT_ViewNext.
+ * @param header_info The header info from which we take the static hashing file information
+ * @param value The value of the key. It must stay alive as long as the view is used
+ * @param view Receives the lookup state
+ * @return On success returns 0
+ * On failure returns -1
+ */
+__NO_DISCARD int HT_Find(HT_info *header_info, const void *value, HT_view *view) __NON_NULL(1, 2, 3);
+
+/**
+ * HT_ViewNext - Moves the view to the next matching record and returns a pointer to it in place, inside its block.
+ * Records of HT_FLAG_COMPACT indexes get decoded into view->scratch instead.
+ * The BF layer cannot pin blocks, so the pointer is only valid until the next call into the HT or BF layer,
+ * this view included. Every call pins the current block again, which costs a buffer lookup and no I/O.
+ * @param view The view filled by HT_Find
+ * @param record Receives the matching record
+ * @return Returns 1 when a record was found, 0 when the chain is exhausted
+ * On failure returns -1
+ */
+__NO_DISCARD int HT_ViewNext(HT_view *view, const Record **record) __NON_NULL(1, 2);
+
+/**
+ * HT_ViewRelease - Ends a lookup. The records it handed out must not be used afterwards.
+ * view->blocksRead keeps the number of blocks the lookup read.
+ * @param view The view filled by HT_Find
+ */
+void HT_ViewRelease(HT_view *view) __NON_NULL(1);
+
+/**
+ * HT_GetMany - Finds the records of many primary key values at once.
+ * Keys that hash to the same bucket share a single walk over the bucket chain
+ * and nothing gets printed.
+ * @param header_info The header info from which we take the static hashing file information
+ * @param keys An array of n keys. For 'i' indexes an array of int, for 'c' indexes an array of char *
+ * @param n The number of keys
+ * @param results An array of n result sets. results[i] receives the records matching keys[i]
+ * and must be released with HT_FreeResults
+ * @return On success returns the number of blocks read
+ * On failure returns -1
+ */
+__NO_DISCARD int HT_GetMany(HT_info *header_info, const void *keys, size_t n,
+                            HT_result_set *results) __NON_NULL(1, 4);
+
+/**
+ * HT_FreeResults - Releases the records held by the result sets filled by HT_GetMany
+ * @param results The result sets
+ * @param n The number of result sets
+ */
+void HT_FreeResults(HT_result_set *results, size_t n);
+
+/**
+ * HT_Scan - Visits every record of the index in file order, one block after the other,
+ * instead of following the bucket chains.
+ * @param header_info The header info from which we take the static hashing file information
+ * @param callback Gets called for every record with the block it lives in. Returning non zero stops the scan
+ * @param context Passed untouched to the callback
+ * @return On success returns the number of blocks read
+ * On failure returns -1
+ */
+__NO_DISCARD int HT_Scan(HT_info *header_info, HT_scan_callback callback, void *context) __NON_NULL(1, 2);
+
 /**
  * SHT_CreateSecondaryIndex - Creates a secondary index file for the primary index file
  * implementing static hashing techniques.
@@ -107,6 +288,7 @@ __NO_DISCARD int SHT_CreateSecondaryIndex(char *secondary_index_name, char *attr
  *
  * @param sfileName A string of the secondary index file name.
  * @return On Success returns a pointer to a SHT_info object, otherwise NULL.
+ * Files of another format version get refused too.
  */
 __NO_DISCARD SHT_info *SHT_OpenSecondaryIndex(char *sfileName) __NON_NULL(1);
 
@@ -129,6 +311,14 @@ __NO_DISCARD int SHT_CloseSecondaryIndex(SHT_info *header_info) __NON_NULL(1);
  */
 __NO_DISCARD int SHT_SecondaryInsertEntry(SHT_info header_info, SecondaryRecord record);
 
+/**
+ * SHT_SecondaryInsertRecord - Same as SHT_SecondaryInsertEntry, without copying the handle and the record on the way in
+ * @param header_info  Info about the secondary index.
+ * @param record  The SecondaryRecord to be inserted. It must not be a view into a block of an index
+ * @return On success returns 0, otherwise -1.
+ */
+__NO_DISCARD int SHT_SecondaryInsertRecord(SHT_info *header_info, const SecondaryRecord *record) __NON_NULL(1, 2);
+
 /**
  * SHT_SecondaryGetAllEntries -
  * @param sht_info The secondary header info
@@ -139,7 +329,87 @@ __NO_DISCARD int SHT_SecondaryInsertEntry(SHT_info header_info, SecondaryRecord
 __NO_DISCARD int SHT_SecondaryGetAllEntries(SHT_info sht_info, HT_info ht_info, void *value) __NON_NULL(3);
 
 /**
- * HashStatistics - Prints the the hash statistics about the file
+ * SHT_Count - Counts the records whose secondary key is equal to value.
+ * Only the chain of the key in the secondary index gets read, no primary block and nothing gets printed
+ * @param header_info The secondary header info
+ * @param value The key
+ * @return On success returns the number of records, 0 when there are none
+ * On failure returns -1
+ */
+__NO_DISCARD int SHT_Count(SHT_info *header_info, const char *value) __NON_NULL(1, 2);
+
+/**
+ * SHT_Exists - Checks whether any record has value as its secondary key, reading like SHT_Count
+ * @param header_info The secondary header info
+ * @param value The key
+ * @return Returns 1 when some record has it, 0 when none does and -1 on failure
+ */
+__NO_DISCARD int SHT_Exists(SHT_info *header_info, const char *value) __NON_NULL(1, 2);
+
+/**
+ * SHT_GroupCount - Streams every distinct key of a secondary index with its record count,
+ * reading the secondary file once in file order and holding nothing but the current block
+ * @param header_info The secondary header info
+ * @param callback Gets called once per key, in no particular order. It may use the BF layer, SHT_Count included
+ * @param context Passed untouched to the callback
+ * @return On success returns the number of keys passed to the callback
+ * On failure returns -1
+ */
+__NO_DISCARD int SHT_GroupCount(SHT_info *header_info, SHT_group_callback callback, void *context) __NON_NULL(1, 2);
+
+/**
+ * HT_GetMetrics - Takes a snapshot of the counters of an index handle.
+ * The counters are only kept when the library is built with HT_METRICS.
+ * @param header_info The handle whose counters are copied
+ * @param metrics Receives the counters
+ * @return On success returns 0
+ * On failure, or when the counters are compiled out, returns -1
+ */
+__NO_DISCARD int HT_GetMetrics(const HT_info *header_info, HT_metrics *metrics) __NON_NULL(1, 2);
+
+/**
+ * SHT_GetMetrics - Takes a snapshot of the counters of a secondary index handle.
+ * Primary blocks read on behalf of SHT_SecondaryGetAllEntries are counted here.
+ * @param header_info The handle whose counters are copied
+ * @param metrics Receives the counters
+ * @return On success returns 0
+ * On failure, or when the counters are compiled out, returns -1
+ */
+__NO_DISCARD int SHT_GetMetrics(const SHT_info *header_info, HT_metrics *metrics) __NON_NULL(1, 2);
+
+/**
+ * HT_SetChecksumVerification - Makes every block read of HT and SHT files check the block checksum.
+ * A block that fails it makes the operation fail instead of following its contents.
+ * The headers get checked on every open either way.
+ * @param enabled Non zero enables the checks, 0 disables them
+ */
+void HT_SetChecksumVerification(int enabled);
+
+/**
+ * HT_SuggestBuckets - Picks a bucket count for the records of an index from its live statistics,
+ * so that the average bucket fills HT_RESIZE_TARGET_FILL of a single block.
+ * @param index_name The index. It must not be open
+ * @return On success returns the bucket count
+ * On failure returns -1
+ */
+__NO_DISCARD int HT_SuggestBuckets(char *index_name) __NON_NULL(1);
+
+/**
+ * HT_Resize - Rehashes an index to a new bucket count. The records get copied with a sequential scan
+ * and batched inserts into <index_name>.resize, which then gets renamed over the index.
+ * Handles opened earlier keep reading the old file until they are reopened, and whatever they write is lost.
+ * An idle handle of the catalog gets closed first, and the resize fails while one is in use.
+ * Secondary indexes point to stale blocks afterwards and must be rebuilt.
+ * @param index_name The index. Its pending writes must have been flushed by closing it
+ * @param new_buckets The new number of buckets, or HT_RESIZE_AUTO to let HT_SuggestBuckets pick it
+ * @return On success returns the new number of buckets
+ * On failure returns -1 and leaves the index untouched
+ */
+__NO_DISCARD int HT_Resize(char *index_name, int new_buckets) __NON_NULL(1);
+
+/**
+ * HashStatistics - Prints the the hash statistics about the file. The blocks get read through the BF layer,
+ * so writes of handles that are still open are included
  * @param filename The file whose statistics will be printed
  * @return On success returns 0.
  * On failure returns -1.
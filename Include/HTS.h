@@ -0,0 +1,105 @@
+#ifndef DB_EX1_HTS_H
+#define DB_EX1_HTS_H
+
+#include <stdlib.h>
+#include "attributes.h"
+#include "record.h"
+#include "HT.h"
+
+#define HTS_FILE_IDENTIFIER "SHARDED_HASH_TABLE"
+// The BF layer can keep only a couple dozen files open and resharding needs the new shards open at once
+#define HTS_MAX_SHARDS 16U
+
+typedef struct {
+  size_t shardN;
+  HT_info **shards;
+} HTS_info;
+
+/**
+ * HTS_Create - Creates a sharded table. The table file only holds the shard count and the generation of the
+ * shards, the records live in shard_n static hash index files named <table_name>.<shard>, and
+ * <table_name>.g<generation>.<shard> once the table got resharded. Nothing is left behind on failure.
+ *
+ * @param table_name  A string of the table name.
+ * @param attribute_type  A character indicating key type.
+ * @param attribute_name  A string of the key name.
+ * @param attribute_length  The length of the key type in bytes.
+ * @param bucket_n  The number of buckets of every shard.
+ * @param shard_n  The number of shards, at most HTS_MAX_SHARDS.
+ * @return On success returns 0.
+ * On failure returns -1
+ */
+__NO_DISCARD int HTS_Create(char *table_name, char attribute_type, char *attribute_name,
+                            int attribute_length, int bucket_n, size_t shard_n) __NON_NULL(1, 3);
+
+/**
+ * HTS_Open - Opens a sharded table together with all of its shards.
+ *
+ * @param table_name The name of the table.
+ * @return On success returns a pointer to an HTS_info object.
+ * On failure returns NULL.
+ */
+__NO_DISCARD HTS_info *HTS_Open(char *table_name) __NON_NULL(1);
+
+/**
+ * HTS_Close - Closes the table and all of its shards
+ * @param table_info A pointer to an HTS_info object
+ * @return On success returns 0
+ * On failure returns -1
+ */
+__NO_DISCARD int HTS_Close(HTS_info *table_info);
+
+/**
+ * HTS_Insert - Routes the record to its shard and inserts it there
+ * @param table_info The table info
+ * @param record The record to insert
+ * @return On success returns the shard that the record got inserted
+ * On failure returns -1
+ */
+__NO_DISCARD int HTS_Insert(HTS_info *table_info, Record record) __NON_NULL(1);
+
+/**
+ * HTS_Delete - Deletes the entry whose key is equal to value from the shard that owns it
+ * @param table_info The table info
+ * @param value The value of the key of the Record to delete
+ * @return On success returns 0
+ * On failure returns -1
+ */
+__NO_DISCARD int HTS_Delete(HTS_info *table_info, void *value) __NON_NULL(1, 2);
+
+/**
+ * HTS_Get - Prints all the records whose key is equal to value.
+ * Only the shard that owns value gets read.
+ * @param table_info The table info
+ * @param value The value of the key of the Records to print
+ * @return On success returns the number of blocks read until we found all the records
+ * On failure returns -1
+ */
+__NO_DISCARD int HTS_Get(HTS_info *table_info, void *value) __NON_NULL(1, 2);
+
+/**
+ * HTS_GetMany - Splits the keys per shard and runs one HT_GetMany on every shard that owns any of them
+ * @param table_info The table info
+ * @param keys An array of n keys, laid out as HT_GetMany expects them
+ * @param n The number of keys
+ * @param results An array of n result sets, released with HT_FreeResults
+ * @return On success returns the number of blocks read
+ * On failure returns -1
+ */
+__NO_DISCARD int HTS_GetMany(HTS_info *table_info, const void *keys, size_t n,
+                             HT_result_set *results) __NON_NULL(1, 4);
+
+/**
+ * HTS_Reshard - Moves the records of a closed table over to new_shard_n shards.
+ * The new shards are built next to the old ones as the next generation, and once they are complete a new
+ * table file is renamed over the old one, so the table switches generations in one step. The old shards
+ * get removed afterwards. On failure the table is left as it was and the new generation gets removed.
+ * Secondary indexes on any of the shards point to stale blocks afterwards and must be rebuilt.
+ * @param table_name The name of the table
+ * @param new_shard_n The new number of shards, at most HTS_MAX_SHARDS
+ * @return On success returns 0
+ * On failure returns -1
+ */
+__NO_DISCARD int HTS_Reshard(char *table_name, size_t new_shard_n) __NON_NULL(1);
+
+#endif //DB_EX1_HTS_H
@@ -0,0 +1,129 @@
+#ifndef DB_EX1_BATCH_H
+#define DB_EX1_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "attributes.h"
+#include "record.h"
+#include "HT.h"
+
+/*
+ * Column batches of records: the ids, names, surnames and addresses of up to capacity records, each in an
+ * array of its own, row r of the batch being entry r of every column. Strings keep the fixed width of their
+ * Record field, zero padded and not NUL terminated when they fill it, so that a string column is one
+ * contiguous array of width sized cells.
+ *
+ * The batches get filled straight from the block entries, a column at a time, and handed to a callback
+ * once full. The selection vector lists the rows that passed the filters so far: every row when the
+ * callback gets the batch, and the HT_BatchSelect filters narrow it down without touching the columns.
+ */
+#define HT_BATCH_NAME_SIZE sizeof(((Record *) 0)->name)
+#define HT_BATCH_SURNAME_SIZE sizeof(((Record *) 0)->surname)
+#define HT_BATCH_ADDRESS_SIZE sizeof(((Record *) 0)->address)
+
+typedef enum {
+  HT_COLUMN_NAME,
+  HT_COLUMN_SURNAME,
+  HT_COLUMN_ADDRESS
+} HT_batch_column;
+
+typedef struct {
+  size_t capacity;
+  size_t count;
+  int *ids;
+  char (*names)[HT_BATCH_NAME_SIZE];
+  char (*surnames)[HT_BATCH_SURNAME_SIZE];
+  char (*addresses)[HT_BATCH_ADDRESS_SIZE];
+  /* The block every row was read from */
+  int *blockIds;
+  /* The key every row of a multi-get matched. Optional, may be NULL */
+  uint32_t *keyIndexes;
+  /* The rows that passed the filters, in row order */
+  uint32_t *selection;
+  size_t selected;
+} HT_batch;
+
+/* Gets every full batch, and the last one when it is not empty. Returning non zero stops the read */
+typedef int (*HT_batch_callback)(HT_batch *batch, void *context);
+
+/**
+ * HT_AllocBatch - Allocates every column of a batch. Batches may as well be set up by hand.
+ * @param batch The batch
+ * @param capacity The number of rows, at most UINT32_MAX
+ * @return On success returns 0, and the batch must be released with HT_FreeBatch
+ * On failure returns -1
+ */
+__NO_DISCARD int HT_AllocBatch(HT_batch *batch, size_t capacity) __NON_NULL(1);
+
+/**
+ * HT_FreeBatch - Releases the columns allocated by HT_AllocBatch
+ * @param batch The batch
+ */
+void HT_FreeBatch(HT_batch *batch);
+
+/**
+ * HT_ScanBatches - Visits every record of the index in file order like HT_Scan, in column batches
+ * @param header_info The header info from which we take the static hashing file information
+ * @param batch The batch to fill, reused for every batch
+ * @param callback Gets called for every batch
+ * @param context Passed untouched to the callback
+ * @return On success returns the number of blocks read
+ * On failure returns -1
+ */
+__NO_DISCARD int HT_ScanBatches(HT_info *header_info, HT_batch *batch, HT_batch_callback callback,
+                                void *context) __NON_NULL(1, 2, 3);
+
+/**
+ * HT_GetManyBatches - Finds the records of many primary key values at once like HT_GetMany, in column batches.
+ * The rows of every key come in chain order, the keys of a bucket together, and keyIndexes tells them apart.
+ * @param header_info The header info from which we take the static hashing file information
+ * @param keys An array of n keys. For 'i' indexes an array of int, for 'c' indexes an array of char *
+ * @param n The number of keys
+ * @param batch The batch to fill, reused for every batch
+ * @param callback Gets called for every batch
+ * @param context Passed untouched to the callback
+ * @return On success returns the number of blocks read
+ * On failure returns -1
+ */
+__NO_DISCARD int HT_GetManyBatches(HT_info *header_info, const void *keys, size_t n, HT_batch *batch,
+                                   HT_batch_callback callback, void *context) __NON_NULL(1, 4, 5);
+
+/**
+ * HT_BatchSelectIdRange - Keeps the selected rows whose id is in [min, max]
+ * @param batch The batch
+ * @param min The smallest id kept
+ * @param max The largest id kept
+ * @return Returns the number of rows still selected
+ */
+size_t HT_BatchSelectIdRange(HT_batch *batch, int min, int max) __NON_NULL(1);
+
+/**
+ * HT_BatchSelectEquals - Keeps the selected rows whose string column is exactly value
+ * @param batch The batch
+ * @param column The column
+ * @param value The string
+ * @return Returns the number of rows still selected
+ */
+size_t HT_BatchSelectEquals(HT_batch *batch, HT_batch_column column, const char *value) __NON_NULL(1, 3);
+
+/* Used by HT.c */
+
+/**
+ * ht_batch_append - Copies entries of a bucket block into the next rows of a batch
+ * @param batch The batch, with room for n more rows
+ * @param block The block, expanded when it is compressed
+ * @param flags The HT_info flags of the index
+ * @param from The first entry
+ * @param n The number of entries
+ * @param block_id The block, for the blockIds column
+ */
+void ht_batch_append(HT_batch *batch, const void *block, unsigned int flags, unsigned int from, unsigned int n,
+                     int block_id) __NON_NULL(1, 2);
+
+/**
+ * ht_batch_flush - Selects every row of the batch, hands it to the callback and empties it
+ * @return Returns what the callback returned
+ */
+int ht_batch_flush(HT_batch *batch, HT_batch_callback callback, void *context) __NON_NULL(1, 2);
+
+#endif //DB_EX1_BATCH_H
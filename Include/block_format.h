@@ -0,0 +1,244 @@
+#ifndef DB_EX1_BLOCK_FORMAT_H
+#define DB_EX1_BLOCK_FORMAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory.h>
+#include "attributes.h"
+#include "bucket.h"
+#include "record.h"
+#include "HT.h"
+
+/*
+ * Record encodings of the HT bucket and overflow blocks. Both start with a bucket_info_t.
+ *
+ * HT_FLAG_COMPACT unset: record_n fixed size Records right after the header.
+ *
+ * HT_FLAG_COMPACT set: every entry is the id followed by the name, surname and address,
+ * each one a length byte and the bytes of the string without padding or terminator.
+ * Entries grow upwards from the header, and a directory of 16 bit entry offsets grows downwards
+ * from the end of the block, slot i being the i-th uint16_t from the end.
+ * Entries are kept in slot order, next_record is the end of the last entry and
+ * free_space is the gap between the last entry and the directory.
+ */
+#define COMPACT_SLOT_SIZE sizeof(uint16_t)
+#define COMPACT_FIELD_N 3U
+
+typedef struct {
+  size_t offset;
+  size_t size;
+} record_field_t;
+
+static const record_field_t record_fields[COMPACT_FIELD_N] = {
+        {offsetof(Record, name), sizeof(((Record *) 0)->name)},
+        {offsetof(Record, surname), sizeof(((Record *) 0)->surname)},
+        {offsetof(Record, address), sizeof(((Record *) 0)->address)}
+};
+
+/* Maps a field offset of Record to its position in a compact entry */
+static __INLINE inline
+unsigned int compact_field_index(size_t field_offset) {
+  return (field_offset == offsetof(Record, name)) ? 0U : (field_offset == offsetof(Record, surname)) ? 1U : 2U;
+}
+
+static __INLINE inline
+uint16_t *compact_slot(const void *block, unsigned int i) {
+  return (uint16_t *) ((char *) block + BLOCK_SIZE) - 1 - i;
+}
+
+static __INLINE inline
+size_t compact_entry_size(const Record *record) {
+  size_t size = sizeof(int) + COMPACT_FIELD_N;
+  for (unsigned int f = 0U; f != COMPACT_FIELD_N; ++f) {
+    size += strnlen((const char *) record + record_fields[f].offset, record_fields[f].size);
+  }
+  return size;
+}
+
+/* Bytes an entry takes in a block of the given format, directory slot included */
+static __INLINE inline
+size_t block_entry_size(unsigned int flags, const Record *record) {
+  return (flags & HT_FLAG_COMPACT) ? compact_entry_size(record) + COMPACT_SLOT_SIZE : sizeof(Record);
+}
+
+static __INLINE inline
+const Record *fixed_record(const void *block, unsigned int i) {
+  return (const Record *) ((const char *) block + sizeof(bucket_info_t)) + i;
+}
+
+// Stored entries are zero padded behind every string and in the struct padding, so that fixed width
+// compares never see stale bytes and equal records compress the same way
+static __INLINE inline
+void fixed_encode(char *entry, const Record *record) {
+  memset(entry, 0, sizeof(Record));
+  memcpy(entry, &record->id, sizeof(int));
+  for (unsigned int f = 0U; f != COMPACT_FIELD_N; ++f) {
+    const char *field = (const char *) record + record_fields[f].offset;
+    memcpy(entry + record_fields[f].offset, field, strnlen(field, record_fields[f].size));
+  }
+}
+
+/* Writes the compact entry of a record, returns its size */
+static __INLINE inline
+size_t compact_encode(char *entry, const Record *record) {
+  memcpy(entry, &record->id, sizeof(int));
+  char *p = entry + sizeof(int);
+  for (unsigned int f = 0U; f != COMPACT_FIELD_N; ++f) {
+    const char *field = (const char *) record + record_fields[f].offset;
+    size_t len = strnlen(field, record_fields[f].size);
+    *p++ = (char) len;
+    memcpy(p, field, len);
+    p += len;
+  }
+  return (size_t) (p - entry);
+}
+
+/* Appends the record to a block that has block_entry_size bytes free */
+static __INLINE inline
+void block_append(void *block, unsigned int flags, const Record *record) {
+  bucket_info_t *bucket_info = block;
+  char *entry = (char *) block + bucket_info->next_record;
+  if (!(flags & HT_FLAG_COMPACT)) {
+    fixed_encode(entry, record);
+    bucket_info->next_record += sizeof(Record);
+    bucket_info->free_space -= sizeof(Record);
+    ++bucket_info->record_n;
+    return;
+  }
+  *compact_slot(block, bucket_info->record_n) = (uint16_t) bucket_info->next_record;
+  int size = (int) compact_encode(entry, record);
+  bucket_info->next_record += size;
+  bucket_info->free_space -= size + (int) COMPACT_SLOT_SIZE;
+  ++bucket_info->record_n;
+}
+
+/* Overwrites entry i with the record. Returns 0, or -1 when a longer compact entry does not fit the block */
+static __INLINE inline
+int block_replace(void *block, unsigned int flags, unsigned int i, const Record *record) {
+  if (!(flags & HT_FLAG_COMPACT)) {
+    fixed_encode((char *) fixed_record(block, i), record);
+    return 0;
+  }
+  bucket_info_t *bucket_info = block;
+  char entry[sizeof(Record) + COMPACT_FIELD_N];
+  int size = (int) compact_encode(entry, record);
+  uint16_t offset = *compact_slot(block, i);
+  uint16_t end = (i == bucket_info->record_n - 1U) ? (uint16_t) bucket_info->next_record : *compact_slot(block, i + 1U);
+  int growth = size - (end - offset);
+  if (growth > bucket_info->free_space) return -1;
+  // The entries after this one shift by the difference in size
+  memmove((char *) block + end + growth, (char *) block + end, (size_t) bucket_info->next_record - end);
+  memcpy((char *) block + offset, entry, (size_t) size);
+  for (unsigned int j = i + 1U; j < bucket_info->record_n; ++j) {
+    *compact_slot(block, j) = (uint16_t) (*compact_slot(block, j) + growth);
+  }
+  bucket_info->next_record += growth;
+  bucket_info->free_space -= growth;
+  return 0;
+}
+
+/* Returns the string field of entry i, which is not NUL terminated when it fills the whole field */
+static __INLINE inline
+const char *block_record_field(const void *block, unsigned int flags, unsigned int i, size_t field_offset,
+                               size_t *len) {
+  if (!(flags & HT_FLAG_COMPACT)) {
+    const char *field = (const char *) fixed_record(block, i) + field_offset;
+    *len = strnlen(field, record_fields[compact_field_index(field_offset)].size);
+    return field;
+  }
+  const unsigned char *p = (const unsigned char *) block + *compact_slot(block, i) + sizeof(int);
+  for (unsigned int f = compact_field_index(field_offset); f != 0U; --f) p += *p + 1U;
+  *len = *p;
+  return (const char *) p + 1;
+}
+
+static __INLINE inline
+void block_decode(const void *block, unsigned int flags, unsigned int i, Record *record) {
+  if (!(flags & HT_FLAG_COMPACT)) {
+    *record = *fixed_record(block, i);
+    return;
+  }
+  const unsigned char *p = (const unsigned char *) block + *compact_slot(block, i);
+  memcpy(&record->id, p, sizeof(int));
+  p += sizeof(int);
+  for (unsigned int f = 0U; f != COMPACT_FIELD_N; ++f) {
+    char *field = (char *) record + record_fields[f].offset;
+    size_t len = *p++;
+    memcpy(field, p, len);
+    memset(field + len, 0, record_fields[f].size - len);
+    p += len;
+  }
+}
+
+/*
+ * Returns entry i as a Record. Fixed size entries are returned in place,
+ * compact ones get decoded into scratch.
+ */
+static __INLINE inline
+const Record *block_record(const void *block, unsigned int flags, unsigned int i, Record *scratch) {
+  if (!(flags & HT_FLAG_COMPACT)) return fixed_record(block, i);
+  block_decode(block, flags, i, scratch);
+  return scratch;
+}
+
+/* Removes entry i and closes the gap it leaves behind */
+static __INLINE inline
+void block_remove(void *block, unsigned int flags, unsigned int i) {
+  bucket_info_t *bucket_info = block;
+  unsigned int last = bucket_info->record_n - 1U;
+  if (!(flags & HT_FLAG_COMPACT)) {
+    char *entry = (char *) fixed_record(block, i);
+    memmove(entry, entry + sizeof(Record), (last - i) * sizeof(Record));
+    bucket_info->next_record -= sizeof(Record);
+    bucket_info->free_space += sizeof(Record);
+    --bucket_info->record_n;
+    return;
+  }
+  uint16_t offset = *compact_slot(block, i);
+  uint16_t end = (i == last) ? (uint16_t) bucket_info->next_record : *compact_slot(block, i + 1U);
+  uint16_t size = end - offset;
+  memmove((char *) block + offset, (char *) block + end, (size_t) bucket_info->next_record - end);
+  for (unsigned int j = i; j != last; ++j) {
+    *compact_slot(block, j) = *compact_slot(block, j + 1U) - size;
+  }
+  bucket_info->next_record -= size;
+  bucket_info->free_space += size + (int) COMPACT_SLOT_SIZE;
+  --bucket_info->record_n;
+}
+
+/*
+ * Returns the end of the entries of a block of block_size bytes, or 0 when the header does not describe a valid block.
+ * Only expanded compressed blocks are larger than BLOCK_SIZE. *padding receives the unused bytes inside the entries.
+ */
+static __INLINE inline
+size_t block_entries_end(const void *block, unsigned int flags, size_t block_size, size_t *padding) {
+  const bucket_info_t *bucket_info = block;
+  *padding = 0U;
+  if (!(flags & HT_FLAG_COMPACT)) {
+    size_t end = sizeof(bucket_info_t) + (size_t) bucket_info->record_n * sizeof(Record);
+    if (end > block_size) return 0U;
+    for (unsigned int i = 0U; i != bucket_info->record_n; ++i) {
+      for (unsigned int f = 0U; f != COMPACT_FIELD_N; ++f) {
+        const char *field = (const char *) fixed_record(block, i) + record_fields[f].offset;
+        size_t len = strnlen(field, record_fields[f].size);
+        if (len < record_fields[f].size) *padding += record_fields[f].size - len - 1U;
+      }
+    }
+    return end;
+  }
+  size_t directory = (size_t) bucket_info->record_n * COMPACT_SLOT_SIZE;
+  if (directory > BLOCK_SIZE - sizeof(bucket_info_t)) return 0U;
+  size_t end = sizeof(bucket_info_t);
+  for (unsigned int i = 0U; i != bucket_info->record_n; ++i) {
+    if (*compact_slot(block, i) != end) return 0U;
+    end += sizeof(int);
+    for (unsigned int f = 0U; f != COMPACT_FIELD_N; ++f) {
+      if (end >= BLOCK_SIZE - directory) return 0U;
+      end += (size_t) ((const unsigned char *) block)[end] + 1U;
+    }
+    if (end > BLOCK_SIZE - directory) return 0U;
+  }
+  return end;
+}
+
+#endif //DB_EX1_BLOCK_FORMAT_H
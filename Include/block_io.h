@@ -0,0 +1,215 @@
+#ifndef DB_EX1_BLOCK_IO_H
+#define DB_EX1_BLOCK_IO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <memory.h>
+#include "attributes.h"
+#include "crc32c.h"
+#include "metrics.h"
+#include "record.h"
+#include "bucket.h"
+#include "BF.h"
+
+/*
+ * Every block access of the index code goes through these,
+ * so that the handle metrics see each one of them.
+ *
+ * Overflow blocks of HT_FLAG_COMPRESS_COLD indexes may be stored compressed: a bucket_info_t with
+ * BLOCK_COMPRESSED set and free_space 0, a 16 bit compressed length and the LZ compressed entries.
+ * Such a block holds up to HT_EXPANDED_BLOCK_SIZE bytes of fixed size entries.
+ * ht_read_block expands it into ht_expanded_block and returns that instead of the BF buffer,
+ * so the callers see a plain block, only larger. Writing it back compresses it again.
+ *
+ * Every block carries a CRC32C of its BLOCK_SIZE bytes as stored by the BF layer: bucket blocks in
+ * bucket_info_t.checksum, block 0 in its last 4 bytes. ht_write_block recomputes it, and ht_read_block
+ * checks it when ht_verify_checksums is set. The headers get checked on every open.
+ *
+ * Block 0 also carries HT_FORMAT_VERSION in the 4 bytes before its checksum. Files written before
+ * the version existed hold 0 there and get refused like those of any other version.
+ */
+#define HT_EXPANDED_BLOCK_SIZE (4U * BLOCK_SIZE)
+// Room left in a block when it gets compressed, so that changing its entries later rarely makes it overflow.
+// Compressed sizes do not shrink with the input, so ht_store_expanded_block still splits a block that does
+#define HT_COMPRESSION_SLACK 32U
+
+typedef struct {
+  int fileDesc;
+  int blockId;
+  char data[HT_EXPANDED_BLOCK_SIZE];
+} expanded_block_t;
+
+#define HT_HEADER_CHECKSUM_OFFSET (BLOCK_SIZE - sizeof(uint32_t))
+#define HT_HEADER_VERSION_OFFSET (HT_HEADER_CHECKSUM_OFFSET - sizeof(uint32_t))
+// Bumped whenever the layout of block 0 or of the bucket blocks changes
+#define HT_FORMAT_VERSION 1U
+
+/* The block that got expanded last. The BF layer is not reentrant and neither is this */
+extern expanded_block_t ht_expanded_block;
+
+/* Set by HT_SetChecksumVerification */
+extern int ht_verify_checksums;
+
+/**
+ * ht_commit_block - Checksums a BF buffer and marks it dirty
+ * @param file_desc The file of the block
+ * @param block_id The block
+ * @return On success returns 0
+ * On failure returns -1
+ */
+__NO_DISCARD int ht_commit_block(int file_desc, int block_id);
+
+/**
+ * ht_checksum_failure - Reports a block whose checksum does not match its contents
+ * @param file_desc The file of the block
+ * @param block_id The block
+ * @return Returns -1
+ */
+int ht_checksum_failure(int file_desc, int block_id);
+
+/**
+ * ht_expand - Decompresses a compressed block
+ * @param block The compressed block
+ * @param expanded Receives the plain block, HT_EXPANDED_BLOCK_SIZE bytes
+ * @return On success returns 0
+ * On failure returns -1
+ */
+__NO_DISCARD int ht_expand(const void *block, void *expanded) __NON_NULL(1, 2);
+
+/**
+ * ht_expand_block - Expands a compressed block read from the BF layer into ht_expanded_block
+ * @param file_desc The file of the block
+ * @param block_id The block
+ * @param block Points to the BF buffer of the block and receives the expanded block
+ * @return On success returns 0
+ * On failure returns -1
+ */
+__NO_DISCARD int ht_expand_block(int file_desc, int block_id, void **block) __NON_NULL(3);
+
+/**
+ * ht_store_expanded_block - Writes ht_expanded_block back to its BF buffer.
+ * It gets stored plain when its entries fit in a block again, otherwise compressed.
+ * Entries that no longer compress into one block get split over new plain overflow blocks linked in behind it.
+ * @param metrics The metrics of the handle
+ * @param file_desc The file of the block
+ * @param block_id The block
+ * @return On success returns 0
+ * On failure returns -1
+ */
+__NO_DISCARD int ht_store_expanded_block(HT_metrics *metrics, int file_desc, int block_id);
+
+/**
+ * ht_append_compressed - Appends a record to a full block of fixed size entries by compressing it
+ * @param metrics The metrics of the handle
+ * @param file_desc The file of the block
+ * @param block_id The block
+ * @param block The block as returned by ht_read_block
+ * @param record The record to append
+ * @return Returns 1 when the record got appended, 0 when it does not fit even compressed
+ * On failure returns -1
+ */
+__NO_DISCARD int ht_append_compressed(HT_metrics *metrics, int file_desc, int block_id, const void *block,
+                                      const Record *record) __NON_NULL(4, 5);
+
+static __INLINE inline
+uint32_t ht_block_checksum(const void *block) {
+  static const uint32_t zero = 0U;
+  const size_t offset = offsetof(bucket_info_t, checksum);
+  uint32_t crc = ht_crc32c(0U, block, offset);
+  crc = ht_crc32c(crc, &zero, sizeof(uint32_t));
+  return ht_crc32c(crc, (const char *) block + offset + sizeof(uint32_t), BLOCK_SIZE - offset - sizeof(uint32_t));
+}
+
+static __INLINE inline
+void ht_seal_block(void *block) {
+  ((bucket_info_t *) block)->checksum = ht_block_checksum(block);
+}
+
+static __INLINE inline
+int ht_block_intact(const void *block) {
+  return ((const bucket_info_t *) block)->checksum == ht_block_checksum(block);
+}
+
+static __INLINE inline
+void ht_seal_header(void *block) {
+  uint32_t version = HT_FORMAT_VERSION;
+  memcpy((char *) block + HT_HEADER_VERSION_OFFSET, &version, sizeof(uint32_t));
+  uint32_t crc = ht_crc32c(0U, block, HT_HEADER_CHECKSUM_OFFSET);
+  memcpy((char *) block + HT_HEADER_CHECKSUM_OFFSET, &crc, sizeof(uint32_t));
+}
+
+static __INLINE inline
+int ht_header_intact(const void *block) {
+  uint32_t crc;
+  memcpy(&crc, (const char *) block + HT_HEADER_CHECKSUM_OFFSET, sizeof(uint32_t));
+  return crc == ht_crc32c(0U, block, HT_HEADER_CHECKSUM_OFFSET);
+}
+
+/* Whether block 0 got written by this format version, says why not on stderr */
+static __INLINE inline
+int ht_header_current(const void *block, const char *file_name) {
+  uint32_t version;
+  memcpy(&version, (const char *) block + HT_HEADER_VERSION_OFFSET, sizeof(uint32_t));
+  if (version == HT_FORMAT_VERSION) return 1;
+  fprintf(stderr, "%s has format version %u, this build reads version %u only\n", file_name, (unsigned) version,
+          HT_FORMAT_VERSION);
+  return 0;
+}
+
+static __INLINE inline
+int ht_fetch_block(int file_desc, int block_id, void **block) {
+  int res = BF_ReadBlock(file_desc, block_id, block);
+  if (res < 0) return res;
+  if (ht_verify_checksums && !ht_block_intact(*block)) return ht_checksum_failure(file_desc, block_id);
+  if (((const bucket_info_t *) *block)->flags & BLOCK_COMPRESSED) return ht_expand_block(file_desc, block_id, block);
+  if (ht_expanded_block.fileDesc == file_desc && ht_expanded_block.blockId == block_id) ht_expanded_block.blockId = -1;
+  return res;
+}
+
+static __INLINE inline
+int ht_read_block(HT_metrics *metrics, int file_desc, int block_id, void **block) {
+  HT_METRIC_ADD(metrics, blockReads, 1U);
+  return ht_fetch_block(file_desc, block_id, block);
+}
+
+static __INLINE inline
+int ht_write_block(HT_metrics *metrics, int file_desc, int block_id) {
+  HT_METRIC_ADD(metrics, blockWrites, 1U);
+  if (ht_expanded_block.fileDesc == file_desc && ht_expanded_block.blockId == block_id) {
+    return ht_store_expanded_block(metrics, file_desc, block_id);
+  }
+  return ht_commit_block(file_desc, block_id);
+}
+
+/*
+ * Appends block_id, the next block of the file, as a sealed empty bucket in the BF buffer, so that it passes
+ * verification before its first write. BF_AllocateBlock does not clear the block: the BF layer keeps blocks
+ * cached by file name, so a file created under the name of a deleted one gets the old contents back.
+ */
+static __INLINE inline
+int ht_append_block(int file_desc, int block_id) {
+  void *block;
+  if (BF_AllocateBlock(file_desc) < 0 || BF_ReadBlock(file_desc, block_id, &block) < 0) return -1;
+  memset(block, 0, BLOCK_SIZE);
+  initialize_block(block);
+  ht_seal_block(block);
+  return 0;
+}
+
+/* Appends an empty block and returns its id. BF_GetBlockCounter walks the whole file, so it gets called once */
+static __INLINE inline
+int ht_allocate_block(HT_metrics *metrics, int file_desc) {
+  HT_METRIC_ADD(metrics, blockAllocations, 1U);
+  int block_id = BF_GetBlockCounter(file_desc);
+  if (block_id < 0 || ht_append_block(file_desc, block_id) < 0) return -1;
+  return block_id;
+}
+
+/* Forgets the expanded block of a file that is getting closed */
+static __INLINE inline
+void ht_release_blocks(int file_desc) {
+  if (ht_expanded_block.fileDesc == file_desc) ht_expanded_block.blockId = -1;
+}
+
+#endif //DB_EX1_BLOCK_IO_H
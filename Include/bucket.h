@@ -0,0 +1,47 @@
+#ifndef DB_EX1_BUCKET_H
+#define DB_EX1_BUCKET_H
+
+#include <memory.h>
+#include <stdint.h>
+#include "attributes.h"
+#include "BF.h"
+
+/*
+ * Layout of the bucket and overflow blocks shared by HT and SHT files.
+ * Every block after block 0 starts with a bucket_info_t followed by the entries.
+ */
+typedef struct {
+  int overflow_bucket;
+  int next_record;
+  int free_space;
+  unsigned int record_n;
+  unsigned int flags;
+  /* CRC32C of the whole block with this field taken as 0, see block_io.h */
+  uint32_t checksum;
+} bucket_info_t;
+
+/* Flags of bucket_info_t */
+// The entries are stored compressed, see block_io.h
+#define BLOCK_COMPRESSED 0x1U
+// A block of SHT ids that spilled out of their key entry, see secondary_format.h
+#define BLOCK_POSTINGS 0x2U
+
+static __INLINE __NO_DISCARD inline
+bucket_info_t create_bucket_info(void) {
+  return (bucket_info_t) {
+          .overflow_bucket = -1,
+          .next_record = sizeof(bucket_info_t),
+          .free_space = BLOCK_SIZE - sizeof(bucket_info_t),
+          .record_n = 0U,
+          .flags = 0U,
+          .checksum = 0U
+  };
+}
+
+static __INLINE inline
+void initialize_block(void *block) {
+  bucket_info_t bucket_info = create_bucket_info();
+  memcpy(block, &bucket_info, sizeof(bucket_info_t));
+}
+
+#endif //DB_EX1_BUCKET_H
@@ -0,0 +1,84 @@
+#ifndef DB_EX1_CATALOG_H
+#define DB_EX1_CATALOG_H
+
+#include <stddef.h>
+#include "attributes.h"
+#include "HT.h"
+
+#define HT_CATALOG_DEFAULT_IDLE_LIMIT 8U
+
+/*
+ * A process wide cache of open index handles, keyed by file name and reference counted.
+ * Acquiring a cached index costs a name lookup instead of BF_OpenFile and parsing block 0.
+ * Released handles stay open until more than the idle limit of them pile up, and then the least
+ * recently released ones get closed. When the BF file table is full, opening a new index closes
+ * idle handles until it fits.
+ *
+ * Handles of the catalog must be given back with the matching release function and never closed directly.
+ */
+
+/**
+ * HT_CatalogAcquire - Returns the cached handle of a primary index, opening it on first use
+ * @param index_name The index
+ * @return On success returns the handle
+ * On failure returns NULL
+ */
+__NO_DISCARD HT_info *HT_CatalogAcquire(const char *index_name) __NON_NULL(1);
+
+/**
+ * HT_CatalogRelease - Gives back a handle returned by HT_CatalogAcquire
+ * @param header_info The handle
+ * @return On success returns 0
+ * On failure, or when the handle does not belong to the catalog, returns -1
+ */
+__NO_DISCARD int HT_CatalogRelease(HT_info *header_info) __NON_NULL(1);
+
+/**
+ * SHT_CatalogAcquire - Returns the cached handle of a secondary index, opening it on first use
+ * @param secondary_index_name The secondary index
+ * @return On success returns the handle
+ * On failure returns NULL
+ */
+__NO_DISCARD SHT_info *SHT_CatalogAcquire(const char *secondary_index_name) __NON_NULL(1);
+
+/**
+ * SHT_CatalogRelease - Gives back a handle returned by SHT_CatalogAcquire
+ * @param header_info The handle
+ * @return On success returns 0
+ * On failure, or when the handle does not belong to the catalog, returns -1
+ */
+__NO_DISCARD int SHT_CatalogRelease(SHT_info *header_info) __NON_NULL(1);
+
+/**
+ * SHT_CatalogGetAllEntries - SHT_SecondaryGetAllEntries with the primary index resolved
+ * from the file name stored in the secondary index and taken from the catalog
+ * @param sht_info The secondary index
+ * @param value The key to look for
+ * @return On success returns the number of blocks read until we found all the records
+ * On failure returns -1
+ */
+__NO_DISCARD int SHT_CatalogGetAllEntries(SHT_info *sht_info, void *value) __NON_NULL(1, 2);
+
+/**
+ * HT_CatalogSetIdleLimit - Sets how many released handles stay open, closing the extra ones right away
+ * @param limit The number of idle handles to keep, 0 closes handles as soon as they are released
+ */
+void HT_CatalogSetIdleLimit(size_t limit);
+
+/**
+ * HT_CatalogEvict - Closes the cached handle of a file so that the next acquire reads it again.
+ * Meant for files that get replaced, as HT_Resize does.
+ * @param filename The primary or secondary index
+ * @return On success, or when the file is not cached, returns 0
+ * When the handle is in use or fails to close returns -1
+ */
+__NO_DISCARD int HT_CatalogEvict(const char *filename) __NON_NULL(1);
+
+/**
+ * HT_CatalogCloseAll - Closes every idle handle of the catalog
+ * @return Returns 0 when the catalog is empty afterwards
+ * When some handles are still in use or fail to close returns -1
+ */
+__NO_DISCARD int HT_CatalogCloseAll(void);
+
+#endif //DB_EX1_CATALOG_H
@@ -0,0 +1,18 @@
+#ifndef DB_EX1_CRC32C_H
+#define DB_EX1_CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "attributes.h"
+
+/**
+ * ht_crc32c - Extends a CRC32C (Castagnoli) checksum over n more bytes.
+ * Uses the SSE4.2 crc32 instruction when the CPU has it, a lookup table otherwise.
+ * @param crc The checksum of the bytes before, 0 to start a new one
+ * @param data The bytes to checksum
+ * @param n The number of bytes
+ * @return Returns the checksum of all the bytes so far
+ */
+__NO_DISCARD uint32_t ht_crc32c(uint32_t crc, const void *data, size_t n) __NON_NULL(2);
+
+#endif //DB_EX1_CRC32C_H
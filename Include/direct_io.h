@@ -0,0 +1,62 @@
+#ifndef DB_EX1_DIRECT_IO_H
+#define DB_EX1_DIRECT_IO_H
+
+#include "attributes.h"
+#include "HT.h"
+
+/*
+ * Sequential reads of whole index files that go around the BF layer and the page cache.
+ *
+ * The BF layer stores a file as a header slot followed by one slot per block, every slot
+ * HT_DIRECT_SLOT_SIZE bytes long, the block taking the first BLOCK_SIZE bytes of its slot.
+ * A direct reader opens the file with O_DIRECT and reads it in chunks of HT_DIRECT_CHUNK_SLOTS slots
+ * into a ring of HT_DIRECT_RING_CHUNKS aligned buffers, a read-ahead thread filling the ring ahead of the
+ * reader. Its memory is the ring whatever the size of the file, the ring buffer of the last closed reader
+ * being kept for the next one. Where O_DIRECT is not supported the file is read through the page cache,
+ * and the chunks are dropped from it once they have been read, so that a scan does not evict what the
+ * other indexes keep hot.
+ *
+ * The BF layer writes its blocks back when a file gets closed, so only files that are not open
+ * are read this way, whatever a handle of the file holds not being on disk yet.
+ */
+#define HT_DIRECT_SLOT_SIZE 1024U
+#define HT_DIRECT_ALIGNMENT 4096U
+#define HT_DIRECT_CHUNK_SLOTS 64U
+#define HT_DIRECT_RING_CHUNKS 4U
+
+typedef struct ht_direct_reader ht_direct_reader_t;
+
+/**
+ * HT_ScanFile - Visits every record of an HT file in file order like HT_Scan, reading it directly
+ * @param filename The file. It must not be open, a handle the catalog keeps idle gets closed first
+ * @param callback Gets called for every record with the block it lives in. Returning non zero stops the scan
+ * @param context Passed untouched to the callback
+ * @return On success returns the number of blocks read
+ * On failure, when the file is not an HT file or the catalog has it in use, returns -1
+ */
+__NO_DISCARD int HT_ScanFile(const char *filename, HT_scan_callback callback, void *context) __NON_NULL(1, 2);
+
+/* Used by statistics.c */
+
+/**
+ * ht_direct_open - Opens a file for a direct sequential read and starts the read-ahead
+ * @param filename The file. It must not be open
+ * @param total_blocks Receives the number of blocks of the file, block 0 included
+ * @return On success returns the reader, to be closed with ht_direct_close
+ * On failure returns NULL
+ */
+__NO_DISCARD ht_direct_reader_t *ht_direct_open(const char *filename, int *total_blocks) __NON_NULL(1, 2);
+
+/**
+ * ht_direct_next - Hands out the next block of the file, starting from block 0
+ * @param reader The reader
+ * @param block Receives the BLOCK_SIZE bytes of the block as stored, valid until the next call
+ * @return Returns 1 while there are blocks, 0 once the file is over
+ * On failure returns -1
+ */
+__NO_DISCARD int ht_direct_next(ht_direct_reader_t *reader, const char **block) __NON_NULL(1, 2);
+
+/* Stops the read-ahead and closes the file */
+void ht_direct_close(ht_direct_reader_t *reader);
+
+#endif //DB_EX1_DIRECT_IO_H
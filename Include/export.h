@@ -0,0 +1,49 @@
+#ifndef DB_EX1_EXPORT_H
+#define DB_EX1_EXPORT_H
+
+#include <stdint.h>
+#include "attributes.h"
+#include "record.h"
+#include "HT.h"
+
+#define HT_EXPORT_FRAME_SIZE (64U << 10U)
+#define HT_EXPORT_NAME_SIZE 32U
+#define HT_EXPORT_RECORD_SIZE (sizeof(uint32_t) + sizeof(((Record *) 0)->name) + sizeof(((Record *) 0)->surname) + \
+                               sizeof(((Record *) 0)->address))
+
+/*
+ * An export file is a sequence of HT_EXPORT_FRAME_SIZE frames, so it can be read and written
+ * with large aligned transfers. All integers are little endian.
+ *
+ * The first frame holds the index header:
+ *   "HTEXPORT", version, frame size, attribute type, attribute length, attribute name
+ *   (HT_EXPORT_NAME_SIZE bytes), bucket count, index flags and the CRC32C of all of them.
+ * Every other frame is
+ *   magic, sequence number, record count, CRC32C of the first 12 bytes and the records
+ * followed by zero padding. A record takes HT_EXPORT_RECORD_SIZE bytes: the id and the three strings
+ * at their full Record width, so the format does not depend on the padding of Record.
+ * The last frame has no records and the number of record frames as its sequence number,
+ * so a truncated file gets rejected.
+ */
+
+/**
+ * HT_Export - Writes every record of an index to an export file with a single sequential scan
+ * @param header_info The index to export
+ * @param filename The export file. It gets created or truncated
+ * @return On success returns the number of records exported
+ * On failure returns -1
+ */
+__NO_DISCARD int HT_Export(HT_info *header_info, const char *filename) __NON_NULL(1, 2);
+
+/**
+ * HT_Import - Creates an index from an export file, loading the records of every frame with HT_InsertMany.
+ * Each frame gets verified against its checksum before any of its records gets inserted.
+ * @param filename The export file
+ * @param index_name The index to create. It must not exist
+ * @param buckets The bucket count of the new index, 0 keeps the one of the exported index
+ * @return On success returns the number of records imported
+ * On failure returns -1 and removes the new index
+ */
+__NO_DISCARD int HT_Import(const char *filename, char *index_name, int buckets) __NON_NULL(1, 2);
+
+#endif //DB_EX1_EXPORT_H
@@ -0,0 +1,30 @@
+#ifndef DB_EX1_JOIN_H
+#define DB_EX1_JOIN_H
+
+#include "attributes.h"
+#include "record.h"
+#include "HT.h"
+
+/* Gets every matching pair. The records are copies and stay valid until it returns. Returning non zero stops the join */
+typedef int (*HT_join_callback)(const Record *left, const Record *right, void *context);
+
+/**
+ * HT_Join - Equi-joins two indexes on the key attribute of the left one, the right records
+ * getting matched on the same field. Strings match when they are equal, not on a prefix.
+ *
+ * When the right index hashes the same attribute into the same number of buckets, equal keys
+ * share their bucket, so bucket i of the left index only gets joined with bucket i of the right one,
+ * one chain pair in memory at a time. Otherwise both indexes get scanned sequentially into
+ * in-memory partitions by key, and every partition pair gets joined on its own.
+ * Either way each pair gets joined by a hash table over its left records, probed with the right ones.
+ *
+ * @param left The index whose key attribute is the join attribute
+ * @param right The other index
+ * @param callback Gets called for every matching pair
+ * @param context Passed untouched to the callback
+ * @return On success returns the number of pairs passed to the callback
+ * On failure returns -1
+ */
+__NO_DISCARD int HT_Join(HT_info *left, HT_info *right, HT_join_callback callback, void *context) __NON_NULL(1, 2, 3);
+
+#endif //DB_EX1_JOIN_H
@@ -0,0 +1,38 @@
+#ifndef DB_EX1_KEY_KERNEL_H
+#define DB_EX1_KEY_KERNEL_H
+
+#include <stddef.h>
+#include "attributes.h"
+
+/*
+ * Key matching specialized per key type and block format. HT_OpenIndex picks one kernel for the
+ * index, so the lookup loops neither branch on attrType per record nor look up the field offset,
+ * and string keys get compared with memcmp against a key whose length is known up front.
+ * Strings keep the prefix semantics of strncmp(field, key, key_len).
+ */
+typedef struct ht_key_kernel {
+  /**
+   * find - Returns the first entry of a bucket block, starting at entry from, that matches the key
+   * @param block The block
+   * @param from The first entry to look at
+   * @param key The key, an int or a string
+   * @param key_len The length of a string key, as returned by key_length
+   * @return Returns the index of the entry, or record_n when no entry matches
+   */
+  unsigned int (*find)(const void *block, unsigned int from, const void *key, size_t key_len);
+  /* The length find expects for a key */
+  size_t (*key_length)(const void *key);
+} ht_key_kernel_t;
+
+/**
+ * ht_select_key_kernel - Picks the kernel of an index
+ * @param attribute_type 'i' or 'c'
+ * @param attribute_name The key field of 'c' indexes
+ * @param len The length of attribute_name
+ * @param flags The HT_info flags of the index
+ * @return Returns the kernel, or NULL when the index has no valid key field
+ */
+__NO_DISCARD const ht_key_kernel_t *ht_select_key_kernel(char attribute_type, const char *attribute_name, size_t len,
+                                                         unsigned int flags);
+
+#endif //DB_EX1_KEY_KERNEL_H
@@ -0,0 +1,68 @@
+#ifndef DB_EX1_LOADER_H
+#define DB_EX1_LOADER_H
+
+#include <stddef.h>
+#include "attributes.h"
+#include "record.h"
+#include "HT.h"
+
+#define HT_LOADER_DEFAULT_BATCH 4096U
+#define HT_LOADER_CHUNK_SIZE (1U << 20U)
+
+/*
+ * Record files hold one record per line in the form
+ *   {id, name, surname, address}
+ * with optional blanks around the fields and optional double quotes around the strings.
+ * The address runs up to the last closing brace of the line, so it may contain commas.
+ */
+
+typedef int (*HT_loader_sink)(const Record *records, size_t n, void *context);
+
+typedef struct {
+  /* Records handed to the sink at a time, 0 picks HT_LOADER_DEFAULT_BATCH */
+  size_t batchSize;
+  /* Stop after that many records, 0 loads the whole file */
+  size_t maxRecords;
+  /* Parse on a separate thread while the sink consumes the previous batch */
+  int parallel;
+} HT_loader_options;
+
+typedef struct {
+  size_t lines;
+  size_t records;
+  /* Lines that are not a record, they get skipped */
+  size_t malformed;
+  /* Strings cut short to fit their Record field */
+  size_t truncated;
+} HT_loader_stats;
+
+/**
+ * HT_LoadRecords - Streams the records of a record file into batches of Records and hands every batch to sink.
+ * The file is read in HT_LOADER_CHUNK_SIZE chunks and parsed in place, without per line allocation or formatting.
+ * The sink always runs on the calling thread, so it may use the BF layer even when parsing is parallel.
+ *
+ * @param filename The record file
+ * @param options The loader options, NULL picks the defaults
+ * @param sink Called with every batch. Returning a negative value stops the load
+ * @param context Passed untouched to the sink
+ * @param stats If not NULL, receives the counters of the load
+ * @return On success returns 0
+ * On failure, or when the sink fails, returns -1
+ */
+__NO_DISCARD int HT_LoadRecords(const char *filename, const HT_loader_options *options, HT_loader_sink sink,
+                                void *context, HT_loader_stats *stats) __NON_NULL(1, 3);
+
+/**
+ * HT_LoadIndex - Loads a record file into an open index with HT_InsertMany
+ *
+ * @param header_info The index to load into
+ * @param filename The record file
+ * @param options The loader options, NULL picks the defaults
+ * @param stats If not NULL, receives the counters of the load
+ * @return On success returns 0
+ * On failure returns -1
+ */
+__NO_DISCARD int HT_LoadIndex(HT_info *header_info, const char *filename, const HT_loader_options *options,
+                              HT_loader_stats *stats) __NON_NULL(1, 2);
+
+#endif //DB_EX1_LOADER_H
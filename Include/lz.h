@@ -0,0 +1,35 @@
+#ifndef DB_EX1_LZ_H
+#define DB_EX1_LZ_H
+
+#include <stddef.h>
+#include "attributes.h"
+
+/*
+ * A small LZ77 codec using the LZ4 block format: every sequence is a token byte holding the literal
+ * and match lengths, the literals, and a 16 bit little endian match offset. It is meant for single
+ * blocks of a few KB, so it keeps its hash table on the stack and needs no dictionary or framing.
+ */
+
+/**
+ * ht_lz_compress - Compresses n bytes of src into dst
+ * @param src The bytes to compress, at most 64KB
+ * @param n The number of bytes to compress
+ * @param dst Receives the compressed bytes
+ * @param capacity The size of dst
+ * @return On success returns the compressed size.
+ * When the output does not fit in capacity bytes returns -1.
+ */
+__NO_DISCARD int ht_lz_compress(const void *src, size_t n, void *dst, size_t capacity) __NON_NULL(1, 3);
+
+/**
+ * ht_lz_decompress - Decompresses n bytes of src into dst
+ * @param src The compressed bytes
+ * @param n The number of compressed bytes
+ * @param dst Receives the decompressed bytes
+ * @param capacity The size of dst
+ * @return On success returns the decompressed size.
+ * When the input is malformed or does not fit in capacity bytes returns -1.
+ */
+__NO_DISCARD int ht_lz_decompress(const void *src, size_t n, void *dst, size_t capacity) __NON_NULL(1, 3);
+
+#endif //DB_EX1_LZ_H
@@ -0,0 +1,65 @@
+#ifndef DB_EX1_METRICS_H
+#define DB_EX1_METRICS_H
+
+#include <stdint.h>
+#include <time.h>
+
+// Latency slot i counts operations that took [2^(i-1), 2^i) nanoseconds
+#define HT_LATENCY_SLOTS 40U
+
+typedef enum {
+  HT_OP_INSERT,
+  HT_OP_GET,
+  HT_OP_DELETE,
+  HT_OP_UPDATE,
+  HT_OP_N
+} HT_operation;
+
+typedef struct {
+  unsigned long blockReads;
+  unsigned long blockWrites;
+  unsigned long blockAllocations;
+  unsigned long operations[HT_OP_N];
+  unsigned long chainHops;
+  unsigned long compares;
+  unsigned long hashCollisions;
+  unsigned long latency[HT_OP_N][HT_LATENCY_SLOTS];
+} HT_metrics;
+
+/*
+ * The counters only exist when the build defines HT_METRICS.
+ * Otherwise the handles carry a NULL metrics pointer and every macro below compiles to nothing.
+ */
+#ifdef HT_METRICS
+
+#define HT_METRIC_ADD(metrics, counter, n) \
+do { \
+  if ((metrics) != NULL) (metrics)->counter += (n); \
+} while (0U)
+
+#define HT_METRIC_TIMER_START(timer) \
+  struct timespec timer; \
+  clock_gettime(CLOCK_MONOTONIC, &timer)
+
+#define HT_METRIC_TIMER_STOP(metrics, operation, timer) \
+do { \
+  if ((metrics) != NULL) { \
+    struct timespec timer##_end; \
+    clock_gettime(CLOCK_MONOTONIC, &timer##_end); \
+    uint64_t ns = (uint64_t) (timer##_end.tv_sec - timer.tv_sec) * 1000000000U + \
+                  (uint64_t) timer##_end.tv_nsec - (uint64_t) timer.tv_nsec; \
+    unsigned int slot = ns ? 64U - (unsigned int) __builtin_clzll(ns) : 0U; \
+    ++(metrics)->operations[operation]; \
+    ++(metrics)->latency[operation][slot < HT_LATENCY_SLOTS ? slot : HT_LATENCY_SLOTS - 1U]; \
+  } \
+} while (0U)
+
+#else
+
+#define HT_METRIC_ADD(metrics, counter, n) ((void) (metrics))
+#define HT_METRIC_TIMER_START(timer) ((void) 0)
+#define HT_METRIC_TIMER_STOP(metrics, operation, timer) ((void) (metrics))
+
+#endif
+
+#endif //DB_EX1_METRICS_H
@@ -31,6 +31,6 @@ __NO_DISCARD Record create_record(int id, const char *restrict name,
  * print_record - Prints the information about the given record
  * @param record The record whose information will be printed
  */
-void print_record(Record *record) __NON_NULL(1);
+void print_record(const Record *record) __NON_NULL(1);
 
 #endif //DB_EX1_RECORD_H
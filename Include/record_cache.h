@@ -0,0 +1,88 @@
+#ifndef DB_EX1_RECORD_CACHE_H
+#define DB_EX1_RECORD_CACHE_H
+
+#include <stddef.h>
+#include "attributes.h"
+#include "record.h"
+#include "HT.h"
+
+/*
+ * An optional per handle cache of HT_GetAllEntries results, keyed by id, for indexes on the id.
+ * A cached lookup prints its records without hashing or reading a single block.
+ *
+ * The cache holds at most its budget of bytes, counting the entries and their records.
+ * Admission is TinyLFU: every lookup bumps the key in a count-min sketch of counters saturating at 15,
+ * which get halved every 10 lookups per counter so that old popularity fades. A missed key only gets
+ * cached when the sketch counts it more often than the least recently used entry it would replace,
+ * so a scan over cold keys can not flush the hot ones.
+ *
+ * HT_InsertRecord, HT_InsertEntry, HT_InsertMany, HT_DeleteEntry, HT_Update and HT_Upsert drop the cached
+ * result of the ids they touch. Only changes made through the same handle are seen, other handles of
+ * the same file keep their stale results.
+ */
+
+typedef struct {
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long admissions;
+  unsigned long rejections;
+  unsigned long evictions;
+  unsigned long invalidations;
+  size_t entries;
+  size_t bytes;
+} HT_cache_stats;
+
+struct ht_record_cache;
+
+/**
+ * HT_EnableRecordCache - Puts a record cache in front of HT_GetAllEntries, replacing any previous one
+ * @param header_info The index, it must be on an 'i' attribute
+ * @param budget The memory the cache may take in bytes
+ * @return On success returns 0
+ * On failure, or when the budget can not hold a single entry, returns -1
+ */
+__NO_DISCARD int HT_EnableRecordCache(HT_info *header_info, size_t budget) __NON_NULL(1);
+
+/**
+ * HT_DisableRecordCache - Drops the record cache of a handle. HT_CloseIndex does it too
+ * @param header_info The index
+ */
+void HT_DisableRecordCache(HT_info *header_info) __NON_NULL(1);
+
+/**
+ * HT_GetRecordCacheStats - Copies the counters of the record cache of a handle
+ * @param header_info The index
+ * @param stats Receives the counters
+ * @return On success returns 0
+ * When the handle has no cache returns -1
+ */
+__NO_DISCARD int HT_GetRecordCacheStats(const HT_info *header_info, HT_cache_stats *stats) __NON_NULL(1, 2);
+
+/* Used by HT.c */
+
+void ht_record_cache_free(struct ht_record_cache *cache);
+
+/**
+ * ht_record_cache_lookup - Looks an id up, counting the access for admission
+ * @param cache The cache
+ * @param id The id
+ * @param records Receives the cached records, valid until the cache changes
+ * @param count Receives how many there are, 0 for an id known to have none
+ * @return Returns 1 on a hit, 0 on a miss
+ */
+__NO_DISCARD int ht_record_cache_lookup(struct ht_record_cache *cache, int id, const Record **records,
+                                        size_t *count) __NON_NULL(1, 3, 4);
+
+/**
+ * ht_record_cache_admit - Offers the result of a missed lookup to the cache
+ * @param cache The cache
+ * @param id The id
+ * @param records The records found
+ * @param count How many there are
+ */
+void ht_record_cache_admit(struct ht_record_cache *cache, int id, const Record *records, size_t count) __NON_NULL(1);
+
+/* Drops the cached result of an id */
+void ht_record_cache_invalidate(struct ht_record_cache *cache, int id) __NON_NULL(1);
+
+#endif //DB_EX1_RECORD_CACHE_H
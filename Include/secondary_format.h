@@ -0,0 +1,164 @@
+#ifndef DB_EX1_SECONDARY_FORMAT_H
+#define DB_EX1_SECONDARY_FORMAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory.h>
+#include "attributes.h"
+#include "bucket.h"
+
+/*
+ * Layout of the SHT blocks. Both kinds start with a bucket_info_t.
+ *
+ * Bucket and overflow blocks hold record_n key entries, one per distinct key of the chain:
+ *   key length (1 byte), the key without terminator, then four varints: the first posting block plus one
+ *   (0 for none), the number of records indexed under the key, the inline id count and the inline list
+ *   length in bytes, and last the inline list.
+ * The record count goes up on every insert, ids that get listed once included, so counts get answered
+ * from the entry alone. The varints grow with their values, so an entry can get longer on any insert.
+ * next_record is the end of the last entry, free_space what is left up to BLOCK_SIZE.
+ *
+ * The ids are primary block ids, kept as lists of zigzag varint deltas, the first one from 0,
+ * so that the ids of a key that keep landing in the same few primary blocks take a byte each.
+ * A key that lands in the same primary block twice in a row gets listed once.
+ * The inline list grows in place while its block has room. An entry that does not fit its block
+ * anymore moves down the chain while it is at most SHT_ENTRY_INLINE_LIMIT bytes, so keys with a few
+ * ids stay packed. Past that, or past SHT_ENTRY_LIST_LIMIT, the ids go to posting blocks:
+ * BLOCK_POSTINGS set, the last id of the block (int32) and record_n varint deltas,
+ * next_record being their end. overflow_bucket links a posting block to the previous one of the key,
+ * so the newest posting block comes first.
+ */
+#define SHT_ENTRY_INLINE_LIMIT (BLOCK_SIZE / 4U)
+#define SHT_MAX_VARINT_SIZE 5U
+#define SHT_ENTRY_MAX_SIZE (BLOCK_SIZE - sizeof(bucket_info_t))
+/* Past this size the inline list stops growing, leaving room for the record count and posting varints to grow */
+#define SHT_ENTRY_LIST_LIMIT (SHT_ENTRY_MAX_SIZE - 2U * (SHT_MAX_VARINT_SIZE - 1U))
+#define SHT_POSTINGS_START (sizeof(bucket_info_t) + sizeof(int32_t))
+
+typedef struct {
+  const char *key;
+  size_t key_len;
+  int32_t postings;
+  uint32_t records;
+  uint16_t count;
+  uint16_t list_bytes;
+  /* Offsets in the block */
+  size_t fields;
+  size_t list;
+  size_t end;
+} sht_entry_t;
+
+static __INLINE inline
+uint32_t sht_zigzag(int32_t delta) {
+  return ((uint32_t) delta << 1U) ^ (uint32_t) -(int32_t) ((uint32_t) delta >> 31U);
+}
+
+static __INLINE inline
+int32_t sht_unzigzag(uint32_t value) {
+  return (int32_t) ((value >> 1U) ^ -(value & 1U));
+}
+
+static __INLINE inline
+size_t sht_varint_size(uint32_t value) {
+  size_t size = 1U;
+  for (; value >= 0x80U; value >>= 7U) ++size;
+  return size;
+}
+
+static __INLINE inline
+size_t sht_varint_put(uint8_t *out, uint32_t value) {
+  size_t size = 0U;
+  for (; value >= 0x80U; value >>= 7U) out[size++] = (uint8_t) (value | 0x80U);
+  out[size++] = (uint8_t) value;
+  return size;
+}
+
+/* Returns the size of the varint at p, or 0 when it does not end before end */
+static __INLINE inline
+size_t sht_varint_get(const uint8_t *p, const uint8_t *end, uint32_t *value) {
+  *value = 0U;
+  for (size_t size = 0U; size != SHT_MAX_VARINT_SIZE && p + size < end; ++size) {
+    *value |= (uint32_t) (p[size] & 0x7FU) << (7U * size);
+    if (!(p[size] & 0x80U)) return size + 1U;
+  }
+  return 0U;
+}
+
+/* Returns the size of the entry with the fields and list length of entry */
+static __INLINE inline
+size_t sht_entry_size(const sht_entry_t *entry) {
+  return 1U + entry->key_len + sht_varint_size((uint32_t) entry->postings + 1U) + sht_varint_size(entry->records) +
+         sht_varint_size(entry->count) + sht_varint_size(entry->list_bytes) + entry->list_bytes;
+}
+
+/* Writes the varint fields of an entry to out, returns their size */
+static __INLINE inline
+size_t sht_entry_put_fields(uint8_t *out, const sht_entry_t *entry) {
+  size_t size = sht_varint_put(out, (uint32_t) entry->postings + 1U);
+  size += sht_varint_put(out + size, entry->records);
+  size += sht_varint_put(out + size, entry->count);
+  return size + sht_varint_put(out + size, entry->list_bytes);
+}
+
+/* Parses the entry at offset. Returns 0, or -1 when it does not end by limit */
+static __INLINE inline
+int sht_entry_parse(const void *block, size_t offset, size_t limit, sht_entry_t *entry) {
+  const uint8_t *p = (const uint8_t *) block;
+  if (offset >= limit) return -1;
+  entry->key_len = p[offset];
+  entry->key = (const char *) p + offset + 1U;
+  entry->fields = offset + 1U + entry->key_len;
+  if (entry->fields >= limit) return -1;
+  uint32_t values[4];
+  size_t field = entry->fields;
+  for (size_t i = 0U; i != 4U; ++i) {
+    size_t size = sht_varint_get(p + field, p + limit, &values[i]);
+    if (size == 0U) return -1;
+    field += size;
+  }
+  if (values[0] > (uint32_t) INT32_MAX || values[2] > UINT16_MAX || values[3] > UINT16_MAX) return -1;
+  entry->postings = (int32_t) values[0] - 1;
+  entry->records = values[1];
+  entry->count = (uint16_t) values[2];
+  entry->list_bytes = (uint16_t) values[3];
+  entry->list = field;
+  entry->end = entry->list + entry->list_bytes;
+  return (entry->end > limit) ? -1 : 0;
+}
+
+/* Returns the last id of a list, decoding as far as its varints go */
+static __INLINE inline
+int32_t sht_last_id(const uint8_t *list, size_t list_bytes) {
+  const uint8_t *end = list + list_bytes;
+  int32_t id = 0;
+  uint32_t delta;
+  for (size_t size; (size = sht_varint_get(list, end, &delta)) != 0U; list += size) {
+    id = (int32_t) ((uint32_t) id + (uint32_t) sht_unzigzag(delta));
+  }
+  return id;
+}
+
+/**
+ * sht_decode_ids - Decodes a list of ids
+ * @param list The first varint
+ * @param list_bytes The length of the list
+ * @param count The number of ids in it
+ * @param ids Receives the ids, or NULL to only check the list
+ * @return Returns 0, or -1 when the list does not hold count ids in exactly list_bytes
+ */
+static __INLINE inline
+int sht_decode_ids(const uint8_t *list, size_t list_bytes, size_t count, int32_t *ids) {
+  const uint8_t *end = list + list_bytes;
+  int32_t id = 0;
+  for (size_t i = 0U; i != count; ++i) {
+    uint32_t delta;
+    size_t size = sht_varint_get(list, end, &delta);
+    if (size == 0U) return -1;
+    list += size;
+    id = (int32_t) ((uint32_t) id + (uint32_t) sht_unzigzag(delta));
+    if (ids != NULL) ids[i] = id;
+  }
+  return (list == end) ? 0 : -1;
+}
+
+#endif //DB_EX1_SECONDARY_FORMAT_H
@@ -0,0 +1,102 @@
+#ifndef DB_EX1_SNAPSHOT_H
+#define DB_EX1_SNAPSHOT_H
+
+#include "attributes.h"
+#include "block_io.h"
+#include "statistics.h"
+#include "HT.h"
+
+/*
+ * Read only views of an HT index as it was when the snapshot got taken.
+ *
+ * Taking a snapshot copies nothing. Writers copy a block before they change it for the first time:
+ * every open snapshot of the file that still sees the block as it was gets the copy,
+ * the snapshots taken at the same version sharing it. A snapshot reads its copy when it has one,
+ * and the live block otherwise, which is still the version it saw. Blocks allocated after the
+ * snapshot got taken are not part of it, so a chain that overflowed later ends where it used to.
+ * A copy gets freed once the last snapshot holding it is closed.
+ *
+ * Writers never wait for snapshot readers, and the readers see every chain of one version,
+ * whatever the writes made through the same handle in between, callbacks of a snapshot scan included.
+ * Writes through other handles of the same file are not seen by the copying and break the view.
+ * Closing the index detaches its snapshots, which then fail every read until they are closed.
+ */
+
+typedef struct ht_snapshot HT_snapshot;
+
+/**
+ * HT_OpenSnapshot - Takes a snapshot of an index
+ * @param header_info The index
+ * @return On success returns the snapshot, to be closed with HT_CloseSnapshot
+ * On failure returns NULL
+ */
+__NO_DISCARD HT_snapshot *HT_OpenSnapshot(HT_info *header_info) __NON_NULL(1);
+
+/**
+ * HT_CloseSnapshot - Closes a snapshot and frees the block copies no other snapshot holds
+ * @param snapshot The snapshot
+ */
+void HT_CloseSnapshot(HT_snapshot *snapshot) __NON_NULL(1);
+
+/**
+ * HT_SnapshotScan - Visits every record of the snapshot in file order, like HT_Scan
+ * @param snapshot The snapshot
+ * @param callback Gets called for every record with the block it lives in. Returning non zero stops the scan
+ * @param context Passed untouched to the callback
+ * @return On success returns the number of blocks read
+ * On failure returns -1
+ */
+__NO_DISCARD int HT_SnapshotScan(HT_snapshot *snapshot, HT_scan_callback callback, void *context) __NON_NULL(1, 2);
+
+/**
+ * HT_CollectSnapshotStatistics - Same as HT_CollectStatistics, over a snapshot of an open index
+ * @param snapshot The snapshot
+ * @param threads The number of worker threads, 0 picks HT_STATS_DEFAULT_THREADS
+ * @param stats Receives the results. Must be released with HT_FreeStatistics
+ * @return On success returns 0, even when integrity violations were found.
+ * On failure returns -1.
+ */
+__NO_DISCARD int HT_CollectSnapshotStatistics(HT_snapshot *snapshot, unsigned int threads,
+                                              HT_statistics *stats) __NON_NULL(1, 3);
+
+/* Used by HT.c and statistics.c */
+
+/* The open snapshots of every file, newest first */
+extern HT_snapshot *ht_snapshots;
+
+/**
+ * ht_snapshot_copy_block - Gives a copy of a block as it is now to the open snapshots of its file that lack one
+ * @param file_desc The file of the block
+ * @param block_id The block, about to change
+ * @return On success returns 0
+ * On failure returns -1
+ */
+__NO_DISCARD int ht_snapshot_copy_block(int file_desc, int block_id);
+
+/**
+ * ht_snapshot_read_block - Copies a block of the snapshot as stored, not expanded
+ * @param snapshot The snapshot
+ * @param block_id The block, below ht_snapshot_blocks
+ * @param block Receives BLOCK_SIZE bytes
+ * @return On success returns 0
+ * On failure, or when the snapshot got detached, returns -1
+ */
+__NO_DISCARD int ht_snapshot_read_block(const HT_snapshot *snapshot, int block_id, void *block) __NON_NULL(1, 3);
+
+/* The number of blocks of the snapshot */
+int ht_snapshot_blocks(const HT_snapshot *snapshot) __NON_NULL(1);
+
+/* Detaches the snapshots of a file that is getting closed */
+void ht_snapshot_detach(int file_desc);
+
+/*
+ * Lets the open snapshots keep their version of a block that is about to change. Chains get walked with
+ * ht_read_block and only the block that gets modified comes through here, right before the change,
+ * so that blocks that only got looked at are not copied.
+ */
+static __INLINE inline
+int ht_prepare_block_write(int file_desc, int block_id) {
+  return (ht_snapshots != NULL) ? ht_snapshot_copy_block(file_desc, block_id) : 0;
+}
+
+#endif //DB_EX1_SNAPSHOT_H
@@ -0,0 +1,73 @@
+#ifndef DB_EX1_STATISTICS_H
+#define DB_EX1_STATISTICS_H
+
+#include <stdio.h>
+#include "attributes.h"
+
+// Chains of HT_STATS_MAX_CHAIN blocks or more share the last histogram slot
+#define HT_STATS_MAX_CHAIN 32U
+#define HT_STATS_DEFAULT_THREADS 4U
+
+typedef struct {
+  int isSecondary;
+  /* The HT_info flags of primary indexes */
+  unsigned int flags;
+  int totalBlocks;
+  unsigned long numBuckets;
+  /* The records of whole bucket chains */
+  unsigned long totalRecords;
+  unsigned int minRecords;
+  unsigned int maxRecords;
+  /* The records of the bucket blocks alone, their overflow blocks left out */
+  unsigned long bucketBlockRecords;
+  unsigned int minBucketBlockRecords;
+  unsigned int maxBucketBlockRecords;
+  unsigned long bucketsWithOverflow;
+  unsigned long overflowBlocks;
+  unsigned long compressedBlocks;
+  unsigned long chainHistogram[HT_STATS_MAX_CHAIN + 1U];
+  double fillP50;
+  double fillP90;
+  double fillP99;
+  unsigned long freeBytes;
+  unsigned long wastedBytes;
+  /* Integrity violations */
+  unsigned long inconsistentHeaders;
+  unsigned long invalidPointers;
+  unsigned long cycles;
+  unsigned long sharedBlocks;
+  unsigned long orphanBlocks;
+  /* Blocks, block 0 included, that do not match their checksum */
+  unsigned long checksumErrors;
+  /* Overflow blocks of every bucket, indexed by bucket - 1 */
+  unsigned int *bucketOverflowBlocks;
+} HT_statistics;
+
+/**
+ * HT_CollectStatistics - Reads every block of an HT or SHT file once, in file order,
+ * and then checks the blocks and walks the bucket chains on several threads.
+ * Besides the usual statistics, every block header gets checked against its entries,
+ * and every block must be reachable from exactly one bucket chain without cycles.
+ *
+ * @param filename The file to examine. It must not be open, a handle the catalog keeps idle gets closed first.
+ * @param threads The number of worker threads, 0 picks HT_STATS_DEFAULT_THREADS
+ * @param stats Receives the results. Must be released with HT_FreeStatistics
+ * @return On success returns 0, even when integrity violations were found.
+ * On failure, or when the catalog has the file in use, returns -1.
+ */
+__NO_DISCARD int HT_CollectStatistics(char *filename, unsigned int threads, HT_statistics *stats) __NON_NULL(1, 3);
+
+/**
+ * HT_FreeStatistics - Releases the memory held by the statistics
+ * @param stats The statistics filled by HT_CollectStatistics
+ */
+void HT_FreeStatistics(HT_statistics *stats) __NON_NULL(1);
+
+/**
+ * HT_PrintStatisticsJSON - Prints the statistics as a single JSON object
+ * @param stats The statistics filled by HT_CollectStatistics
+ * @param out The stream to print to
+ */
+void HT_PrintStatisticsJSON(const HT_statistics *stats, FILE *out) __NON_NULL(1, 2);
+
+#endif //DB_EX1_STATISTICS_H
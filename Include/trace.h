@@ -0,0 +1,140 @@
+#ifndef DB_EX1_TRACE_H
+#define DB_EX1_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "attributes.h"
+#include "record.h"
+
+/*
+ * Workload traces of the HT and SHT calls, for Benchmark/ht_replay to run again.
+ *
+ * While a trace is on, every traced call gets logged once it returns: the operation, its start in
+ * nanoseconds since the trace started, its duration, the handle it was made on, its result and its
+ * arguments. Handles are the BF file descriptors of the indexes, those of HT_OpenIndex and
+ * SHT_OpenSecondaryIndex being their results. When no trace is on a traced call costs a pointer check.
+ * Scans, views, joins, batches and snapshots take callbacks and are not traced.
+ *
+ * A trace file is HT_TRACE_MAGIC followed by the events, each one
+ *   the operation (1 byte), the start relative to the start of the previous event, the duration,
+ *   the handle, the result, the payload size and the payload.
+ * Every number is a varint, signed ones zigzag encoded. Strings are their length and their bytes,
+ * records their id and their three strings, and keys an id for 'i' indexes and a string for 'c' ones.
+ * The payloads are:
+ *   HT_TRACE_CREATE      name, attribute type, attribute name, attribute length, buckets, flags
+ *   HT_TRACE_OPEN        name
+ *   HT_TRACE_INSERT      record
+ *   HT_TRACE_INSERT_MANY count, records
+ *   HT_TRACE_DELETE      key
+ *   HT_TRACE_GET         key
+ *   HT_TRACE_GET_MANY    count, keys
+ *   HT_TRACE_UPDATE      key, 1 and the updated record when one got updated, 0 otherwise
+ *   HT_TRACE_UPSERT      record
+ *   SHT_TRACE_CREATE     name, attribute name, attribute length, buckets, primary index name
+ *   SHT_TRACE_OPEN       name
+ *   SHT_TRACE_INSERT     record, block id
+ *   SHT_TRACE_GET        primary index handle, key
+ *   SHT_TRACE_COUNT      key
+ * and the closes have none.
+ */
+#define HT_TRACE_MAGIC "HTTRACE1"
+
+typedef enum {
+  HT_TRACE_CREATE,
+  HT_TRACE_OPEN,
+  HT_TRACE_CLOSE,
+  HT_TRACE_INSERT,
+  HT_TRACE_INSERT_MANY,
+  HT_TRACE_DELETE,
+  HT_TRACE_GET,
+  HT_TRACE_GET_MANY,
+  HT_TRACE_UPDATE,
+  HT_TRACE_UPSERT,
+  SHT_TRACE_CREATE,
+  SHT_TRACE_OPEN,
+  SHT_TRACE_CLOSE,
+  SHT_TRACE_INSERT,
+  SHT_TRACE_GET,
+  SHT_TRACE_COUNT,
+  HT_TRACE_OP_N
+} HT_trace_op;
+
+typedef struct {
+  HT_trace_op op;
+  /* Nanoseconds since the trace started */
+  uint64_t start;
+  uint64_t duration;
+  int handle;
+  int result;
+  /* The part of the payload not read yet */
+  const uint8_t *payload;
+  size_t payloadSize;
+} HT_trace_event;
+
+typedef struct ht_trace_reader HT_trace_reader;
+
+/**
+ * HT_StartTrace - Starts logging the traced calls to a new trace file
+ * @param filename The trace file, truncated when it exists
+ * @return On success returns 0
+ * On failure, or when a trace is already on, returns -1
+ */
+__NO_DISCARD int HT_StartTrace(const char *filename) __NON_NULL(1);
+
+/**
+ * HT_StopTrace - Stops the trace and closes its file
+ * @return Returns 0 when every event made it to the file, -1 otherwise
+ */
+int HT_StopTrace(void);
+
+/**
+ * HT_OpenTrace - Opens a trace file for reading
+ * @param filename The trace file
+ * @return On success returns the reader, to be closed with HT_CloseTrace
+ * On failure, or when the file is not a trace, returns NULL
+ */
+__NO_DISCARD HT_trace_reader *HT_OpenTrace(const char *filename) __NON_NULL(1);
+
+/**
+ * HT_NextTraceEvent - Reads the next event of a trace
+ * @param reader The reader
+ * @param event Receives the event. Its payload stays valid until the next call
+ * @return Returns 1 while there are events and 0 at the end of the trace
+ * On failure, or when the trace is malformed, returns -1
+ */
+__NO_DISCARD int HT_NextTraceEvent(HT_trace_reader *reader, HT_trace_event *event) __NON_NULL(1, 2);
+
+void HT_CloseTrace(HT_trace_reader *reader);
+
+/* Read the next argument of the payload of an event. They return 0, or -1 when the payload is malformed */
+
+__NO_DISCARD int HT_TraceGetInt(HT_trace_event *event, long *value) __NON_NULL(1, 2);
+
+/* The string gets NUL terminated, and must fit size bytes with the terminator */
+__NO_DISCARD int HT_TraceGetString(HT_trace_event *event, char *buffer, size_t size) __NON_NULL(1, 2);
+
+__NO_DISCARD int HT_TraceGetRecord(HT_trace_event *event, Record *record) __NON_NULL(1, 2);
+
+/* Used by HT.c */
+
+typedef struct ht_tracer ht_tracer_t;
+
+/* The trace that is on, NULL when there is none */
+extern ht_tracer_t *ht_tracer;
+
+/* Monotonic nanoseconds, for the start of a traced call */
+uint64_t ht_trace_clock(void);
+
+/* Starts a traced call. The call gets logged by the ht_trace_ functions below, once it returns */
+#define HT_TRACE_START(start) uint64_t start = (ht_tracer != NULL) ? ht_trace_clock() : 0U
+
+/* Starts building the event of a call that returned, the arguments get appended one by one */
+void ht_trace_begin(HT_trace_op op, uint64_t start, int handle, int result);
+void ht_trace_put_int(long value);
+void ht_trace_put_string(const char *string, size_t max_len) __NON_NULL(1);
+void ht_trace_put_record(const Record *record) __NON_NULL(1);
+void ht_trace_put_key(char attribute_type, const void *key) __NON_NULL(2);
+/* Writes the event out */
+void ht_trace_end(void);
+
+#endif //DB_EX1_TRACE_H
@@ -1,9 +1,19 @@
 #include <stdint.h>
 #include <stddef.h>
+#include <limits.h>
 #include <memory.h>
 #include <stdio.h>
 #include "../Include/HT.h"
 #include "../Include/BF.h"
+#include "../Include/bucket.h"
+#include "../Include/block_format.h"
+#include "../Include/block_io.h"
+#include "../Include/key_kernel.h"
+#include "../Include/record_cache.h"
+#include "../Include/secondary_format.h"
+#include "../Include/snapshot.h"
+#include "../Include/batch.h"
+#include "../Include/trace.h"
 #include "../Include/macros.h"
 
 #define BF_CREATE_EMSG "Error while creating file"
@@ -14,28 +24,6 @@
 #define BF_CLOSE_EMSG "Error while closing file"
 #define BF_GET_BLOCK_COUNTER_EMSG "Error while getting block counter"
 
-typedef struct {
-  int overflow_bucket;
-  int next_record;
-  int free_space;
-  unsigned int record_n;
-} bucket_info_t;
-
-typedef struct {
-  int block_id;
-  char *value;
-} SHT_insert_info;
-
-static __INLINE __NO_DISCARD inline
-bucket_info_t create_bucket_info(void) {
-  return (bucket_info_t) {
-          .overflow_bucket = -1,
-          .next_record = sizeof(bucket_info_t),
-          .free_space = BLOCK_SIZE - sizeof(bucket_info_t),
-          .record_n = 0U
-  };
-}
-
 static __INLINE inline
 uint64_t hash_function(char attribute_type, size_t bucket_n, const void *restrict value) {
   uint64_t hash_value = 0U;
@@ -84,16 +72,26 @@ size_t get_attribute_offset(const char *attribute_name, size_t len) {
   return offset;
 }
 
-static __INLINE inline
-void initialize_block(void *block) {
-  bucket_info_t bucket_info = create_bucket_info();
-  memcpy(block, &bucket_info, sizeof(bucket_info_t));
+static HT_metrics *create_metrics(void) {
+#ifdef HT_METRICS
+  return calloc(1U, sizeof(HT_metrics));
+#else
+  return NULL;
+#endif
 }
 
 int HT_CreateIndex(char *index_name, char attribute_type, char *attribute_name,
                    int attribute_length, int bucket_n) {
+  return HT_CreateIndexEx(index_name, attribute_type, attribute_name, attribute_length, bucket_n, NULL);
+}
+
+static int create_index(char *index_name, char attribute_type, char *attribute_name,
+                        int attribute_length, int bucket_n, const HT_create_options *options) {
 
   if (sizeof(HT_info) > BLOCK_SIZE) return HT_BLOCK_OVERFLOW;
+  unsigned int flags = (options != NULL) ? options->flags : 0U;
+  // Compressed blocks grow past BLOCK_SIZE, which the slot directory of compact blocks can not
+  if ((flags & HT_FLAG_COMPACT) && (flags & HT_FLAG_COMPRESS_COLD)) return -1;
   int index_descriptor = 0;
   CHECK(BF_CreateFile(index_name), BF_CREATE_EMSG, return -1);
   CHECK(index_descriptor = BF_OpenFile(index_name), BF_OPEN_EMSG, return -1);
@@ -111,21 +109,37 @@ int HT_CreateIndex(char *index_name, char attribute_type, char *attribute_name,
   info->attrType = attribute_type;
   info->attrLength = (size_t) attribute_length;
   info->numBuckets = (unsigned long) bucket_n;
+  info->flags = flags;
   memcpy(&info->attrName, attribute_name, (size_t) attribute_length);
+  ht_seal_header(block - identifier_len);
 
   CHECK(BF_WriteBlock(index_descriptor, 0), BF_WRITE_BLOCK_EMSG, return -1);
   for (size_t i = 1U; i <= bucket_n; ++i) {
-    CHECK(BF_AllocateBlock(index_descriptor), BF_ALLOCATE_EMSG, return -1);
-    void *bucket_block;
-    CHECK(BF_ReadBlock(index_descriptor, (int) i, &bucket_block), BF_READ_BLOCK_EMSG, return -1);
-    initialize_block(bucket_block);
+    CHECK(ht_append_block(index_descriptor, (int) i), BF_ALLOCATE_EMSG, return -1);
     CHECK(BF_WriteBlock(index_descriptor, (int) i), BF_WRITE_BLOCK_EMSG, return -1);
   }
   CHECK(BF_CloseFile(index_descriptor), BF_CLOSE_EMSG, return -1);
   return 0;
 }
 
-HT_info *HT_OpenIndex(char *index_name) {
+int HT_CreateIndexEx(char *index_name, char attribute_type, char *attribute_name,
+                     int attribute_length, int bucket_n, const HT_create_options *options) {
+  HT_TRACE_START(trace_start);
+  int res = create_index(index_name, attribute_type, attribute_name, attribute_length, bucket_n, options);
+  if (ht_tracer != NULL) {
+    ht_trace_begin(HT_TRACE_CREATE, trace_start, -1, res);
+    ht_trace_put_string(index_name, SIZE_MAX);
+    ht_trace_put_int(attribute_type);
+    ht_trace_put_string(attribute_name, (size_t) attribute_length);
+    ht_trace_put_int(attribute_length);
+    ht_trace_put_int(bucket_n);
+    ht_trace_put_int((options != NULL) ? (long) options->flags : 0L);
+    ht_trace_end();
+  }
+  return res;
+}
+
+static HT_info *open_index(char *index_name) {
   int index_descriptor;
   CHECK(index_descriptor = BF_OpenFile(index_name), BF_OPEN_EMSG, return NULL);
 
@@ -133,160 +147,740 @@ HT_info *HT_OpenIndex(char *index_name) {
   CHECK(BF_ReadBlock(index_descriptor, 0, &block), BF_READ_BLOCK_EMSG, return NULL);
 
   size_t identifier_len = strlen(HT_FILE_IDENTIFIER);
-  if (memcmp(block, HT_FILE_IDENTIFIER, identifier_len) != 0) return NULL;
+  if (memcmp(block, HT_FILE_IDENTIFIER, identifier_len) != 0 || !ht_header_current(block, index_name) ||
+      !ht_header_intact(block)) {
+    return NULL;
+  }
   block += identifier_len;
 
   HT_info *info = (HT_info *) block;
   HT_info *ht_info = __MALLOC(1, HT_info);
   if (ht_info == NULL) return NULL;
-  ht_info->fileDesc = info->fileDesc;
+  ht_info->fileDesc = index_descriptor;
   ht_info->attrType = info->attrType;
   ht_info->numBuckets = info->numBuckets;
   ht_info->attrLength = info->attrLength;
+  ht_info->flags = info->flags;
   ht_info->attrName = __MALLOC(info->attrLength + 1, char);
   STR_COPY(ht_info->attrName, &info->attrName, info->attrLength);
+  ht_info->kernel = ht_select_key_kernel(ht_info->attrType, ht_info->attrName, ht_info->attrLength, ht_info->flags);
+  ht_info->metrics = create_metrics();
+  ht_info->cache = NULL;
   return ht_info;
 }
 
-int HT_CloseIndex(HT_info *header_info) {
-  if (header_info == NULL) return -1;
+HT_info *HT_OpenIndex(char *index_name) {
+  HT_TRACE_START(trace_start);
+  HT_info *ht_info = open_index(index_name);
+  if (ht_tracer != NULL) {
+    int index_descriptor = (ht_info != NULL) ? ht_info->fileDesc : -1;
+    ht_trace_begin(HT_TRACE_OPEN, trace_start, index_descriptor, index_descriptor);
+    ht_trace_put_string(index_name, SIZE_MAX);
+    ht_trace_end();
+  }
+  return ht_info;
+}
+
+static int close_index(HT_info *header_info) {
+  ht_release_blocks(header_info->fileDesc);
+  ht_snapshot_detach(header_info->fileDesc);
   CHECK(BF_CloseFile(header_info->fileDesc), BF_CLOSE_EMSG, return -1);
   free(header_info->attrName);
+  free(header_info->metrics);
+  ht_record_cache_free(header_info->cache);
   free(header_info);
   return 0;
 }
 
-int HT_InsertEntry(HT_info header_info, Record record) {
-  int index_descriptor = header_info.fileDesc;
-  void *hash_attribute = get_hash_attribute(header_info.attrType, header_info.attrName,
-                                            header_info.attrLength, &record);
-  int bucket = (int) hash_function(header_info.attrType, header_info.numBuckets, hash_attribute);
+int HT_CloseIndex(HT_info *header_info) {
+  if (header_info == NULL) return -1;
+  HT_TRACE_START(trace_start);
+  int index_descriptor = header_info->fileDesc;
+  int res = close_index(header_info);
+  if (ht_tracer != NULL) {
+    ht_trace_begin(HT_TRACE_CLOSE, trace_start, index_descriptor, res);
+    ht_trace_end();
+  }
+  return res;
+}
+
+/* Appends the record to the first block of the chain from block_id on with room for it, extending the chain if none has */
+static int insert_from(const HT_info *header_info, const Record *record, int block_id) {
+  int index_descriptor = header_info->fileDesc;
+  HT_metrics *metrics = header_info->metrics;
+  int entry_size = (int) block_entry_size(header_info->flags, record);
   void *block;
-  CHECK(BF_ReadBlock(index_descriptor, bucket, &block), BF_READ_BLOCK_EMSG, return -1);
-  bucket_info_t bucket_info = *(bucket_info_t *) block;
-  int current_bucket = bucket;
-  while (bucket_info.free_space < sizeof(Record)) {
-    if (bucket_info.overflow_bucket != -1) {
-      CHECK(BF_ReadBlock(index_descriptor, bucket_info.overflow_bucket, &block), BF_READ_BLOCK_EMSG, return -1);
-      current_bucket = bucket_info.overflow_bucket;
-      bucket_info = *(bucket_info_t *) block;
+  CHECK(ht_read_block(metrics, index_descriptor, block_id, &block), BF_READ_BLOCK_EMSG, return -1);
+  bucket_info_t *bucket_info = block;
+  int current_bucket = block_id;
+  while (bucket_info->free_space < entry_size) {
+    if (bucket_info->overflow_bucket != -1) {
+      current_bucket = bucket_info->overflow_bucket;
+      CHECK(ht_read_block(metrics, index_descriptor, current_bucket, &block), BF_READ_BLOCK_EMSG, return -1);
+      HT_METRIC_ADD(metrics, chainHops, 1U);
+      bucket_info = block;
     } else {
-      CHECK(BF_AllocateBlock(index_descriptor), BF_ALLOCATE_EMSG, return -1);
-      CHECK(bucket_info.overflow_bucket = BF_GetBlockCounter(index_descriptor) - 1, BF_GET_BLOCK_COUNTER_EMSG,
-            return -1);
-      memcpy(block, &bucket_info, sizeof(bucket_info_t));
-      CHECK(BF_WriteBlock(index_descriptor, current_bucket), BF_WRITE_BLOCK_EMSG, return -1);
-      CHECK(BF_ReadBlock(index_descriptor, bucket_info.overflow_bucket, &block), BF_READ_BLOCK_EMSG, return -1);
-      current_bucket = bucket_info.overflow_bucket;
-      initialize_block(block);
-      CHECK(BF_WriteBlock(index_descriptor, bucket_info.overflow_bucket), BF_WRITE_BLOCK_EMSG, return -1);
-      bucket_info = *(bucket_info_t *) block;
-      break;
+      // The last block of the chain changes either way
+      CHECK(ht_prepare_block_write(index_descriptor, current_bucket), BF_READ_BLOCK_EMSG, return -1);
+      if ((header_info->flags & HT_FLAG_COMPRESS_COLD) && current_bucket > (int) header_info->numBuckets) {
+        int appended;
+        CHECK(appended = ht_append_compressed(metrics, index_descriptor, current_bucket, block, record),
+              BF_WRITE_BLOCK_EMSG, return -1);
+        if (appended) return current_bucket;
+      }
+      int overflow_bucket;
+      CHECK(overflow_bucket = ht_allocate_block(metrics, index_descriptor), BF_ALLOCATE_EMSG, return -1);
+      bucket_info->overflow_bucket = overflow_bucket;
+      CHECK(ht_write_block(metrics, index_descriptor, current_bucket), BF_WRITE_BLOCK_EMSG, return -1);
+      current_bucket = overflow_bucket;
+      CHECK(ht_read_block(metrics, index_descriptor, current_bucket, &block), BF_READ_BLOCK_EMSG, return -1);
+      bucket_info = block;
     }
   }
-  memcpy(block + bucket_info.next_record, &record, sizeof(Record));
-  bucket_info.next_record += sizeof(Record);
-  bucket_info.free_space -= sizeof(Record);
-  ++bucket_info.record_n;
-  memcpy(block, &bucket_info, sizeof(bucket_info_t));
-  CHECK(BF_WriteBlock(index_descriptor, current_bucket), BF_WRITE_BLOCK_EMSG, return -1);
+  CHECK(ht_prepare_block_write(index_descriptor, current_bucket), BF_READ_BLOCK_EMSG, return -1);
+  // The record itself is the only copy, the header gets updated in place
+  block_append(block, header_info->flags, record);
+  CHECK(ht_write_block(metrics, index_descriptor, current_bucket), BF_WRITE_BLOCK_EMSG, return -1);
   return current_bucket;
 }
 
+static int insert_entry(const HT_info *header_info, const Record *record) {
+  void *hash_attribute = get_hash_attribute(header_info->attrType, header_info->attrName,
+                                            header_info->attrLength, (Record *) record);
+  if (hash_attribute == NULL) return -1;
+  return insert_from(header_info, record,
+                     (int) hash_function(header_info->attrType, header_info->numBuckets, hash_attribute));
+}
+
+int HT_InsertRecord(HT_info *header_info, const Record *record) {
+  HT_TRACE_START(trace_start);
+  HT_METRIC_TIMER_START(timer);
+  if (header_info->cache != NULL) ht_record_cache_invalidate(header_info->cache, record->id);
+  int res = insert_entry(header_info, record);
+  HT_METRIC_TIMER_STOP(header_info->metrics, HT_OP_INSERT, timer);
+  if (ht_tracer != NULL) {
+    ht_trace_begin(HT_TRACE_INSERT, trace_start, header_info->fileDesc, res);
+    ht_trace_put_record(record);
+    ht_trace_end();
+  }
+  return res;
+}
+
+int HT_InsertEntry(HT_info header_info, Record record) {
+  return HT_InsertRecord(&header_info, &record);
+}
+
+static int delete_entry(const HT_info *header_info, const void *value) {
+  int index_descriptor = header_info->fileDesc;
+  HT_metrics *metrics = header_info->metrics;
+  unsigned int flags = header_info->flags;
+  const ht_key_kernel_t *kernel = header_info->kernel;
+  if (kernel == NULL) return -1;
+  int bucket = (int) hash_function(header_info->attrType, header_info->numBuckets, value);
+  size_t value_len = kernel->key_length(value);
+  while (1U) {
+    void *block;
+    CHECK(ht_read_block(metrics, index_descriptor, bucket, &block), BF_READ_BLOCK_EMSG, return -1);
+    bucket_info_t *bucket_info = block;
+    unsigned int i = kernel->find(block, 0U, value, value_len);
+    if (i != bucket_info->record_n) {
+      HT_METRIC_ADD(metrics, compares, i + 1U);
+      HT_METRIC_ADD(metrics, hashCollisions, i);
+      CHECK(ht_prepare_block_write(index_descriptor, bucket), BF_READ_BLOCK_EMSG, return -1);
+      block_remove(block, flags, i);
+      CHECK(ht_write_block(metrics, index_descriptor, bucket), BF_WRITE_BLOCK_EMSG, return -1);
+      return 0;
+    }
+    HT_METRIC_ADD(metrics, compares, bucket_info->record_n);
+    HT_METRIC_ADD(metrics, hashCollisions, bucket_info->record_n);
+    if (bucket_info->overflow_bucket == -1) return -1;
+    bucket = bucket_info->overflow_bucket;
+    HT_METRIC_ADD(metrics, chainHops, 1U);
+  }
+}
+
 int HT_DeleteEntry(HT_info header_info, void *value) {
-  int index_descriptor = header_info.fileDesc;
-  int bucket = (int) hash_function(header_info.attrType, header_info.numBuckets, value);
+  HT_TRACE_START(trace_start);
+  HT_METRIC_TIMER_START(timer);
+  if (header_info.cache != NULL) ht_record_cache_invalidate(header_info.cache, *(int *) value);
+  int res = delete_entry(&header_info, value);
+  HT_METRIC_TIMER_STOP(header_info.metrics, HT_OP_DELETE, timer);
+  if (ht_tracer != NULL) {
+    ht_trace_begin(HT_TRACE_DELETE, trace_start, header_info.fileDesc, res);
+    ht_trace_put_key(header_info.attrType, value);
+    ht_trace_end();
+  }
+  return res;
+}
+
+typedef struct {
+  int block_id;
   void *block;
-  void *block_base;
-  bucket_info_t bucket_info;
-  size_t i;
-  if (header_info.attrType == 'c') {
-    size_t value_len = strlen(value);
-    size_t field_offset = get_attribute_offset(header_info.attrName, header_info.attrLength);
-    while (1U) {
-      CHECK(BF_ReadBlock(index_descriptor, bucket, &block), BF_READ_BLOCK_EMSG, return -1);
-      bucket_info = *(bucket_info_t *) block;
-      block_base = block;
-      block += sizeof(bucket_info_t);
-      for (i = 0U; i != bucket_info.record_n; ++i, block += sizeof(Record)) {
-        char *key = ((char *) (block + field_offset));
-        if (!strncmp(key, value, value_len)) goto __SEARCH_END;
+  unsigned int index;
+  // The first block of the chain with room for the entry being upserted, -1 for none
+  int room_block;
+} record_position_t;
+
+/**
+ * locate_record - Walks a chain once, looking for the first record whose key is exactly value
+ * @param bucket The first block of the chain
+ * @param room_size The size of an entry to find room for on the way
+ * @param position Receives the record, or the last block of the chain when there is none.
+ * The block stays valid until the next block read
+ * @return Returns 1 when the record was found, 0 when it was not and -1 on failure
+ */
+static int locate_record(const HT_info *header_info, int bucket, const void *value, int room_size,
+                         record_position_t *position) {
+  HT_metrics *metrics = header_info->metrics;
+  const ht_key_kernel_t *kernel = header_info->kernel;
+  if (kernel == NULL) return -1;
+  size_t value_len = kernel->key_length(value);
+  size_t field_offset = (header_info->attrType == 'c') ?
+                        get_attribute_offset(header_info->attrName, header_info->attrLength) : 0U;
+  position->block_id = bucket;
+  position->room_block = -1;
+  while (1U) {
+    CHECK(ht_read_block(metrics, header_info->fileDesc, position->block_id, &position->block), BF_READ_BLOCK_EMSG,
+          return -1);
+    const bucket_info_t *bucket_info = position->block;
+    // The kernel finds the records the value is a prefix of, only an exact match counts
+    for (unsigned int i = kernel->find(position->block, 0U, value, value_len); i != bucket_info->record_n;
+         i = kernel->find(position->block, i + 1U, value, value_len)) {
+      size_t key_len = value_len;
+      if (header_info->attrType == 'c') {
+        (void) block_record_field(position->block, header_info->flags, i, field_offset, &key_len);
+      }
+      if (key_len == value_len) {
+        HT_METRIC_ADD(metrics, compares, i + 1U);
+        position->index = i;
+        return 1;
       }
-      if (bucket_info.overflow_bucket == -1) return -1;
-      bucket = bucket_info.overflow_bucket;
     }
-  } else {
-    int id = *(int *) value;
-    while (1U) {
-      CHECK(BF_ReadBlock(index_descriptor, bucket, &block), BF_READ_BLOCK_EMSG, return -1);
-      bucket_info = *(bucket_info_t *) block;
-      block_base = block;
-      block += sizeof(bucket_info_t);
-      for (i = 0U; i != bucket_info.record_n; ++i, block += sizeof(Record)) {
-        if (((Record *) block)->id == id) goto __SEARCH_END;
+    HT_METRIC_ADD(metrics, compares, bucket_info->record_n);
+    if (position->room_block == -1 && bucket_info->free_space >= room_size) position->room_block = position->block_id;
+    if (bucket_info->overflow_bucket == -1) return 0;
+    position->block_id = bucket_info->overflow_bucket;
+    HT_METRIC_ADD(metrics, chainHops, 1U);
+  }
+}
+
+/* Rewrites a located record in place when its key is unchanged and it still fits, moves it otherwise */
+static int rewrite_record(const HT_info *header_info, record_position_t *position, const Record *record,
+                          int same_key) {
+  int index_descriptor = header_info->fileDesc;
+  HT_metrics *metrics = header_info->metrics;
+  CHECK(ht_prepare_block_write(index_descriptor, position->block_id), BF_READ_BLOCK_EMSG, return -1);
+  if (same_key && block_replace(position->block, header_info->flags, position->index, record) == 0) {
+    CHECK(ht_write_block(metrics, index_descriptor, position->block_id), BF_WRITE_BLOCK_EMSG, return -1);
+    return position->block_id;
+  }
+  block_remove(position->block, header_info->flags, position->index);
+  CHECK(ht_write_block(metrics, index_descriptor, position->block_id), BF_WRITE_BLOCK_EMSG, return -1);
+  return same_key ? insert_from(header_info, record, position->block_id) : insert_entry(header_info, record);
+}
+
+static int same_key(const HT_info *header_info, const Record *lhs, const Record *rhs) {
+  if (header_info->attrType == 'i') return lhs->id == rhs->id;
+  size_t field_offset = get_attribute_offset(header_info->attrName, header_info->attrLength);
+  return !strncmp((const char *) lhs + field_offset, (const char *) rhs + field_offset,
+                  record_fields[compact_field_index(field_offset)].size);
+}
+
+/* *found tells whether the mutator got called, and updated then receives what it made of the record */
+static int update_entry(HT_info *header_info, const void *value, HT_update_callback mutator, void *context,
+                        Record *updated, int *found) {
+  record_position_t position;
+  int bucket = (int) hash_function(header_info->attrType, header_info->numBuckets, value);
+  *found = 0;
+  if (locate_record(header_info, bucket, value, 0, &position) != 1) return -1;
+  Record record;
+  block_decode(position.block, header_info->flags, position.index, &record);
+  *updated = record;
+  mutator(updated, context);
+  *found = 1;
+  if (header_info->cache != NULL) {
+    ht_record_cache_invalidate(header_info->cache, record.id);
+    ht_record_cache_invalidate(header_info->cache, updated->id);
+  }
+  return rewrite_record(header_info, &position, updated, same_key(header_info, &record, updated));
+}
+
+int HT_Update(HT_info *header_info, const void *value, HT_update_callback mutator, void *context) {
+  HT_TRACE_START(trace_start);
+  HT_METRIC_TIMER_START(timer);
+  Record updated;
+  int found;
+  int res = update_entry(header_info, value, mutator, context, &updated, &found);
+  HT_METRIC_TIMER_STOP(header_info->metrics, HT_OP_UPDATE, timer);
+  if (ht_tracer != NULL) {
+    ht_trace_begin(HT_TRACE_UPDATE, trace_start, header_info->fileDesc, res);
+    ht_trace_put_key(header_info->attrType, value);
+    ht_trace_put_int(found);
+    if (found) ht_trace_put_record(&updated);
+    ht_trace_end();
+  }
+  return res;
+}
+
+static int upsert_entry(HT_info *header_info, const Record *record) {
+  void *hash_attribute = get_hash_attribute(header_info->attrType, header_info->attrName,
+                                            header_info->attrLength, (Record *) record);
+  if (hash_attribute == NULL) return -1;
+  // The chain is the one insert_entry picks, the key to match is the field up to its width
+  int bucket = (int) hash_function(header_info->attrType, header_info->numBuckets, hash_attribute);
+  char key[sizeof(Record)];
+  if (header_info->attrType == 'c') {
+    size_t field_offset = get_attribute_offset(header_info->attrName, header_info->attrLength);
+    size_t len = strnlen(hash_attribute, record_fields[compact_field_index(field_offset)].size);
+    memcpy(key, hash_attribute, len);
+    key[len] = '\0';
+    hash_attribute = key;
+  }
+  if (header_info->cache != NULL) ht_record_cache_invalidate(header_info->cache, record->id);
+  record_position_t position;
+  int found = locate_record(header_info, bucket, hash_attribute, (int) block_entry_size(header_info->flags, record),
+                            &position);
+  if (found < 0) return -1;
+  if (found) return rewrite_record(header_info, &position, record, 1);
+  return insert_from(header_info, record, (position.room_block != -1) ? position.room_block : position.block_id);
+}
+
+int HT_Upsert(HT_info *header_info, const Record *record) {
+  HT_TRACE_START(trace_start);
+  HT_METRIC_TIMER_START(timer);
+  int res = upsert_entry(header_info, record);
+  HT_METRIC_TIMER_STOP(header_info->metrics, HT_OP_UPDATE, timer);
+  if (ht_tracer != NULL) {
+    ht_trace_begin(HT_TRACE_UPSERT, trace_start, header_info->fileDesc, res);
+    ht_trace_put_record(record);
+    ht_trace_end();
+  }
+  return res;
+}
+
+int HT_Find(HT_info *header_info, const void *value, HT_view *view) {
+  if (header_info->kernel == NULL) return -1;
+  *view = (HT_view) {
+          .info = header_info,
+          .value = value,
+          .valueLength = header_info->kernel->key_length(value),
+          .blockId = (int) hash_function(header_info->attrType, header_info->numBuckets, value)
+  };
+  return 0;
+}
+
+int HT_ViewNext(HT_view *view, const Record **record) {
+  const HT_info *header_info = view->info;
+  HT_metrics *metrics = header_info->metrics;
+  while (view->blockId != -1) {
+    void *block;
+    if (view->nextRecord == 0U) {
+      CHECK(ht_read_block(metrics, header_info->fileDesc, view->blockId, &block), BF_READ_BLOCK_EMSG, return -1);
+      ++view->blocksRead;
+    } else {
+      // Pinning the block again is a lookup in the BF buffers, it only goes to disk if the block got evicted
+      CHECK(ht_fetch_block(header_info->fileDesc, view->blockId, &block), BF_READ_BLOCK_EMSG, return -1);
+    }
+    const bucket_info_t *bucket_info = block;
+    if (view->nextRecord < bucket_info->record_n) {
+      unsigned int from = view->nextRecord;
+      unsigned int i = header_info->kernel->find(block, from, view->value, view->valueLength);
+      HT_METRIC_ADD(metrics, compares, i - from + (i != bucket_info->record_n));
+      HT_METRIC_ADD(metrics, hashCollisions, i - from);
+      if (i != bucket_info->record_n) {
+        view->nextRecord = i + 1U;
+        *record = block_record(block, header_info->flags, i, &view->scratch);
+        return 1;
       }
-      if (bucket_info.overflow_bucket == -1) return -1;
-      bucket = bucket_info.overflow_bucket;
     }
+    view->blockId = bucket_info->overflow_bucket;
+    view->nextRecord = 0U;
+    if (view->blockId != -1) HT_METRIC_ADD(metrics, chainHops, 1U);
   }
-__SEARCH_END:;
-  size_t remaining_records = bucket_info.record_n - i - 1;
-  memcpy(block, block + sizeof(Record), remaining_records * sizeof(Record));
-  bucket_info.next_record -= sizeof(Record);
-  bucket_info.free_space += sizeof(Record);
-  --bucket_info.record_n;
-  memcpy(block_base, &bucket_info, sizeof(bucket_info_t));
-  CHECK(BF_WriteBlock(index_descriptor, bucket), BF_WRITE_BLOCK_EMSG, return -1);
   return 0;
 }
 
-int HT_GetAllEntries(HT_info header_info, void *value) {
-  int index_descriptor = header_info.fileDesc;
-  int bucket = (int) hash_function(header_info.attrType, header_info.numBuckets, value);
-  int blocks_read = 0;
+void HT_ViewRelease(HT_view *view) {
+  view->blockId = -1;
+  view->nextRecord = 0U;
+}
+
+static int append_result(HT_result_set *result, const Record *record) {
+  if (result->count == result->capacity) {
+    size_t new_capacity = result->capacity ? result->capacity * 2U : 4U;
+    Record *records = realloc(result->records, new_capacity * sizeof(Record));
+    if (records == NULL) return -1;
+    result->records = records;
+    result->capacity = new_capacity;
+  }
+  result->records[result->count++] = *record;
+  return 0;
+}
+
+static int cached_get_all_entries(HT_info *header_info, int id) {
+  const Record *records;
+  size_t count;
+  if (ht_record_cache_lookup(header_info->cache, id, &records, &count)) {
+    for (size_t i = 0U; i != count; ++i) print_record(&records[i]);
+    return (count == 0U) ? -1 : 0;
+  }
+  HT_view view;
+  const Record *record;
+  HT_result_set found = {0};
+  int found_any = 0;
+  int complete = 1;
+  int res;
+  if (HT_Find(header_info, &id, &view) < 0) return -1;
+  while ((res = HT_ViewNext(&view, &record)) > 0) {
+    found_any = 1;
+    print_record(record);
+    if (append_result(&found, record) < 0) complete = 0;
+  }
+  HT_ViewRelease(&view);
+  // Only a lookup that went through the whole chain and kept every record is worth caching
+  if (res == 0 && complete) ht_record_cache_admit(header_info->cache, id, found.records, found.count);
+  free(found.records);
+  if (res < 0) return -1;
+  return (!found_any) ? -1 : view.blocksRead;
+}
+
+static int get_all_entries(HT_info *header_info, void *value) {
+  if (header_info->cache != NULL) return cached_get_all_entries(header_info, *(int *) value);
+  HT_view view;
+  const Record *record;
   int found = 0;
-  if (header_info.attrType == 'c') {
-    size_t value_len = strlen(value);
-    size_t field_offset = get_attribute_offset(header_info.attrName, header_info.attrLength);
-    do {
-      void *block;
-      CHECK(BF_ReadBlock(index_descriptor, bucket, &block), BF_READ_BLOCK_EMSG, return -1);
-      bucket_info_t bucket_info = *(bucket_info_t *) block;
-      block += sizeof(bucket_info_t);
-      for (size_t i = 0U; i != bucket_info.record_n; ++i, block += sizeof(Record)) {
-        char *key = ((char *) (block + field_offset));
-        if (!strncmp(key, value, value_len)) {
-          found = 1;
-          print_record(block);
+  int res;
+  if (HT_Find(header_info, value, &view) < 0) return -1;
+  while ((res = HT_ViewNext(&view, &record)) > 0) {
+    found = 1;
+    print_record(record);
+  }
+  HT_ViewRelease(&view);
+  if (res < 0) return -1;
+  return (!found) ? -1 : view.blocksRead;
+}
+
+int HT_GetAllEntries(HT_info header_info, void *value) {
+  HT_TRACE_START(trace_start);
+  HT_METRIC_TIMER_START(timer);
+  int res = get_all_entries(&header_info, value);
+  HT_METRIC_TIMER_STOP(header_info.metrics, HT_OP_GET, timer);
+  if (ht_tracer != NULL) {
+    ht_trace_begin(HT_TRACE_GET, trace_start, header_info.fileDesc, res);
+    ht_trace_put_key(header_info.attrType, value);
+    ht_trace_end();
+  }
+  return res;
+}
+
+typedef struct {
+  uint32_t bucket;
+  uint32_t key_index;
+} bucket_probe_t;
+
+static int compare_probes(const void *a, const void *b) {
+  const bucket_probe_t *lhs = a;
+  const bucket_probe_t *rhs = b;
+  if (lhs->bucket != rhs->bucket) return (lhs->bucket < rhs->bucket) ? -1 : 1;
+  return (lhs->key_index < rhs->key_index) ? -1 : (lhs->key_index > rhs->key_index);
+}
+
+static int insert_many(HT_info *header_info, const Record *records, size_t n, int *block_ids) {
+  if (n == 0U) return 0;
+  if (records == NULL || n > UINT32_MAX) return -1;
+  int index_descriptor = header_info->fileDesc;
+  HT_metrics *metrics = header_info->metrics;
+  unsigned int flags = header_info->flags;
+  int compress_cold = (flags & HT_FLAG_COMPRESS_COLD) != 0U;
+  int appended;
+  bucket_probe_t *probes = __MALLOC(n, bucket_probe_t);
+  if (probes == NULL) return -1;
+  for (size_t i = 0U; i != n; ++i) {
+    if (header_info->cache != NULL) ht_record_cache_invalidate(header_info->cache, records[i].id);
+    void *hash_attribute = get_hash_attribute(header_info->attrType, header_info->attrName,
+                                              header_info->attrLength, (Record *) &records[i]);
+    if (hash_attribute == NULL) goto __INSERT_MANY_ERROR;
+    probes[i].bucket = (uint32_t) hash_function(header_info->attrType, header_info->numBuckets, hash_attribute);
+    probes[i].key_index = (uint32_t) i;
+  }
+  // Ties are broken by key_index, so the records of a bucket are appended in the order they were given
+  qsort(probes, n, sizeof(bucket_probe_t), compare_probes);
+
+  int blocks_written = 0;
+  for (size_t next = 0U, group_end; next != n; next = group_end) {
+    int current_bucket = (int) probes[next].bucket;
+    for (group_end = next + 1U; group_end != n && probes[group_end].bucket == probes[next].bucket; ++group_end);
+    void *block;
+    CHECK(ht_read_block(metrics, index_descriptor, current_bucket, &block), BF_READ_BLOCK_EMSG,
+          goto __INSERT_MANY_ERROR);
+    bucket_info_t *bucket_info = block;
+    while (1U) {
+      int dirty = 0;
+      for (; next != group_end; ++next, dirty = 1) {
+        uint32_t key_index = probes[next].key_index;
+        if (bucket_info->free_space < (int) block_entry_size(flags, &records[key_index])) break;
+        if (!dirty) {
+          CHECK(ht_prepare_block_write(index_descriptor, current_bucket), BF_READ_BLOCK_EMSG,
+                goto __INSERT_MANY_ERROR);
         }
+        block_append(block, flags, &records[key_index]);
+        if (block_ids != NULL) block_ids[key_index] = current_bucket;
       }
-      bucket = bucket_info.overflow_bucket;
-      ++blocks_read;
-    } while (bucket != -1);
+      if (next == group_end) {
+        if (dirty) {
+          CHECK(ht_write_block(metrics, index_descriptor, current_bucket), BF_WRITE_BLOCK_EMSG,
+                goto __INSERT_MANY_ERROR);
+          ++blocks_written;
+        }
+        break;
+      }
+      // The last block of the chain changes either way
+      if (bucket_info->overflow_bucket == -1) {
+        CHECK(ht_prepare_block_write(index_descriptor, current_bucket), BF_READ_BLOCK_EMSG,
+              goto __INSERT_MANY_ERROR);
+      }
+      if (bucket_info->overflow_bucket != -1) {
+        if (dirty) {
+          CHECK(ht_write_block(metrics, index_descriptor, current_bucket), BF_WRITE_BLOCK_EMSG,
+                goto __INSERT_MANY_ERROR);
+          ++blocks_written;
+        }
+        current_bucket = bucket_info->overflow_bucket;
+        CHECK(ht_read_block(metrics, index_descriptor, current_bucket, &block), BF_READ_BLOCK_EMSG,
+              goto __INSERT_MANY_ERROR);
+        HT_METRIC_ADD(metrics, chainHops, 1U);
+      } else if (compress_cold && current_bucket > (int) header_info->numBuckets &&
+                 (appended = ht_append_compressed(metrics, index_descriptor, current_bucket, block,
+                                                  &records[probes[next].key_index])) != 0) {
+        CHECK(appended, BF_WRITE_BLOCK_EMSG, goto __INSERT_MANY_ERROR);
+        if (block_ids != NULL) block_ids[probes[next].key_index] = current_bucket;
+        ++next;
+        ++blocks_written;
+        CHECK(ht_read_block(metrics, index_descriptor, current_bucket, &block), BF_READ_BLOCK_EMSG,
+              goto __INSERT_MANY_ERROR);
+      } else {
+        int overflow_bucket;
+        CHECK(overflow_bucket = ht_allocate_block(metrics, index_descriptor), BF_ALLOCATE_EMSG,
+              goto __INSERT_MANY_ERROR);
+        bucket_info->overflow_bucket = overflow_bucket;
+        CHECK(ht_write_block(metrics, index_descriptor, current_bucket), BF_WRITE_BLOCK_EMSG,
+              goto __INSERT_MANY_ERROR);
+        ++blocks_written;
+        current_bucket = overflow_bucket;
+        CHECK(ht_read_block(metrics, index_descriptor, current_bucket, &block), BF_READ_BLOCK_EMSG,
+              goto __INSERT_MANY_ERROR);
+      }
+      bucket_info = block;
+    }
+  }
+  HT_METRIC_ADD(metrics, operations[HT_OP_INSERT], n);
+  free(probes);
+  return blocks_written;
+
+__INSERT_MANY_ERROR:
+  free(probes);
+  return -1;
+}
+
+int HT_InsertMany(HT_info *header_info, const Record *records, size_t n, int *block_ids) {
+  HT_TRACE_START(trace_start);
+  int res = insert_many(header_info, records, n, block_ids);
+  if (ht_tracer != NULL && records != NULL) {
+    ht_trace_begin(HT_TRACE_INSERT_MANY, trace_start, header_info->fileDesc, res);
+    ht_trace_put_int((long) n);
+    for (size_t i = 0U; i != n; ++i) ht_trace_put_record(&records[i]);
+    ht_trace_end();
+  }
+  return res;
+}
+
+/* Logs a call that took n keys */
+static void trace_keys(HT_trace_op op, uint64_t start, const HT_info *header_info, int result, const void *keys,
+                       size_t n) {
+  ht_trace_begin(op, start, header_info->fileDesc, result);
+  ht_trace_put_int((long) n);
+  for (size_t i = 0U; i != n; ++i) {
+    ht_trace_put_key(header_info->attrType, (header_info->attrType == 'c') ? ((char *const *) keys)[i]
+                                                                           : (const void *) &((const int *) keys)[i]);
+  }
+  ht_trace_end();
+}
+
+/* Gets every match of get_many. Returns 0 to go on, 1 to stop and -1 to fail */
+typedef int (*match_callback_t)(void *context, uint32_t key_index, const void *block, unsigned int i, int block_id);
+
+typedef struct {
+  HT_result_set *results;
+  unsigned int flags;
+} result_sink_t;
+
+typedef struct {
+  HT_batch *batch;
+  unsigned int flags;
+  HT_batch_callback callback;
+  void *context;
+} batch_sink_t;
+
+/**
+ * get_many - Walks the chain of every bucket the keys hash to once and passes on the matching entries
+ * @param block_copy When not NULL, every block is copied into it first, so that on_match may use the BF layer
+ * @return On success returns the number of blocks read
+ * On failure returns -1
+ */
+static int get_many(HT_info *header_info, const void *keys, size_t n, match_callback_t on_match, void *context,
+                    char *block_copy) {
+  const ht_key_kernel_t *kernel = header_info->kernel;
+  if (keys == NULL || n > UINT32_MAX || kernel == NULL) return -1;
+  int index_descriptor = header_info->fileDesc;
+  HT_metrics *metrics = header_info->metrics;
+  size_t bucket_n = header_info->numBuckets;
+  int is_string = header_info->attrType == 'c';
+  const int *ids = keys;
+  char *const *strings = keys;
+
+  bucket_probe_t *probes = __MALLOC(n, bucket_probe_t);
+  size_t *key_lengths = is_string ? __MALLOC(n, size_t) : NULL;
+  if (probes == NULL || (is_string && key_lengths == NULL)) {
+    free(probes);
+    free(key_lengths);
+    return -1;
+  }
+  // Hash every key up front. The integer case is a plain loop over the id array so the compiler can vectorize it.
+  if (is_string) {
+    for (size_t i = 0U; i != n; ++i) {
+      probes[i].bucket = (uint32_t) hash_function('c', bucket_n, strings[i]);
+      probes[i].key_index = (uint32_t) i;
+      key_lengths[i] = strlen(strings[i]);
+    }
   } else {
-    int id = *(int *) value;
+    for (size_t i = 0U; i != n; ++i) {
+      probes[i].bucket = (uint32_t) ((size_t) ids[i] % bucket_n + 1U);
+      probes[i].key_index = (uint32_t) i;
+    }
+  }
+  // Grouping the keys by bucket means every chain is walked once and the buckets are visited in file order.
+  qsort(probes, n, sizeof(bucket_probe_t), compare_probes);
+
+  int blocks_read = 0;
+  int res = 0;
+  for (size_t group_start = 0U, group_end; group_start != n && res == 0; group_start = group_end) {
+    int bucket = (int) probes[group_start].bucket;
+    for (group_end = group_start + 1U; group_end != n && probes[group_end].bucket == (uint32_t) bucket; ++group_end);
     do {
       void *block;
-      CHECK(BF_ReadBlock(index_descriptor, bucket, &block), BF_READ_BLOCK_EMSG, return -1);
-      bucket_info_t bucket_info = *(bucket_info_t *) block;
-      block += sizeof(bucket_info_t);
-      for (size_t i = 0U; i != bucket_info.record_n; ++i, block += sizeof(Record)) {
-        if (((Record *) block)->id == id) {
-          found = 1;
-          print_record(block);
+      CHECK(ht_read_block(metrics, index_descriptor, bucket, &block), BF_READ_BLOCK_EMSG, {
+        res = -1;
+        goto __GET_MANY_END;
+      });
+      const bucket_info_t *bucket_info = block;
+      if (block_copy != NULL) {
+        memcpy(block_copy, block,
+               (bucket_info->flags & BLOCK_COMPRESSED) ? (size_t) bucket_info->next_record : BLOCK_SIZE);
+        block = block_copy;
+        bucket_info = block;
+      }
+      unsigned int record_n = bucket_info->record_n;
+      for (size_t j = group_start; j != group_end && res == 0; ++j) {
+        uint32_t key_index = probes[j].key_index;
+        const void *key = is_string ? (const void *) strings[key_index] : (const void *) &ids[key_index];
+        size_t key_len = is_string ? key_lengths[key_index] : 0U;
+        for (unsigned int i = kernel->find(block, 0U, key, key_len); i != record_n && res == 0;
+             i = kernel->find(block, i + 1U, key, key_len)) {
+          res = on_match(context, key_index, block, i, bucket);
         }
       }
-      bucket = bucket_info.overflow_bucket;
+      HT_METRIC_ADD(metrics, compares, bucket_info->record_n * (group_end - group_start));
       ++blocks_read;
-    } while (bucket != -1);
+      bucket = bucket_info->overflow_bucket;
+      if (bucket != -1) HT_METRIC_ADD(metrics, chainHops, 1U);
+    } while (bucket != -1 && res == 0);
   }
-  return (!found) ? -1 : blocks_read;
+
+__GET_MANY_END:
+  free(probes);
+  free(key_lengths);
+  return (res < 0) ? -1 : blocks_read;
 }
 
-int SHT_CreateSecondaryIndex(char *secondary_index_name, char *attribute_name,
-                             int attribute_length, int bucket_n, char *index_name) {
+static int collect_match(void *context, uint32_t key_index, const void *block, unsigned int i, int block_id) {
+  (void) block_id;
+  result_sink_t *sink = context;
+  Record scratch;
+  return append_result(&sink->results[key_index], block_record(block, sink->flags, i, &scratch));
+}
+
+static int batch_match(void *context, uint32_t key_index, const void *block, unsigned int i, int block_id) {
+  batch_sink_t *sink = context;
+  HT_batch *batch = sink->batch;
+  if (batch->keyIndexes != NULL) batch->keyIndexes[batch->count] = key_index;
+  ht_batch_append(batch, block, sink->flags, i, 1U, block_id);
+  if (batch->count != batch->capacity) return 0;
+  return ht_batch_flush(batch, sink->callback, sink->context) ? 1 : 0;
+}
+
+int HT_GetMany(HT_info *header_info, const void *keys, size_t n, HT_result_set *results) {
+  HT_TRACE_START(trace_start);
+  memset(results, 0, n * sizeof(HT_result_set));
+  if (n == 0U) return 0;
+  result_sink_t sink = {results, header_info->flags};
+  int res = get_many(header_info, keys, n, collect_match, &sink, NULL);
+  if (res < 0) HT_FreeResults(results, n);
+  if (ht_tracer != NULL && keys != NULL) trace_keys(HT_TRACE_GET_MANY, trace_start, header_info, res, keys, n);
+  return res;
+}
+
+int HT_GetManyBatches(HT_info *header_info, const void *keys, size_t n, HT_batch *batch,
+                      HT_batch_callback callback, void *context) {
+  if (batch->capacity == 0U) return -1;
+  batch->count = 0U;
+  if (n == 0U) return 0;
+  batch_sink_t sink = {batch, header_info->flags, callback, context};
+  // The callback is free to use the BF layer, which may evict our buffer
+  char block_copy[HT_EXPANDED_BLOCK_SIZE];
+  int res = get_many(header_info, keys, n, batch_match, &sink, block_copy);
+  if (res >= 0 && batch->count != 0U) (void) ht_batch_flush(batch, callback, context);
+  return res;
+}
 
-  if (sizeof(SHT_info) > BLOCK_SIZE) return HT_BLOCK_OVERFLOW;
+void HT_FreeResults(HT_result_set *results, size_t n) {
+  if (results == NULL) return;
+  for (size_t i = 0U; i != n; ++i) {
+    free(results[i].records);
+    results[i] = (HT_result_set) {0};
+  }
+}
+
+int HT_Scan(HT_info *header_info, HT_scan_callback callback, void *context) {
+  int index_descriptor = header_info->fileDesc;
+  HT_metrics *metrics = header_info->metrics;
+  int total_blocks;
+  CHECK(total_blocks = BF_GetBlockCounter(index_descriptor), BF_GET_BLOCK_COUNTER_EMSG, return -1);
+  // The callback is free to use the BF layer, which may evict our buffer, so each block is copied out first.
+  char block_copy[HT_EXPANDED_BLOCK_SIZE];
+  int blocks_read = 0;
+  for (int block_id = 1; block_id < total_blocks; ++block_id) {
+    void *block;
+    CHECK(ht_read_block(metrics, index_descriptor, block_id, &block), BF_READ_BLOCK_EMSG, return -1);
+    const bucket_info_t *bucket_info = block;
+    memcpy(block_copy, block, (bucket_info->flags & BLOCK_COMPRESSED) ? (size_t) bucket_info->next_record : BLOCK_SIZE);
+    ++blocks_read;
+    bucket_info = (const bucket_info_t *) block_copy;
+    for (unsigned int i = 0U; i != bucket_info->record_n; ++i) {
+      Record scratch;
+      if (callback(block_record(block_copy, header_info->flags, i, &scratch), block_id, context)) return blocks_read;
+    }
+  }
+  return blocks_read;
+}
+
+static int create_secondary_index(char *secondary_index_name, char *attribute_name,
+                                  int attribute_length, int bucket_n, char *index_name) {
+
+  // The index name gets stored in block 0 after the SHT_info, and must end before the format version
+  if (sizeof(SHT_info) > BLOCK_SIZE || strlen(SHT_FILE_IDENTIFIER) + offsetof(SHT_info, fileName) +
+                                       strlen(index_name) >= HT_HEADER_VERSION_OFFSET) {
+    return HT_BLOCK_OVERFLOW;
+  }
   int secondary_index_descriptor = 0;
   CHECK(BF_CreateFile(secondary_index_name), BF_CREATE_EMSG, return -1);
   CHECK(secondary_index_descriptor = BF_OpenFile(secondary_index_name), BF_OPEN_EMSG, return -1);
@@ -304,20 +898,34 @@ int SHT_CreateSecondaryIndex(char *secondary_index_name, char *attribute_name,
   info->numBuckets = (unsigned long) bucket_n;
   memcpy(&info->attrName, attribute_name, (size_t) attribute_length);
   memcpy(&info->fileName, index_name, strlen(index_name));
+  ht_seal_header(block - identifier_len);
 
   CHECK(BF_WriteBlock(secondary_index_descriptor, 0), BF_WRITE_BLOCK_EMSG, return -1);
   for (size_t i = 1U; i <= bucket_n; ++i) {
-    CHECK(BF_AllocateBlock(secondary_index_descriptor), BF_ALLOCATE_EMSG, return -1);
-    void *bucket_block;
-    CHECK(BF_ReadBlock(secondary_index_descriptor, (int) i, &bucket_block), BF_READ_BLOCK_EMSG, return -1);
-    initialize_block(bucket_block);
+    CHECK(ht_append_block(secondary_index_descriptor, (int) i), BF_ALLOCATE_EMSG, return -1);
     CHECK(BF_WriteBlock(secondary_index_descriptor, (int) i), BF_WRITE_BLOCK_EMSG, return -1);
   }
   CHECK(BF_CloseFile(secondary_index_descriptor), BF_CLOSE_EMSG, return -1);
   return 0;
 }
 
-SHT_info *SHT_OpenSecondaryIndex(char *sfileName) {
+int SHT_CreateSecondaryIndex(char *secondary_index_name, char *attribute_name,
+                             int attribute_length, int bucket_n, char *index_name) {
+  HT_TRACE_START(trace_start);
+  int res = create_secondary_index(secondary_index_name, attribute_name, attribute_length, bucket_n, index_name);
+  if (ht_tracer != NULL) {
+    ht_trace_begin(SHT_TRACE_CREATE, trace_start, -1, res);
+    ht_trace_put_string(secondary_index_name, SIZE_MAX);
+    ht_trace_put_string(attribute_name, (size_t) attribute_length);
+    ht_trace_put_int(attribute_length);
+    ht_trace_put_int(bucket_n);
+    ht_trace_put_string(index_name, SIZE_MAX);
+    ht_trace_end();
+  }
+  return res;
+}
+
+static SHT_info *open_secondary_index(char *sfileName) {
   int sfd;  // Secondary index file decriptor.
   CHECK(sfd = BF_OpenFile(sfileName), BF_OPEN_EMSG, return NULL);
 
@@ -325,14 +933,18 @@ SHT_info *SHT_OpenSecondaryIndex(char *sfileName) {
   CHECK(BF_ReadBlock(sfd, 0, &block), BF_READ_BLOCK_EMSG, return NULL);
 
   size_t identifier_len = strlen(SHT_FILE_IDENTIFIER);
-  if (memcmp(block, SHT_FILE_IDENTIFIER, identifier_len) != 0) return NULL;
+  if (memcmp(block, SHT_FILE_IDENTIFIER, identifier_len) != 0 || !ht_header_current(block, sfileName) ||
+      !ht_header_intact(block)) {
+    return NULL;
+  }
   block += identifier_len;
 
   SHT_info *info = (SHT_info *) block;
   SHT_info *sht_info = __MALLOC(1, SHT_info);
   if (sht_info == NULL) return NULL;
 
-  sht_info->fileDesc = info->fileDesc;
+  sht_info->fileDesc = sfd;
+  sht_info->attrLength = info->attrLength;
   sht_info->fileName = info->fileName;
   sht_info->numBuckets = info->numBuckets;
   sht_info->attrName = __MALLOC(info->attrLength + 1, char);
@@ -342,172 +954,485 @@ SHT_info *SHT_OpenSecondaryIndex(char *sfileName) {
   sht_info->fileName = __MALLOC(index_name_len + 1, char);
   STR_COPY(sht_info->attrName, &info->attrName, info->attrLength);
   STR_COPY(sht_info->fileName, &info->fileName, index_name_len);
+  sht_info->metrics = create_metrics();
   return sht_info;
 }
 
-int SHT_CloseSecondaryIndex(SHT_info *header_info) {
-  if (header_info == NULL) return -1;
+SHT_info *SHT_OpenSecondaryIndex(char *sfileName) {
+  HT_TRACE_START(trace_start);
+  SHT_info *sht_info = open_secondary_index(sfileName);
+  if (ht_tracer != NULL) {
+    int sfd = (sht_info != NULL) ? sht_info->fileDesc : -1;
+    ht_trace_begin(SHT_TRACE_OPEN, trace_start, sfd, sfd);
+    ht_trace_put_string(sfileName, SIZE_MAX);
+    ht_trace_end();
+  }
+  return sht_info;
+}
+
+static int close_secondary_index(SHT_info *header_info) {
+  ht_release_blocks(header_info->fileDesc);
+  ht_snapshot_detach(header_info->fileDesc);
   CHECK(BF_CloseFile(header_info->fileDesc), BF_CLOSE_EMSG, return -1);
   free(header_info->attrName);
   free(header_info->fileName);
+  free(header_info->metrics);
   free(header_info);
   return 0;
 }
 
-int SHT_SecondaryInsertEntry(SHT_info header_info, SecondaryRecord sRecord) {
-  int sfd = header_info.fileDesc;
-  char *hash_attribute = get_hash_attribute('c', header_info.attrName, header_info.attrLength,
-                                            &sRecord.record);
+int SHT_CloseSecondaryIndex(SHT_info *header_info) {
+  if (header_info == NULL) return -1;
+  HT_TRACE_START(trace_start);
+  int sfd = header_info->fileDesc;
+  int res = close_secondary_index(header_info);
+  if (ht_tracer != NULL) {
+    ht_trace_begin(SHT_TRACE_CLOSE, trace_start, sfd, res);
+    ht_trace_end();
+  }
+  return res;
+}
+
+/* Adds an id to the posting blocks from head on, starting a new one when head is full. Returns the new head */
+static int append_posting(HT_metrics *metrics, int sfd, int head, int32_t id) {
+  void *block;
+  if (head != -1) {
+    CHECK(ht_read_block(metrics, sfd, head, &block), BF_READ_BLOCK_EMSG, return -1);
+    bucket_info_t *bucket_info = block;
+    int32_t last_id;
+    memcpy(&last_id, (char *) block + sizeof(bucket_info_t), sizeof(int32_t));
+    if (last_id == id) return head;
+    uint32_t delta = sht_zigzag((int32_t) ((uint32_t) id - (uint32_t) last_id));
+    if (bucket_info->free_space >= (int) sht_varint_size(delta)) {
+      size_t size = sht_varint_put((uint8_t *) block + bucket_info->next_record, delta);
+      memcpy((char *) block + sizeof(bucket_info_t), &id, sizeof(int32_t));
+      bucket_info->next_record += (int) size;
+      bucket_info->free_space -= (int) size;
+      ++bucket_info->record_n;
+      CHECK(ht_write_block(metrics, sfd, head), BF_WRITE_BLOCK_EMSG, return -1);
+      return head;
+    }
+  }
+  int postings;
+  CHECK(postings = ht_allocate_block(metrics, sfd), BF_ALLOCATE_EMSG, return -1);
+  CHECK(ht_read_block(metrics, sfd, postings, &block), BF_READ_BLOCK_EMSG, return -1);
+  // Past the fields set here, the block is all zeroes from the allocation
+  bucket_info_t *bucket_info = block;
+  bucket_info->flags = BLOCK_POSTINGS;
+  bucket_info->overflow_bucket = head;
+  memcpy((char *) block + sizeof(bucket_info_t), &id, sizeof(int32_t));
+  bucket_info->next_record = (int) (SHT_POSTINGS_START +
+                                    sht_varint_put((uint8_t *) block + SHT_POSTINGS_START, sht_zigzag(id)));
+  bucket_info->free_space = BLOCK_SIZE - bucket_info->next_record;
+  bucket_info->record_n = 1U;
+  CHECK(ht_write_block(metrics, sfd, postings), BF_WRITE_BLOCK_EMSG, return -1);
+  return postings;
+}
+
+/* Encodes an entry to out: fields, list_size bytes of list, then delta unless delta_size is 0. Returns the size */
+static size_t encode_entry(char *out, const sht_entry_t *entry, const void *list, size_t list_size, uint32_t delta,
+                           size_t delta_size) {
+  out[0] = (char) entry->key_len;
+  memcpy(out + 1, entry->key, entry->key_len);
+  size_t size = 1U + entry->key_len;
+  size += sht_entry_put_fields((uint8_t *) out + size, entry);
+  if (list_size != 0U) memcpy(out + size, list, list_size);
+  size += list_size;
+  if (delta_size != 0U) size += sht_varint_put((uint8_t *) out + size, delta);
+  return size;
+}
+
+/* Writes an encoded entry to the first block of the chain from block_id on with room for it, extending the chain if none has */
+static int place_entry(HT_metrics *metrics, int sfd, int block_id, const char *entry, size_t size) {
+  void *block;
+  bucket_info_t *bucket_info;
+  while (1U) {
+    CHECK(ht_read_block(metrics, sfd, block_id, &block), BF_READ_BLOCK_EMSG, return -1);
+    bucket_info = block;
+    if (bucket_info->free_space >= (int) size) break;
+    if (bucket_info->overflow_bucket != -1) {
+      block_id = bucket_info->overflow_bucket;
+      HT_METRIC_ADD(metrics, chainHops, 1U);
+      continue;
+    }
+    // The new block comes cleared and empty, files recreated under an old name would hand back stale contents
+    int overflow_bucket;
+    CHECK(overflow_bucket = ht_allocate_block(metrics, sfd), BF_ALLOCATE_EMSG, return -1);
+    bucket_info->overflow_bucket = overflow_bucket;
+    CHECK(ht_write_block(metrics, sfd, block_id), BF_WRITE_BLOCK_EMSG, return -1);
+    block_id = overflow_bucket;
+  }
+  memcpy((char *) block + bucket_info->next_record, entry, size);
+  bucket_info->next_record += (int) size;
+  bucket_info->free_space -= (int) size;
+  ++bucket_info->record_n;
+  CHECK(ht_write_block(metrics, sfd, block_id), BF_WRITE_BLOCK_EMSG, return -1);
+  return block_id;
+}
+
+/**
+ * rewrite_entry - Writes back an entry of block whose fields changed, with delta appended to its inline list
+ * unless delta_size is 0. The entry grows in place while its block has room and moves down the chain otherwise
+ * @param entry The entry with its new fields, its offsets still those of the block
+ * @return Returns the block the entry ends up in, or -1 on failure
+ */
+static int rewrite_entry(HT_metrics *metrics, int sfd, int entry_block, void *block, const sht_entry_t *entry,
+                         uint32_t delta, size_t delta_size) {
+  bucket_info_t *bucket_info = block;
+  size_t entry_offset = entry->fields - 1U - entry->key_len;
+  size_t entry_size = entry->end - entry_offset;
+  char encoded[SHT_ENTRY_MAX_SIZE];
+  size_t size = encode_entry(encoded, entry, (char *) block + entry->list, entry->end - entry->list, delta,
+                             delta_size);
+  size_t growth = size - entry_size;
+  char *tail = (char *) block + entry->end;
+  size_t tail_size = (size_t) bucket_info->next_record - entry->end;
+  if (bucket_info->free_space >= (int) growth) {
+    // The entries after this one move up to make room
+    memmove(tail + growth, tail, tail_size);
+    memcpy((char *) block + entry_offset, encoded, size);
+    bucket_info->next_record += (int) growth;
+    bucket_info->free_space -= (int) growth;
+    CHECK(ht_write_block(metrics, sfd, entry_block), BF_WRITE_BLOCK_EMSG, return -1);
+    return entry_block;
+  }
+  // The entries after this one move down over it
+  memmove((char *) block + entry_offset, tail, tail_size);
+  bucket_info->next_record -= (int) entry_size;
+  bucket_info->free_space += (int) entry_size;
+  --bucket_info->record_n;
+  memset((char *) block + bucket_info->next_record, 0, entry_size);
+  CHECK(ht_write_block(metrics, sfd, entry_block), BF_WRITE_BLOCK_EMSG, return -1);
+  return place_entry(metrics, sfd, entry_block, encoded, size);
+}
+
+/* Adds an id to an entry: inline while it fits, moving the entry down the chain while it is small, then to posting blocks */
+static int append_id(HT_metrics *metrics, int sfd, int entry_block, void *block, sht_entry_t *entry, int32_t id) {
+  size_t entry_offset = entry->fields - 1U - entry->key_len;
+  bucket_info_t *bucket_info = block;
+  ++entry->records;
+  if (entry->postings == -1) {
+    // The last id of the list is the sum of its deltas
+    int32_t last_id = sht_last_id((const uint8_t *) block + entry->list, entry->list_bytes);
+    if (last_id == id) return rewrite_entry(metrics, sfd, entry_block, block, entry, 0U, 0U);
+    uint32_t delta = sht_zigzag((int32_t) ((uint32_t) id - (uint32_t) last_id));
+    size_t size = sht_varint_size(delta);
+    ++entry->count;
+    entry->list_bytes = (uint16_t) (entry->list_bytes + size);
+    size_t grown_size = sht_entry_size(entry);
+    if (grown_size <= SHT_ENTRY_LIST_LIMIT && (grown_size <= SHT_ENTRY_INLINE_LIMIT ||
+                                               grown_size - (entry->end - entry_offset) <=
+                                               (size_t) bucket_info->free_space)) {
+      return rewrite_entry(metrics, sfd, entry_block, block, entry, delta, size);
+    }
+    --entry->count;
+    entry->list_bytes = (uint16_t) (entry->list_bytes - size);
+  }
+  int postings;
+  CHECK(postings = append_posting(metrics, sfd, entry->postings, id), BF_WRITE_BLOCK_EMSG, return -1);
+  // The posting blocks went through the BF buffer, so the entry gets read again
+  sht_entry_t updated;
+  CHECK(ht_read_block(metrics, sfd, entry_block, &block), BF_READ_BLOCK_EMSG, return -1);
+  if (sht_entry_parse(block, entry_offset, (size_t) ((bucket_info_t *) block)->next_record, &updated) < 0) return -1;
+  updated.postings = postings;
+  updated.records = entry->records;
+  return rewrite_entry(metrics, sfd, entry_block, block, &updated, 0U, 0U);
+}
+
+static int secondary_insert_entry(const SHT_info *header_info, const SecondaryRecord *sRecord) {
+  int sfd = header_info->fileDesc;
+  HT_metrics *metrics = header_info->metrics;
+  char *hash_attribute = get_hash_attribute('c', header_info->attrName, header_info->attrLength,
+                                            (Record *) &sRecord->record);
   if (hash_attribute == NULL)
     return -1;
-  int bucket = (int) hash_function('c', header_info.numBuckets, hash_attribute);
-  void *block;
-  CHECK(BF_ReadBlock(sfd, bucket, &block), BF_READ_BLOCK_EMSG, return -1);
-  bucket_info_t bucket_info = *(bucket_info_t *) block;
+  int bucket = (int) hash_function('c', header_info->numBuckets, hash_attribute);
+  size_t field_offset = get_attribute_offset(header_info->attrName, header_info->attrLength);
+  size_t key_len = strnlen(hash_attribute, record_fields[compact_field_index(field_offset)].size);
+  int32_t id = sRecord->blockId;
+  uint32_t first = sht_zigzag(id);
+  sht_entry_t new_entry = {
+          .key = hash_attribute,
+          .key_len = key_len,
+          .postings = -1,
+          .records = 1U,
+          .count = 1U,
+          .list_bytes = (uint16_t) sht_varint_size(first)
+  };
+  size_t entry_size = sht_entry_size(&new_entry);
+  // The whole chain gets searched for the key, a new key goes to the first block with room for it
+  int room_block = -1;
   int current_bucket = bucket;
-  while (bucket_info.free_space < sizeof(SHT_insert_info)) {
-    if (bucket_info.overflow_bucket != -1) {
-      CHECK(BF_ReadBlock(sfd, bucket_info.overflow_bucket, &block), BF_READ_BLOCK_EMSG, return -1);
-      current_bucket = bucket_info.overflow_bucket;
-      bucket_info = *(bucket_info_t *) block;
-    } else {
-      CHECK(BF_AllocateBlock(sfd), BF_ALLOCATE_EMSG, return -1);
-      CHECK(bucket_info.overflow_bucket = BF_GetBlockCounter(sfd) - 1, BF_GET_BLOCK_COUNTER_EMSG,
-            return -1);
-      memcpy(block, &bucket_info, sizeof(bucket_info_t));
-      CHECK(BF_WriteBlock(sfd, current_bucket), BF_WRITE_BLOCK_EMSG, return -1);
-      CHECK(BF_ReadBlock(sfd, bucket_info.overflow_bucket, &block), BF_READ_BLOCK_EMSG, return -1);
-      current_bucket = bucket_info.overflow_bucket;
-      initialize_block(block);
-      CHECK(BF_WriteBlock(sfd, bucket_info.overflow_bucket), BF_WRITE_BLOCK_EMSG, return -1);
-      bucket_info = *(bucket_info_t *) block;
-      break;
+  void *block;
+  bucket_info_t *bucket_info;
+  while (1U) {
+    CHECK(ht_read_block(metrics, sfd, current_bucket, &block), BF_READ_BLOCK_EMSG, return -1);
+    bucket_info = block;
+    size_t offset = sizeof(bucket_info_t);
+    for (unsigned int i = 0U; i != bucket_info->record_n; ++i) {
+      sht_entry_t entry;
+      if (sht_entry_parse(block, offset, (size_t) bucket_info->next_record, &entry) < 0) return -1;
+      HT_METRIC_ADD(metrics, compares, 1U);
+      if (entry.key_len == key_len && !memcmp(entry.key, hash_attribute, key_len)) {
+        return append_id(metrics, sfd, current_bucket, block, &entry, id);
+      }
+      HT_METRIC_ADD(metrics, hashCollisions, 1U);
+      offset = entry.end;
     }
+    if (room_block == -1 && bucket_info->free_space >= (int) entry_size) room_block = current_bucket;
+    if (bucket_info->overflow_bucket == -1) break;
+    current_bucket = bucket_info->overflow_bucket;
+    HT_METRIC_ADD(metrics, chainHops, 1U);
   }
-  size_t attribute_length = strlen(hash_attribute);
-  SHT_insert_info *insert_info = (SHT_insert_info *) (block + bucket_info.next_record);
-  insert_info->block_id = sRecord.blockId;
-  memcpy(&insert_info->value, hash_attribute, attribute_length);
-  // That's the C we love!
-  *(char *) (void *) (&insert_info->value + attribute_length) = '\0';
-
-  size_t insert_info_size = offsetof(SHT_insert_info, value) + attribute_length + 1;
-  bucket_info.next_record += insert_info_size;
-  bucket_info.free_space -= insert_info_size;
-  ++bucket_info.record_n;
-  memcpy(block, &bucket_info, sizeof(bucket_info_t));
-  CHECK(BF_WriteBlock(sfd, current_bucket), BF_WRITE_BLOCK_EMSG, return -1);
-  return current_bucket;
+  char encoded[SHT_ENTRY_MAX_SIZE];
+  (void) encode_entry(encoded, &new_entry, NULL, 0U, first, sht_varint_size(first));
+  return place_entry(metrics, sfd, (room_block != -1) ? room_block : current_bucket, encoded, entry_size);
+}
+
+int SHT_SecondaryInsertRecord(SHT_info *header_info, const SecondaryRecord *sRecord) {
+  HT_TRACE_START(trace_start);
+  HT_METRIC_TIMER_START(timer);
+  int res = secondary_insert_entry(header_info, sRecord);
+  HT_METRIC_TIMER_STOP(header_info->metrics, HT_OP_INSERT, timer);
+  if (ht_tracer != NULL) {
+    ht_trace_begin(SHT_TRACE_INSERT, trace_start, header_info->fileDesc, res);
+    ht_trace_put_record(&sRecord->record);
+    ht_trace_put_int(sRecord->blockId);
+    ht_trace_end();
+  }
+  return res;
+}
+
+int SHT_SecondaryInsertEntry(SHT_info header_info, SecondaryRecord sRecord) {
+  return SHT_SecondaryInsertRecord(&header_info, &sRecord);
+}
+
+/* The primary blocks a lookup has already printed, a bit per block id, grown on demand */
+typedef struct {
+  uint8_t *bits;
+  size_t size;
+} visited_blocks_t;
+
+/* Marks a block, returns 1 when it was not marked yet, 0 when it was and -1 on failure */
+static int visit_block(visited_blocks_t *visited, int block_id) {
+  if (block_id < 0) return -1;
+  size_t byte = (size_t) block_id / 8U;
+  if (byte >= visited->size) {
+    size_t size = 2U * byte + 1U;
+    uint8_t *bits = realloc(visited->bits, size);
+    if (bits == NULL) return -1;
+    memset(bits + visited->size, 0, size - visited->size);
+    visited->bits = bits;
+    visited->size = size;
+  }
+  uint8_t mask = (uint8_t) (1U << ((unsigned int) block_id % 8U));
+  if (visited->bits[byte] & mask) return 0;
+  visited->bits[byte] |= mask;
+  return 1;
 }
 
-static int HT_PrintAllEntriesFromSHT(const HT_info *ht_info, int bucket, char *value) {
+/* Prints the matches of the chain from bucket on, stopping at the first block an earlier chain already printed */
+static int HT_PrintAllEntriesFromSHT(const HT_info *ht_info, HT_metrics *metrics, int bucket, char *value,
+                                     visited_blocks_t *visited) {
   int index_descriptor = ht_info->fileDesc;
   int blocks_read = 0;
   size_t value_len = strlen(value);
   size_t field_offset = get_attribute_offset(ht_info->attrName, ht_info->attrLength);
-  do {
+  while (bucket != -1) {
+    int fresh = visit_block(visited, bucket);
+    if (fresh < 0) return -1;
+    if (!fresh) break;
     void *block;
-    CHECK(BF_ReadBlock(index_descriptor, bucket, &block), BF_READ_BLOCK_EMSG, return -1);
-    bucket_info_t bucket_info = *(bucket_info_t *) block;
-    block += sizeof(bucket_info_t);
-    for (size_t i = 0U; i != bucket_info.record_n; ++i, block += sizeof(Record)) {
-      char *key = (char *) (block + field_offset);
-      if (!strcmp(key, value))
-        print_record(block);
+    CHECK(ht_read_block(metrics, index_descriptor, bucket, &block), BF_READ_BLOCK_EMSG, return -1);
+    const bucket_info_t *bucket_info = block;
+    // The kernel finds the records the value is a prefix of, only the exact matches get printed
+    for (unsigned int i = ht_info->kernel->find(block, 0U, value, value_len); i != bucket_info->record_n;
+         i = ht_info->kernel->find(block, i + 1U, value, value_len)) {
+      size_t key_len;
+      (void) block_record_field(block, ht_info->flags, i, field_offset, &key_len);
+      if (key_len == value_len) {
+        Record scratch;
+        print_record(block_record(block, ht_info->flags, i, &scratch));
+      }
     }
-    bucket = bucket_info.overflow_bucket;
+    HT_METRIC_ADD(metrics, compares, bucket_info->record_n);
+    bucket = bucket_info->overflow_bucket;
     ++blocks_read;
-  } while (bucket != -1);
+    if (bucket != -1) HT_METRIC_ADD(metrics, chainHops, 1U);
+  }
   return blocks_read;
 }
 
-int SHT_SecondaryGetAllEntries(SHT_info sht_info, HT_info ht_info, void *value) {
-  int index_descriptor = sht_info.fileDesc;
-  int bucket = (int) hash_function('c', sht_info.numBuckets, value);
+static int compare_ids(const void *a, const void *b) {
+  int32_t lhs = *(const int32_t *) a;
+  int32_t rhs = *(const int32_t *) b;
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+/* Appends the inline ids and then the ids of every posting block of an entry */
+static int collect_ids(HT_metrics *metrics, int sfd, const void *block, const sht_entry_t *entry,
+                       int32_t **ids, size_t *n, int *blocks_read) {
+  *ids = __MALLOC(entry->count, int32_t);
+  if (*ids == NULL && entry->count != 0U) return -1;
+  if (sht_decode_ids((const uint8_t *) block + entry->list, entry->list_bytes, entry->count, *ids) < 0) return -1;
+  *n = entry->count;
+  for (int postings = entry->postings; postings != -1;) {
+    void *posting_block;
+    CHECK(ht_read_block(metrics, sfd, postings, &posting_block), BF_READ_BLOCK_EMSG, return -1);
+    ++*blocks_read;
+    const bucket_info_t *bucket_info = posting_block;
+    if (!(bucket_info->flags & BLOCK_POSTINGS) || bucket_info->next_record > BLOCK_SIZE) return -1;
+    int32_t *grown = realloc(*ids, (*n + bucket_info->record_n) * sizeof(int32_t));
+    if (grown == NULL) return -1;
+    *ids = grown;
+    if (sht_decode_ids((const uint8_t *) posting_block + SHT_POSTINGS_START,
+                       (size_t) bucket_info->next_record - SHT_POSTINGS_START, bucket_info->record_n,
+                       *ids + *n) < 0) {
+      return -1;
+    }
+    *n += bucket_info->record_n;
+    postings = bucket_info->overflow_bucket;
+  }
+  return 0;
+}
+
+/**
+ * find_secondary_key - Looks a key up in its SHT chain. Every distinct key is stored once per chain,
+ * so the search ends at the first match
+ * @param block Receives the block of the entry, valid until the next block read
+ * @param entry Receives the entry
+ * @param blocks_read Gets the blocks read added to it
+ * @return Returns 1 when the key was found, 0 when it was not and -1 on failure
+ */
+static int find_secondary_key(const SHT_info *sht_info, const char *value, size_t value_len, void **block,
+                              sht_entry_t *entry, int *blocks_read) {
+  HT_metrics *metrics = sht_info->metrics;
+  int bucket = (int) hash_function('c', sht_info->numBuckets, value);
+  while (bucket != -1) {
+    CHECK(ht_read_block(metrics, sht_info->fileDesc, bucket, block), BF_READ_BLOCK_EMSG, return -1);
+    ++*blocks_read;
+    const bucket_info_t *bucket_info = *block;
+    size_t offset = sizeof(bucket_info_t);
+    for (unsigned int i = 0U; i != bucket_info->record_n; ++i) {
+      if (sht_entry_parse(*block, offset, (size_t) bucket_info->next_record, entry) < 0) return -1;
+      HT_METRIC_ADD(metrics, compares, 1U);
+      if (entry->key_len == value_len && !memcmp(entry->key, value, value_len)) return 1;
+      HT_METRIC_ADD(metrics, hashCollisions, 1U);
+      offset = entry->end;
+    }
+    bucket = bucket_info->overflow_bucket;
+    if (bucket != -1) HT_METRIC_ADD(metrics, chainHops, 1U);
+  }
+  return 0;
+}
+
+static int secondary_get_all_entries(SHT_info sht_info, HT_info ht_info, void *value) {
+  HT_metrics *metrics = sht_info.metrics;
   int blocks_read = 0;
   ht_info.attrType = 'c';
   ht_info.attrName = sht_info.attrName;
-  do {
-    void *block;
-    CHECK(BF_ReadBlock(index_descriptor, bucket, &block), BF_READ_BLOCK_EMSG, return -1);
-    bucket_info_t bucket_info = *(bucket_info_t *) block;
-    block += sizeof(bucket_info_t);
-    for (size_t i = 0U; i != bucket_info.record_n; ++i) {
-      SHT_insert_info *insert_info = (SHT_insert_info *) block;
-      char *key = (char *) &insert_info->value;
-      if (!strcmp(key, value)) {
-        blocks_read += HT_PrintAllEntriesFromSHT(&ht_info, insert_info->block_id, value);
-      }
-      block += offsetof(SHT_insert_info, value) + strlen(key) + 1;
-    }
-    bucket = bucket_info.overflow_bucket;
-    ++blocks_read;
-  } while (bucket != -1);
-  return blocks_read;
+  ht_info.attrLength = sht_info.attrLength;
+  ht_info.kernel = ht_select_key_kernel('c', sht_info.attrName, sht_info.attrLength, ht_info.flags);
+  if (ht_info.kernel == NULL) return -1;
+  int32_t *ids = NULL;
+  size_t n = 0U;
+  void *block;
+  sht_entry_t entry;
+  int res = find_secondary_key(&sht_info, value, strlen(value), &block, &entry, &blocks_read);
+  if (res < 0) return -1;
+  res = (res == 1) ? collect_ids(metrics, sht_info.fileDesc, block, &entry, &ids, &n, &blocks_read) : 0;
+  // Each primary block gets read once, however many ids or earlier chains lead to it, and the ids in file order
+  if (res == 0 && n != 0U) qsort(ids, n, sizeof(int32_t), compare_ids);
+  visited_blocks_t visited = {NULL, 0U};
+  for (size_t i = 0U; res == 0 && i != n; ++i) {
+    int primary_blocks = HT_PrintAllEntriesFromSHT(&ht_info, metrics, ids[i], value, &visited);
+    if (primary_blocks < 0) res = -1;
+    else blocks_read += primary_blocks;
+  }
+  free(visited.bits);
+  free(ids);
+  return (res < 0) ? -1 : blocks_read;
+}
+
+int SHT_SecondaryGetAllEntries(SHT_info sht_info, HT_info ht_info, void *value) {
+  HT_TRACE_START(trace_start);
+  HT_METRIC_TIMER_START(timer);
+  int res = secondary_get_all_entries(sht_info, ht_info, value);
+  HT_METRIC_TIMER_STOP(sht_info.metrics, HT_OP_GET, timer);
+  if (ht_tracer != NULL) {
+    ht_trace_begin(SHT_TRACE_GET, trace_start, sht_info.fileDesc, res);
+    ht_trace_put_int(ht_info.fileDesc);
+    ht_trace_put_key('c', value);
+    ht_trace_end();
+  }
+  return res;
 }
 
-int HashStatistics(char *filename) {
-  int fd;
-  CHECK(fd = BF_OpenFile(filename), BF_OPEN_EMSG, return -1);
+int SHT_Count(SHT_info *header_info, const char *value) {
+  HT_TRACE_START(trace_start);
+  HT_METRIC_TIMER_START(timer);
   void *block;
-  CHECK(BF_ReadBlock(fd, 0, &block), BF_READ_BLOCK_EMSG, return -1);
-  size_t ht_file_id_len = strlen(HT_FILE_IDENTIFIER);
-  size_t sht_file_id_len = strlen(SHT_FILE_IDENTIFIER);
-  int buckets;
-  if (!memcmp(block, HT_FILE_IDENTIFIER, ht_file_id_len)) {
-    block += ht_file_id_len;
-    buckets = (int) ((HT_info *) block)->numBuckets;
-  } else if (!memcmp(block, SHT_FILE_IDENTIFIER, sht_file_id_len)) {
-    block += sht_file_id_len;
-    buckets = (int) ((SHT_info *) block)->numBuckets;
-  } else return -1;
-  int total_blocks;
-  CHECK(total_blocks = BF_GetBlockCounter(fd), BF_GET_BLOCK_COUNTER_EMSG, return -1);
-  int total_records = 0;
-  int *bucket_overlfow_blocks = __MALLOC(buckets, int);
-  memset(bucket_overlfow_blocks, 0, buckets * sizeof(int));
-  int min_records = BLOCK_SIZE / sizeof(Record) + 1;
-  int max_records = 0;
-  int buckets_with_overflow_blocks = 0U;
-  for (size_t i = 1U; i <= buckets; ++i) {
-    CHECK(BF_ReadBlock(fd, (int) i, &block), BF_READ_BLOCK_EMSG, {
-      free(bucket_overlfow_blocks);
-      return -1;
-    });
-    bucket_info_t bucket_info = *(bucket_info_t *) block;
-    if (bucket_info.record_n > max_records) max_records = bucket_info.record_n;
-    if (bucket_info.record_n < min_records) min_records = bucket_info.record_n;
-    total_records += bucket_info.record_n;
-    void *overflow_block;
-    if (bucket_info.overflow_bucket != -1) ++buckets_with_overflow_blocks;
-    while (bucket_info.overflow_bucket != -1) {
-      CHECK(BF_ReadBlock(fd, bucket_info.overflow_bucket, &overflow_block), BF_READ_BLOCK_EMSG, {
-        free(bucket_overlfow_blocks);
-        return -1;
-      });
-      ++bucket_overlfow_blocks[i - 1U];
-      bucket_info = *(bucket_info_t *) overflow_block;
-    }
+  sht_entry_t entry;
+  int blocks_read = 0;
+  int res = find_secondary_key(header_info, value, strlen(value), &block, &entry, &blocks_read);
+  if (res == 1) res = (entry.records > INT_MAX) ? INT_MAX : (int) entry.records;
+  HT_METRIC_TIMER_STOP(header_info->metrics, HT_OP_GET, timer);
+  if (ht_tracer != NULL) {
+    ht_trace_begin(SHT_TRACE_COUNT, trace_start, header_info->fileDesc, res);
+    ht_trace_put_key('c', value);
+    ht_trace_end();
   }
-  printf("\n================================= HASH STATISTICS =================================\n");
-  printf("\tFile Blocks: %d\n"
-         "\tMinimum Records in a bucket: %d\n"
-         "\tMaximum Records in a bucket: %d\n"
-         "\tAverage Records in a bucket: %.2f\n"
-         "\tAverage number of Blocks per bucket: %.2f\n"
-         "\tNumber of buckets with overflow blocks: %d\n",
-         total_blocks, min_records, max_records,
-         (float) total_records / (float) buckets,
-         (float) total_blocks / (float) buckets,
-         buckets_with_overflow_blocks);
-  if (buckets_with_overflow_blocks) {
-    printf("Overflow Blocks in buckets:\n");
-    for (size_t i = 0U; i != buckets_with_overflow_blocks; ++i) {
-      if (bucket_overlfow_blocks[i]) {
-        printf("\tBucket[%zu]: %d\n", i + 1, bucket_overlfow_blocks[i]);
-      }
+  return res;
+}
+
+int SHT_Exists(SHT_info *header_info, const char *value) {
+  int count = SHT_Count(header_info, value);
+  return (count < 0) ? -1 : (count != 0);
+}
+
+int SHT_GroupCount(SHT_info *header_info, SHT_group_callback callback, void *context) {
+  int sfd = header_info->fileDesc;
+  int block_n;
+  CHECK(block_n = BF_GetBlockCounter(sfd), BF_GET_BLOCK_COUNTER_EMSG, return -1);
+  int keys = 0;
+  // The callback is free to use the BF layer, which may evict our buffer, so each block is copied out first
+  char block[BLOCK_SIZE];
+  // Every key entry of a bucket or overflow block is a distinct key, so file order visits each key once
+  for (int block_id = 1; block_id < block_n; ++block_id) {
+    void *stored;
+    CHECK(ht_read_block(header_info->metrics, sfd, block_id, &stored), BF_READ_BLOCK_EMSG, return -1);
+    memcpy(block, stored, BLOCK_SIZE);
+    const bucket_info_t *bucket_info = (const bucket_info_t *) block;
+    if (bucket_info->flags & BLOCK_POSTINGS) continue;
+    size_t offset = sizeof(bucket_info_t);
+    for (unsigned int i = 0U; i != bucket_info->record_n; ++i) {
+      sht_entry_t entry;
+      if (sht_entry_parse(block, offset, (size_t) bucket_info->next_record, &entry) < 0) return -1;
+      char key[UINT8_MAX + 1U];
+      memcpy(key, entry.key, entry.key_len);
+      key[entry.key_len] = '\0';
+      ++keys;
+      if (callback(key, entry.records, context)) return keys;
+      offset = entry.end;
     }
   }
-  free(bucket_overlfow_blocks);
+  return keys;
+}
+
+static int copy_metrics(const HT_metrics *metrics, HT_metrics *snapshot) {
+  if (metrics == NULL) return -1;
+  *snapshot = *metrics;
   return 0;
-}
\ No newline at end of file
+}
+
+int HT_GetMetrics(const HT_info *header_info, HT_metrics *metrics) {
+  return copy_metrics(header_info->metrics, metrics);
+}
+
+int SHT_GetMetrics(const SHT_info *header_info, HT_metrics *metrics) {
+  return copy_metrics(header_info->metrics, metrics);
+}
+
+void HT_SetChecksumVerification(int enabled) {
+  ht_verify_checksums = enabled;
+}
@@ -0,0 +1,322 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <memory.h>
+#include "../Include/HTS.h"
+#include "../Include/BF.h"
+#include "../Include/direct_io.h"
+#include "../Include/macros.h"
+
+#define BF_CREATE_EMSG "Error while creating file"
+#define BF_OPEN_EMSG "Error while opening file"
+#define BF_ALLOCATE_EMSG "Error while allocating block"
+#define BF_READ_BLOCK_EMSG "Error while reading block"
+#define BF_WRITE_BLOCK_EMSG "Error while writing block"
+#define BF_CLOSE_EMSG "Error while closing file"
+
+#define SHARD_SUFFIX_LEN 48U
+#define RESHARD_SUFFIX ".reshard"
+
+typedef struct {
+  HT_info **shards;
+  size_t shard_n;
+  int failed;
+} reshard_context_t;
+
+/*
+ * The shard is picked with a hash that is unrelated to the bucket hash of HT.c.
+ * Routing with id % shard_n would leave every shard using only a fraction of its buckets.
+ */
+static __INLINE inline
+size_t shard_of(char attribute_type, size_t shard_n, const void *restrict value) {
+  uint32_t hash_value;
+  if (attribute_type == 'c') {
+    hash_value = 2166136261U;
+    for (const unsigned char *c = value; *c; ++c) {
+      hash_value = (hash_value ^ *c) * 16777619U;
+    }
+  } else {
+    hash_value = (uint32_t) (*(const int *) value) * 2654435761U;
+    hash_value ^= hash_value >> 16;
+  }
+  return hash_value % shard_n;
+}
+
+static const void *record_key(const HT_info *info, const Record *record) {
+  if (info->attrType == 'i') return &record->id;
+  if (!strncmp(info->attrName, "name", info->attrLength)) return record->name;
+  if (!strncmp(info->attrName, "surname", info->attrLength)) return record->surname;
+  if (!strncmp(info->attrName, "address", info->attrLength)) return record->address;
+  return NULL;
+}
+
+/* The shards of generation 0 are <table>.<shard>, those of a later generation <table>.g<generation>.<shard> */
+static char *shard_file_name(const char *table_name, unsigned int generation, size_t shard) {
+  size_t len = strlen(table_name) + SHARD_SUFFIX_LEN;
+  char *file_name = __MALLOC(len, char);
+  if (file_name == NULL) return NULL;
+  if (generation == 0U) snprintf(file_name, len, "%s.%zu", table_name, shard);
+  else snprintf(file_name, len, "%s.g%u.%zu", table_name, generation, shard);
+  return file_name;
+}
+
+static int write_table_file(char *file_name, size_t shard_n, unsigned int generation) {
+  int fd;
+  CHECK(BF_CreateFile(file_name), BF_CREATE_EMSG, return -1);
+  CHECK(fd = BF_OpenFile(file_name), BF_OPEN_EMSG, return -1);
+  void *block;
+  CHECK(BF_AllocateBlock(fd), BF_ALLOCATE_EMSG, return -1);
+  CHECK(BF_ReadBlock(fd, 0, &block), BF_READ_BLOCK_EMSG, return -1);
+  size_t identifier_len = strlen(HTS_FILE_IDENTIFIER);
+  memcpy(block, HTS_FILE_IDENTIFIER, identifier_len);
+  memcpy(block + identifier_len, &shard_n, sizeof(size_t));
+  memcpy(block + identifier_len + sizeof(size_t), &generation, sizeof(unsigned int));
+  CHECK(BF_WriteBlock(fd, 0), BF_WRITE_BLOCK_EMSG, return -1);
+  CHECK(BF_CloseFile(fd), BF_CLOSE_EMSG, return -1);
+  return 0;
+}
+
+/*
+ * The table file is read around the BF layer: BF keeps blocks cached by file name,
+ * so it would go on handing out the table file that a reshard renamed over.
+ */
+static int read_table_file(const char *table_name, size_t *shard_n, unsigned int *generation) {
+  int total_blocks;
+  ht_direct_reader_t *reader = ht_direct_open(table_name, &total_blocks);
+  if (reader == NULL) return -1;
+  const char *block;
+  size_t identifier_len = strlen(HTS_FILE_IDENTIFIER);
+  int valid = ht_direct_next(reader, &block) == 1 && !memcmp(block, HTS_FILE_IDENTIFIER, identifier_len);
+  if (valid) {
+    memcpy(shard_n, block + identifier_len, sizeof(size_t));
+    memcpy(generation, block + identifier_len + sizeof(size_t), sizeof(unsigned int));
+  }
+  ht_direct_close(reader);
+  return (valid && *shard_n != 0U && *shard_n <= HTS_MAX_SHARDS) ? 0 : -1;
+}
+
+static void remove_shards(const char *table_name, unsigned int generation, size_t shard_n) {
+  for (size_t i = 0U; i != shard_n; ++i) {
+    char *file_name = shard_file_name(table_name, generation, i);
+    if (file_name != NULL) remove(file_name);
+    free(file_name);
+  }
+}
+
+/* Creates every shard of a generation, or none of them */
+static int create_shards(const char *table_name, unsigned int generation, char attribute_type,
+                         char *attribute_name, int attribute_length, int bucket_n, size_t shard_n) {
+  for (size_t i = 0U; i != shard_n; ++i) {
+    char *file_name = shard_file_name(table_name, generation, i);
+    int res = (file_name != NULL) ? HT_CreateIndex(file_name, attribute_type, attribute_name, attribute_length,
+                                                   bucket_n) : -1;
+    free(file_name);
+    if (res < 0) {
+      remove_shards(table_name, generation, i + 1U);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static void close_shards(HT_info **shards, size_t shard_n) {
+  for (size_t i = 0U; i != shard_n; ++i) {
+    if (shards[i] != NULL && HT_CloseIndex(shards[i]) < 0) {
+      fprintf(stderr, "Could not close shard %zu\n", i);
+    }
+  }
+}
+
+static HT_info **open_shards(const char *table_name, unsigned int generation, size_t shard_n) {
+  HT_info **shards = calloc(shard_n, sizeof(HT_info *));
+  if (shards == NULL) return NULL;
+  for (size_t i = 0U; i != shard_n; ++i) {
+    char *file_name = shard_file_name(table_name, generation, i);
+    if (file_name != NULL) shards[i] = HT_OpenIndex(file_name);
+    free(file_name);
+    if (shards[i] == NULL) {
+      close_shards(shards, i);
+      free(shards);
+      return NULL;
+    }
+  }
+  return shards;
+}
+
+int HTS_Create(char *table_name, char attribute_type, char *attribute_name,
+               int attribute_length, int bucket_n, size_t shard_n) {
+  if (shard_n == 0U || shard_n > HTS_MAX_SHARDS) return -1;
+  if (write_table_file(table_name, shard_n, 0U) < 0 ||
+      create_shards(table_name, 0U, attribute_type, attribute_name, attribute_length, bucket_n, shard_n) < 0) {
+    remove(table_name);
+    return -1;
+  }
+  return 0;
+}
+
+HTS_info *HTS_Open(char *table_name) {
+  size_t shard_n;
+  unsigned int generation;
+  if (read_table_file(table_name, &shard_n, &generation) < 0) return NULL;
+  HTS_info *table_info = __MALLOC(1, HTS_info);
+  if (table_info == NULL) return NULL;
+  table_info->shardN = shard_n;
+  table_info->shards = open_shards(table_name, generation, shard_n);
+  if (table_info->shards == NULL) {
+    free(table_info);
+    return NULL;
+  }
+  return table_info;
+}
+
+int HTS_Close(HTS_info *table_info) {
+  if (table_info == NULL) return -1;
+  int res = 0;
+  for (size_t i = 0U; i != table_info->shardN; ++i) {
+    if (HT_CloseIndex(table_info->shards[i]) < 0) res = -1;
+  }
+  free(table_info->shards);
+  free(table_info);
+  return res;
+}
+
+int HTS_Insert(HTS_info *table_info, Record record) {
+  HT_info *any_shard = table_info->shards[0];
+  const void *key = record_key(any_shard, &record);
+  if (key == NULL) return -1;
+  size_t shard = shard_of(any_shard->attrType, table_info->shardN, key);
+  return (HT_InsertEntry(*table_info->shards[shard], record) < 0) ? -1 : (int) shard;
+}
+
+int HTS_Delete(HTS_info *table_info, void *value) {
+  size_t shard = shard_of(table_info->shards[0]->attrType, table_info->shardN, value);
+  return HT_DeleteEntry(*table_info->shards[shard], value);
+}
+
+int HTS_Get(HTS_info *table_info, void *value) {
+  size_t shard = shard_of(table_info->shards[0]->attrType, table_info->shardN, value);
+  return HT_GetAllEntries(*table_info->shards[shard], value);
+}
+
+int HTS_GetMany(HTS_info *table_info, const void *keys, size_t n, HT_result_set *results) {
+  memset(results, 0, n * sizeof(HT_result_set));
+  if (n == 0U) return 0;
+  if (keys == NULL) return -1;
+  char attribute_type = table_info->shards[0]->attrType;
+  size_t key_size = (attribute_type == 'c') ? sizeof(char *) : sizeof(int);
+  size_t shard_n = table_info->shardN;
+
+  // Counting sort of the keys by shard, so that every shard gets one contiguous batch.
+  size_t shard_start[HTS_MAX_SHARDS + 1U] = {0};
+  size_t *key_shard = __MALLOC(n, size_t);
+  size_t *order = __MALLOC(n, size_t);
+  char *shard_keys = malloc(n * key_size);
+  HT_result_set *shard_results = __MALLOC(n, HT_result_set);
+  if (key_shard == NULL || order == NULL || shard_keys == NULL || shard_results == NULL) goto __GET_MANY_ERROR;
+  for (size_t i = 0U; i != n; ++i) {
+    const void *key = (const char *) keys + i * key_size;
+    key_shard[i] = shard_of(attribute_type, shard_n, (attribute_type == 'c') ? *(char *const *) key : key);
+    ++shard_start[key_shard[i] + 1U];
+  }
+  for (size_t s = 0U; s != shard_n; ++s) shard_start[s + 1U] += shard_start[s];
+  size_t shard_fill[HTS_MAX_SHARDS];
+  memcpy(shard_fill, shard_start, sizeof(shard_fill));
+  for (size_t i = 0U; i != n; ++i) {
+    size_t position = shard_fill[key_shard[i]]++;
+    order[position] = i;
+    memcpy(shard_keys + position * key_size, (const char *) keys + i * key_size, key_size);
+  }
+
+  int blocks_read = 0;
+  for (size_t s = 0U; s != shard_n; ++s) {
+    size_t batch_n = shard_start[s + 1U] - shard_start[s];
+    if (batch_n == 0U) continue;
+    int res = HT_GetMany(table_info->shards[s], shard_keys + shard_start[s] * key_size, batch_n,
+                         shard_results + shard_start[s]);
+    if (res < 0) {
+      HT_FreeResults(shard_results, shard_start[s]);
+      goto __GET_MANY_ERROR;
+    }
+    blocks_read += res;
+  }
+  for (size_t i = 0U; i != n; ++i) results[order[i]] = shard_results[i];
+
+  free(key_shard);
+  free(order);
+  free(shard_keys);
+  free(shard_results);
+  return blocks_read;
+
+__GET_MANY_ERROR:
+  free(key_shard);
+  free(order);
+  free(shard_keys);
+  free(shard_results);
+  return -1;
+}
+
+static int reshard_record(const Record *record, int block_id, void *context) {
+  (void) block_id;
+  reshard_context_t *reshard = context;
+  HT_info *any_shard = reshard->shards[0];
+  const void *key = record_key(any_shard, record);
+  size_t shard = shard_of(any_shard->attrType, reshard->shard_n, key);
+  if (HT_InsertEntry(*reshard->shards[shard], *record) < 0) {
+    reshard->failed = 1;
+    return 1;
+  }
+  return 0;
+}
+
+int HTS_Reshard(char *table_name, size_t new_shard_n) {
+  if (new_shard_n == 0U || new_shard_n > HTS_MAX_SHARDS) return -1;
+  size_t old_shard_n;
+  unsigned int old_generation;
+  if (read_table_file(table_name, &old_shard_n, &old_generation) < 0) return -1;
+  unsigned int generation = old_generation + 1U;
+  char *switch_name = __MALLOC(strlen(table_name) + sizeof(RESHARD_SUFFIX), char);
+  if (switch_name == NULL) return -1;
+  sprintf(switch_name, "%s%s", table_name, RESHARD_SUFFIX);
+
+  HT_info **old_shard = open_shards(table_name, old_generation, 1U);
+  if (old_shard == NULL) {
+    free(switch_name);
+    return -1;
+  }
+  int res = create_shards(table_name, generation, old_shard[0]->attrType, old_shard[0]->attrName,
+                          (int) old_shard[0]->attrLength, (int) old_shard[0]->numBuckets, new_shard_n);
+  close_shards(old_shard, 1U);
+  free(old_shard);
+  if (res < 0) {
+    free(switch_name);
+    return -1;
+  }
+
+  reshard_context_t reshard = {.shard_n = new_shard_n, .failed = 0};
+  reshard.shards = open_shards(table_name, generation, new_shard_n);
+  if (reshard.shards == NULL) goto __RESHARD_FAILED;
+  // Old shards are opened one at a time, to stay clear of the BF open file limit.
+  for (size_t i = 0U; i != old_shard_n && !reshard.failed; ++i) {
+    char *file_name = shard_file_name(table_name, old_generation, i);
+    HT_info *shard = (file_name != NULL) ? HT_OpenIndex(file_name) : NULL;
+    free(file_name);
+    if (shard == NULL || HT_Scan(shard, reshard_record, &reshard) < 0) reshard.failed = 1;
+    if (shard != NULL && HT_CloseIndex(shard) < 0) reshard.failed = 1;
+  }
+  close_shards(reshard.shards, new_shard_n);
+  free(reshard.shards);
+  if (reshard.failed) goto __RESHARD_FAILED;
+
+  // The new generation is complete. Renaming the new table file over the old one switches to it in one step
+  if (write_table_file(switch_name, new_shard_n, generation) < 0 || rename(switch_name, table_name) < 0) {
+    goto __RESHARD_FAILED;
+  }
+  remove_shards(table_name, old_generation, old_shard_n);
+  free(switch_name);
+  return 0;
+
+__RESHARD_FAILED:
+  remove_shards(table_name, generation, new_shard_n);
+  remove(switch_name);
+  free(switch_name);
+  return -1;
+}
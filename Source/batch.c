@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include "../Include/batch.h"
+#include "../Include/block_io.h"
+#include "../Include/block_format.h"
+#include "../Include/macros.h"
+
+#define BF_READ_BLOCK_EMSG "Error while reading block"
+#define BF_GET_BLOCK_COUNTER_EMSG "Error while getting block counter"
+
+int HT_AllocBatch(HT_batch *batch, size_t capacity) {
+  memset(batch, 0, sizeof(HT_batch));
+  if (capacity == 0U || capacity > UINT32_MAX) return -1;
+  batch->capacity = capacity;
+  batch->ids = __MALLOC(capacity, int);
+  batch->names = malloc(capacity * HT_BATCH_NAME_SIZE);
+  batch->surnames = malloc(capacity * HT_BATCH_SURNAME_SIZE);
+  batch->addresses = malloc(capacity * HT_BATCH_ADDRESS_SIZE);
+  batch->blockIds = __MALLOC(capacity, int);
+  batch->keyIndexes = __MALLOC(capacity, uint32_t);
+  batch->selection = __MALLOC(capacity, uint32_t);
+  if (batch->ids == NULL || batch->names == NULL || batch->surnames == NULL || batch->addresses == NULL ||
+      batch->blockIds == NULL || batch->keyIndexes == NULL || batch->selection == NULL) {
+    HT_FreeBatch(batch);
+    return -1;
+  }
+  return 0;
+}
+
+void HT_FreeBatch(HT_batch *batch) {
+  if (batch == NULL) return;
+  free(batch->ids);
+  free(batch->names);
+  free(batch->surnames);
+  free(batch->addresses);
+  free(batch->blockIds);
+  free(batch->keyIndexes);
+  free(batch->selection);
+  memset(batch, 0, sizeof(HT_batch));
+}
+
+void ht_batch_append(HT_batch *batch, const void *block, unsigned int flags, unsigned int from, unsigned int n,
+                     int block_id) {
+  size_t row = batch->count;
+  // Stored fixed size entries are zero padded, so every column is a plain copy of its field
+  if (!(flags & HT_FLAG_COMPACT)) {
+    const Record *records = fixed_record(block, from);
+    for (unsigned int i = 0U; i != n; ++i) batch->ids[row + i] = records[i].id;
+    for (unsigned int i = 0U; i != n; ++i) memcpy(batch->names[row + i], records[i].name, HT_BATCH_NAME_SIZE);
+    for (unsigned int i = 0U; i != n; ++i) {
+      memcpy(batch->surnames[row + i], records[i].surname, HT_BATCH_SURNAME_SIZE);
+    }
+    for (unsigned int i = 0U; i != n; ++i) {
+      memcpy(batch->addresses[row + i], records[i].address, HT_BATCH_ADDRESS_SIZE);
+    }
+  } else {
+    char *columns[COMPACT_FIELD_N] = {batch->names[row], batch->surnames[row], batch->addresses[row]};
+    for (unsigned int i = 0U; i != n; ++i) {
+      const unsigned char *p = (const unsigned char *) block + *compact_slot(block, from + i);
+      memcpy(&batch->ids[row + i], p, sizeof(int));
+      p += sizeof(int);
+      for (unsigned int f = 0U; f != COMPACT_FIELD_N; ++f) {
+        char *cell = columns[f] + i * record_fields[f].size;
+        size_t len = *p++;
+        memcpy(cell, p, len);
+        memset(cell + len, 0, record_fields[f].size - len);
+        p += len;
+      }
+    }
+  }
+  for (unsigned int i = 0U; i != n; ++i) batch->blockIds[row + i] = block_id;
+  batch->count += n;
+}
+
+int ht_batch_flush(HT_batch *batch, HT_batch_callback callback, void *context) {
+  for (size_t row = 0U; row != batch->count; ++row) batch->selection[row] = (uint32_t) row;
+  batch->selected = batch->count;
+  int res = callback(batch, context);
+  batch->count = 0U;
+  batch->selected = 0U;
+  return res;
+}
+
+int HT_ScanBatches(HT_info *header_info, HT_batch *batch, HT_batch_callback callback, void *context) {
+  int index_descriptor = header_info->fileDesc;
+  int total_blocks;
+  CHECK(total_blocks = BF_GetBlockCounter(index_descriptor), BF_GET_BLOCK_COUNTER_EMSG, return -1);
+  if (batch->capacity == 0U) return -1;
+  // The callback is free to use the BF layer, which may evict our buffer, so each block is copied out first
+  char block_copy[HT_EXPANDED_BLOCK_SIZE];
+  int blocks_read = 0;
+  batch->count = 0U;
+  for (int block_id = 1; block_id < total_blocks; ++block_id) {
+    void *block;
+    CHECK(ht_read_block(header_info->metrics, index_descriptor, block_id, &block), BF_READ_BLOCK_EMSG, return -1);
+    const bucket_info_t *bucket_info = block;
+    memcpy(block_copy, block, (bucket_info->flags & BLOCK_COMPRESSED) ? (size_t) bucket_info->next_record : BLOCK_SIZE);
+    ++blocks_read;
+    unsigned int record_n = ((const bucket_info_t *) block_copy)->record_n;
+    for (unsigned int i = 0U; i != record_n;) {
+      size_t room = batch->capacity - batch->count;
+      unsigned int n = (record_n - i < room) ? record_n - i : (unsigned int) room;
+      ht_batch_append(batch, block_copy, header_info->flags, i, n, block_id);
+      i += n;
+      if (batch->count == batch->capacity && ht_batch_flush(batch, callback, context)) return blocks_read;
+    }
+  }
+  if (batch->count != 0U) (void) ht_batch_flush(batch, callback, context);
+  return blocks_read;
+}
+
+size_t HT_BatchSelectIdRange(HT_batch *batch, int min, int max) {
+  size_t kept = 0U;
+  // Every row gets written back and only the kept ones advance, so the loop does not branch on the data
+  for (size_t s = 0U; s != batch->selected; ++s) {
+    uint32_t row = batch->selection[s];
+    batch->selection[kept] = row;
+    kept += (size_t) ((batch->ids[row] >= min) & (batch->ids[row] <= max));
+  }
+  return batch->selected = kept;
+}
+
+size_t HT_BatchSelectEquals(HT_batch *batch, HT_batch_column column, const char *value) {
+  const record_field_t *field = &record_fields[column];
+  const char *cells = (column == HT_COLUMN_NAME) ? batch->names[0]
+                      : (column == HT_COLUMN_SURNAME) ? batch->surnames[0] : batch->addresses[0];
+  size_t len = strlen(value);
+  if (len > field->size) return batch->selected = 0U;
+  // The cells are zero padded, so a padded copy of the value makes equality a fixed width compare
+  char key[HT_BATCH_ADDRESS_SIZE] = {0};
+  memcpy(key, value, len);
+  size_t kept = 0U;
+  for (size_t s = 0U; s != batch->selected; ++s) {
+    uint32_t row = batch->selection[s];
+    batch->selection[kept] = row;
+    kept += (size_t) !memcmp(cells + row * field->size, key, field->size);
+  }
+  return batch->selected = kept;
+}
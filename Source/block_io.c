@@ -0,0 +1,138 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <memory.h>
+#include "../Include/block_io.h"
+#include "../Include/block_format.h"
+#include "../Include/lz.h"
+
+#define COMPRESSED_HEADER_SIZE (sizeof(bucket_info_t) + sizeof(uint16_t))
+
+expanded_block_t ht_expanded_block = {.fileDesc = -1, .blockId = -1};
+int ht_verify_checksums = 0;
+
+int ht_commit_block(int file_desc, int block_id) {
+  void *block;
+  if (BF_ReadBlock(file_desc, block_id, &block) < 0) return -1;
+  ht_seal_block(block);
+  return BF_WriteBlock(file_desc, block_id);
+}
+
+int ht_checksum_failure(int file_desc, int block_id) {
+  fprintf(stderr, "Block %d of file %d does not match its checksum\n", block_id, file_desc);
+  return -1;
+}
+
+int ht_expand(const void *block, void *expanded) {
+  const bucket_info_t *bucket_info = block;
+  uint16_t compressed_n;
+  memcpy(&compressed_n, (const char *) block + sizeof(bucket_info_t), sizeof(uint16_t));
+  if (compressed_n > BLOCK_SIZE - COMPRESSED_HEADER_SIZE || bucket_info->next_record < (int) sizeof(bucket_info_t) ||
+      bucket_info->next_record > (int) HT_EXPANDED_BLOCK_SIZE) {
+    return -1;
+  }
+  size_t entries_n = (size_t) bucket_info->next_record - sizeof(bucket_info_t);
+  int res = ht_lz_decompress((const char *) block + COMPRESSED_HEADER_SIZE, compressed_n,
+                             (char *) expanded + sizeof(bucket_info_t), HT_EXPANDED_BLOCK_SIZE - sizeof(bucket_info_t));
+  if (res != (int) entries_n) return -1;
+  memcpy(expanded, block, sizeof(bucket_info_t));
+  return 0;
+}
+
+int ht_expand_block(int file_desc, int block_id, void **block) {
+  ht_expanded_block.blockId = -1;
+  if (ht_expand(*block, ht_expanded_block.data) < 0) return -1;
+  ht_expanded_block.fileDesc = file_desc;
+  ht_expanded_block.blockId = block_id;
+  *block = ht_expanded_block.data;
+  return 0;
+}
+
+/* Compresses the entries of expanded into the BF buffer block, leaving block untouched when they do not fit */
+static int compress_block(void *block, const void *expanded, size_t slack) {
+  bucket_info_t bucket_info = *(const bucket_info_t *) expanded;
+  char compressed[BLOCK_SIZE];
+  int compressed_n = ht_lz_compress((const char *) expanded + sizeof(bucket_info_t),
+                                    (size_t) bucket_info.next_record - sizeof(bucket_info_t), compressed,
+                                    BLOCK_SIZE - COMPRESSED_HEADER_SIZE - slack);
+  if (compressed_n < 0) return -1;
+  bucket_info.flags |= BLOCK_COMPRESSED;
+  bucket_info.free_space = 0;
+  uint16_t length = (uint16_t) compressed_n;
+  memcpy(block, &bucket_info, sizeof(bucket_info_t));
+  memcpy((char *) block + sizeof(bucket_info_t), &length, sizeof(uint16_t));
+  memcpy((char *) block + COMPRESSED_HEADER_SIZE, compressed, (size_t) compressed_n);
+  memset((char *) block + COMPRESSED_HEADER_SIZE + compressed_n, 0,
+         BLOCK_SIZE - COMPRESSED_HEADER_SIZE - (size_t) compressed_n);
+  return 0;
+}
+
+/* Writes records [begin, end) of expanded plain over the BF buffer of block_id, followed by overflow_bucket */
+static int store_plain(int file_desc, int block_id, const void *expanded, unsigned int begin, unsigned int end,
+                       int overflow_bucket) {
+  void *block;
+  if (BF_ReadBlock(file_desc, block_id, &block) < 0) return -1;
+  bucket_info_t bucket_info = *(const bucket_info_t *) expanded;
+  bucket_info.flags &= ~BLOCK_COMPRESSED;
+  bucket_info.overflow_bucket = overflow_bucket;
+  bucket_info.record_n = end - begin;
+  bucket_info.next_record = (int) (sizeof(bucket_info_t) + bucket_info.record_n * sizeof(Record));
+  bucket_info.free_space = BLOCK_SIZE - bucket_info.next_record;
+  memset(block, 0, BLOCK_SIZE);
+  memcpy(block, &bucket_info, sizeof(bucket_info_t));
+  memcpy((char *) block + sizeof(bucket_info_t), fixed_record(expanded, begin), bucket_info.record_n * sizeof(Record));
+  ht_seal_block(block);
+  return BF_WriteBlock(file_desc, block_id);
+}
+
+/*
+ * Spreads the entries of an expanded block that no longer compress into one block over plain blocks:
+ * block_id keeps the first ones and new blocks linked in behind it take the rest.
+ * The new blocks get written from the last one back, so each one links to a block that is already stored.
+ */
+static int split_block(HT_metrics *metrics, int file_desc, int block_id, const void *expanded) {
+  const bucket_info_t *bucket_info = expanded;
+  const unsigned int block_records = (BLOCK_SIZE - sizeof(bucket_info_t)) / sizeof(Record);
+  int overflow_bucket = bucket_info->overflow_bucket;
+  for (unsigned int begin = (bucket_info->record_n - 1U) / block_records * block_records; begin != 0U;
+       begin -= block_records) {
+    unsigned int end = (begin + block_records < bucket_info->record_n) ? begin + block_records : bucket_info->record_n;
+    int new_block = ht_allocate_block(metrics, file_desc);
+    if (new_block < 0 || store_plain(file_desc, new_block, expanded, begin, end, overflow_bucket) < 0) return -1;
+    HT_METRIC_ADD(metrics, blockWrites, 1U);
+    overflow_bucket = new_block;
+  }
+  return store_plain(file_desc, block_id, expanded, 0U, block_records, overflow_bucket);
+}
+
+int ht_store_expanded_block(HT_metrics *metrics, int file_desc, int block_id) {
+  void *block;
+  if (BF_ReadBlock(file_desc, block_id, &block) < 0) return -1;
+  bucket_info_t *bucket_info = (bucket_info_t *) ht_expanded_block.data;
+  if (bucket_info->next_record <= BLOCK_SIZE) {
+    bucket_info->flags &= ~BLOCK_COMPRESSED;
+    bucket_info->free_space = BLOCK_SIZE - bucket_info->next_record;
+    memcpy(block, ht_expanded_block.data, BLOCK_SIZE);
+    ht_expanded_block.blockId = -1;
+  } else if (compress_block(block, ht_expanded_block.data, 0U) < 0) {
+    // Rare, as new compressed blocks keep HT_COMPRESSION_SLACK bytes free, but changed entries may compress worse
+    ht_expanded_block.blockId = -1;
+    return split_block(metrics, file_desc, block_id, ht_expanded_block.data);
+  }
+  ht_seal_block(block);
+  return BF_WriteBlock(file_desc, block_id);
+}
+
+int ht_append_compressed(HT_metrics *metrics, int file_desc, int block_id, const void *block, const Record *record) {
+  const bucket_info_t *bucket_info = block;
+  if ((size_t) bucket_info->next_record + sizeof(Record) > HT_EXPANDED_BLOCK_SIZE) return 0;
+  char expanded[HT_EXPANDED_BLOCK_SIZE];
+  memcpy(expanded, block, (size_t) bucket_info->next_record);
+  block_append(expanded, 0U, record);
+  void *buffer;
+  if (BF_ReadBlock(file_desc, block_id, &buffer) < 0) return -1;
+  if (compress_block(buffer, expanded, HT_COMPRESSION_SLACK) < 0) return 0;
+  if (ht_expanded_block.fileDesc == file_desc && ht_expanded_block.blockId == block_id) ht_expanded_block.blockId = -1;
+  HT_METRIC_ADD(metrics, blockWrites, 1U);
+  ht_seal_block(buffer);
+  return (BF_WriteBlock(file_desc, block_id) < 0) ? -1 : 1;
+}
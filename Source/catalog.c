@@ -0,0 +1,178 @@
+#include <memory.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include "../Include/catalog.h"
+#include "../Include/BF.h"
+
+typedef struct {
+  char *name;
+  int is_secondary;
+  // HT_info or SHT_info
+  void *handle;
+  size_t references;
+  unsigned long released_at;
+} catalog_entry_t;
+
+static struct {
+  catalog_entry_t *entries;
+  size_t n;
+  size_t capacity;
+  size_t idle_limit;
+  unsigned long clock;
+  pthread_mutex_t lock;
+} catalog = {.idle_limit = HT_CATALOG_DEFAULT_IDLE_LIMIT, .lock = PTHREAD_MUTEX_INITIALIZER};
+
+static catalog_entry_t *find_by_name(const char *name, int is_secondary) {
+  for (size_t i = 0U; i != catalog.n; ++i) {
+    catalog_entry_t *entry = &catalog.entries[i];
+    if (entry->is_secondary == is_secondary && !strcmp(entry->name, name)) return entry;
+  }
+  return NULL;
+}
+
+static catalog_entry_t *find_by_handle(const void *handle) {
+  for (size_t i = 0U; i != catalog.n; ++i) {
+    if (catalog.entries[i].handle == handle) return &catalog.entries[i];
+  }
+  return NULL;
+}
+
+static int close_entry(catalog_entry_t *entry) {
+  int res = entry->is_secondary ? SHT_CloseSecondaryIndex(entry->handle) : HT_CloseIndex(entry->handle);
+  free(entry->name);
+  // The last entry takes the place of the closed one
+  *entry = catalog.entries[--catalog.n];
+  return res;
+}
+
+/* Closes the least recently released idle handle. Returns 1 when one got closed, 0 when all are in use */
+static int close_oldest_idle(int *res) {
+  catalog_entry_t *oldest = NULL;
+  for (size_t i = 0U; i != catalog.n; ++i) {
+    catalog_entry_t *entry = &catalog.entries[i];
+    if (entry->references == 0U && (oldest == NULL || entry->released_at < oldest->released_at)) oldest = entry;
+  }
+  if (oldest == NULL) return 0;
+  if (close_entry(oldest) < 0) *res = -1;
+  return 1;
+}
+
+static int trim_idle(void) {
+  size_t idle = 0U;
+  for (size_t i = 0U; i != catalog.n; ++i) idle += catalog.entries[i].references == 0U;
+  int res = 0;
+  for (; idle > catalog.idle_limit && close_oldest_idle(&res); --idle);
+  return res;
+}
+
+static void *acquire(const char *name, int is_secondary) {
+  pthread_mutex_lock(&catalog.lock);
+  catalog_entry_t *entry = find_by_name(name, is_secondary);
+  if (entry != NULL) {
+    ++entry->references;
+    pthread_mutex_unlock(&catalog.lock);
+    return entry->handle;
+  }
+  void *handle = NULL;
+  char *name_copy = NULL;
+  if (catalog.n == catalog.capacity) {
+    size_t capacity = catalog.capacity ? 2U * catalog.capacity : 8U;
+    catalog_entry_t *entries = realloc(catalog.entries, capacity * sizeof(catalog_entry_t));
+    if (entries == NULL) goto __ACQUIRE_END;
+    catalog.entries = entries;
+    catalog.capacity = capacity;
+  }
+  if ((name_copy = malloc(strlen(name) + 1U)) == NULL) goto __ACQUIRE_END;
+  strcpy(name_copy, name);
+  // Only a full file table is worth closing idle handles for
+  int res = 0;
+  do {
+    BF_Errno = 0;
+    handle = is_secondary ? (void *) SHT_OpenSecondaryIndex(name_copy) : (void *) HT_OpenIndex(name_copy);
+  } while (handle == NULL && BF_Errno == BFE_FTABFULL && close_oldest_idle(&res));
+  if (handle == NULL) goto __ACQUIRE_END;
+  catalog.entries[catalog.n++] = (catalog_entry_t) {
+          .name = name_copy,
+          .is_secondary = is_secondary,
+          .handle = handle,
+          .references = 1U
+  };
+  name_copy = NULL;
+
+__ACQUIRE_END:
+  pthread_mutex_unlock(&catalog.lock);
+  free(name_copy);
+  return handle;
+}
+
+static int release(const void *handle) {
+  pthread_mutex_lock(&catalog.lock);
+  catalog_entry_t *entry = find_by_handle(handle);
+  int res = -1;
+  if (entry != NULL && entry->references != 0U) {
+    --entry->references;
+    entry->released_at = ++catalog.clock;
+    res = trim_idle();
+  }
+  pthread_mutex_unlock(&catalog.lock);
+  return res;
+}
+
+HT_info *HT_CatalogAcquire(const char *index_name) {
+  return acquire(index_name, 0);
+}
+
+int HT_CatalogRelease(HT_info *header_info) {
+  return release(header_info);
+}
+
+SHT_info *SHT_CatalogAcquire(const char *secondary_index_name) {
+  return acquire(secondary_index_name, 1);
+}
+
+int SHT_CatalogRelease(SHT_info *header_info) {
+  return release(header_info);
+}
+
+int SHT_CatalogGetAllEntries(SHT_info *sht_info, void *value) {
+  HT_info *ht_info = HT_CatalogAcquire(sht_info->fileName);
+  if (ht_info == NULL) return -1;
+  int res = SHT_SecondaryGetAllEntries(*sht_info, *ht_info, value);
+  if (HT_CatalogRelease(ht_info) < 0) res = -1;
+  return res;
+}
+
+void HT_CatalogSetIdleLimit(size_t limit) {
+  pthread_mutex_lock(&catalog.lock);
+  catalog.idle_limit = limit;
+  // A failed close has already been reported by the BF layer
+  (void) trim_idle();
+  pthread_mutex_unlock(&catalog.lock);
+}
+
+int HT_CatalogEvict(const char *filename) {
+  pthread_mutex_lock(&catalog.lock);
+  int res = 0;
+  for (int is_secondary = 0; is_secondary != 2; ++is_secondary) {
+    catalog_entry_t *entry = find_by_name(filename, is_secondary);
+    if (entry == NULL) continue;
+    if (entry->references != 0U || close_entry(entry) < 0) res = -1;
+  }
+  pthread_mutex_unlock(&catalog.lock);
+  return res;
+}
+
+int HT_CatalogCloseAll(void) {
+  pthread_mutex_lock(&catalog.lock);
+  int res = 0;
+  while (close_oldest_idle(&res));
+  if (catalog.n != 0U) {
+    res = -1;
+  } else {
+    free(catalog.entries);
+    catalog.entries = NULL;
+    catalog.capacity = 0U;
+  }
+  pthread_mutex_unlock(&catalog.lock);
+  return res;
+}
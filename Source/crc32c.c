@@ -0,0 +1,64 @@
+#include <memory.h>
+#include <pthread.h>
+#include "../Include/crc32c.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <nmmintrin.h>
+#define HAVE_SSE42_KERNEL
+#endif
+
+#define CRC32C_POLYNOMIAL 0x82F63B78U
+
+typedef uint32_t (*crc_kernel_t)(uint32_t crc, const uint8_t *p, size_t n);
+
+/* Slicing by 8: table[k][b] is the CRC of byte b followed by k zero bytes */
+static uint32_t crc_table[8][256];
+static crc_kernel_t crc_kernel;
+static pthread_once_t crc_kernel_once = PTHREAD_ONCE_INIT;
+
+static uint32_t crc32c_table(uint32_t crc, const uint8_t *p, size_t n) {
+  for (; n >= 8U; n -= 8U, p += 8) {
+    uint32_t low = crc ^ ((uint32_t) p[0] | (uint32_t) p[1] << 8U | (uint32_t) p[2] << 16U | (uint32_t) p[3] << 24U);
+    crc = crc_table[7][low & 0xFFU] ^ crc_table[6][(low >> 8U) & 0xFFU] ^
+          crc_table[5][(low >> 16U) & 0xFFU] ^ crc_table[4][low >> 24U] ^
+          crc_table[3][p[4]] ^ crc_table[2][p[5]] ^ crc_table[1][p[6]] ^ crc_table[0][p[7]];
+  }
+  for (; n != 0U; --n) crc = (crc >> 8U) ^ crc_table[0][(crc ^ *p++) & 0xFFU];
+  return crc;
+}
+
+#ifdef HAVE_SSE42_KERNEL
+/* The crc32 instruction implements CRC32C, 8 bytes at a time */
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *p, size_t n) {
+  uint64_t crc64 = crc;
+  for (; n >= 8U; n -= 8U, p += 8) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(uint64_t));
+    crc64 = _mm_crc32_u64(crc64, word);
+  }
+  crc = (uint32_t) crc64;
+  for (; n != 0U; --n) crc = _mm_crc32_u8(crc, *p++);
+  return crc;
+}
+#endif
+
+static void select_crc_kernel(void) {
+  for (uint32_t b = 0U; b != 256U; ++b) {
+    uint32_t crc = b;
+    for (int bit = 0; bit != 8; ++bit) crc = (crc >> 1U) ^ (CRC32C_POLYNOMIAL & (0U - (crc & 1U)));
+    crc_table[0][b] = crc;
+  }
+  for (uint32_t b = 0U; b != 256U; ++b) {
+    for (int k = 1; k != 8; ++k) crc_table[k][b] = (crc_table[k - 1][b] >> 8U) ^ crc_table[0][crc_table[k - 1][b] & 0xFFU];
+  }
+  crc_kernel = crc32c_table;
+#ifdef HAVE_SSE42_KERNEL
+  if (__builtin_cpu_supports("sse4.2")) crc_kernel = crc32c_sse42;
+#endif
+}
+
+uint32_t ht_crc32c(uint32_t crc, const void *data, size_t n) {
+  pthread_once(&crc_kernel_once, select_crc_kernel);
+  return ~crc_kernel(~crc, data, n);
+}
@@ -0,0 +1,213 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../Include/direct_io.h"
+#include "../Include/block_io.h"
+#include "../Include/block_format.h"
+#include "../Include/catalog.h"
+#include "../Include/macros.h"
+
+#define CHUNK_BYTES ((size_t) HT_DIRECT_CHUNK_SLOTS * HT_DIRECT_SLOT_SIZE)
+#define RING_BYTES (HT_DIRECT_RING_CHUNKS * CHUNK_BYTES)
+#define NO_CHUNK ((size_t) -1)
+
+struct ht_direct_reader {
+  int fd;
+  int direct;
+  int total_blocks;
+  size_t file_size;
+  size_t chunk_n;
+  char *ring;
+  /* The slot of the next block handed out, and the chunk it got handed out of */
+  size_t next_slot;
+  size_t current;
+  /* Guarded by lock: chunks read ahead, chunks released by the reader */
+  size_t filled;
+  size_t released;
+  int failed;
+  int stopped;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  pthread_t thread;
+};
+
+// The ring of the last closed reader
+static _Atomic(char *) pooled_ring = NULL;
+
+static int read_chunk(ht_direct_reader_t *reader, size_t chunk) {
+  char *buffer = reader->ring + (chunk % HT_DIRECT_RING_CHUNKS) * CHUNK_BYTES;
+  off_t offset = (off_t) (chunk * CHUNK_BYTES);
+  size_t size = reader->file_size - (size_t) offset;
+  if (size > CHUNK_BYTES) size = CHUNK_BYTES;
+  for (size_t done = 0U; done != size;) {
+    ssize_t bytes = pread(reader->fd, buffer + done, size - done, offset + (off_t) done);
+    if (bytes < 0 && errno == EINVAL && reader->direct) {
+      // Some file systems take O_DIRECT on open and only refuse it on the first read
+      if (fcntl(reader->fd, F_SETFL, fcntl(reader->fd, F_GETFL) & ~O_DIRECT) < 0) return -1;
+      reader->direct = 0;
+      continue;
+    }
+    if (bytes < 0 && errno == EINTR) continue;
+    if (bytes <= 0) return -1;
+    done += (size_t) bytes;
+  }
+#ifdef POSIX_FADV_DONTNEED
+  if (!reader->direct) posix_fadvise(reader->fd, offset, (off_t) size, POSIX_FADV_DONTNEED);
+#endif
+  return 0;
+}
+
+static void *read_ahead(void *argument) {
+  ht_direct_reader_t *reader = argument;
+  for (size_t chunk = 0U; chunk != reader->chunk_n; ++chunk) {
+    pthread_mutex_lock(&reader->lock);
+    while (chunk - reader->released == HT_DIRECT_RING_CHUNKS && !reader->stopped) {
+      pthread_cond_wait(&reader->changed, &reader->lock);
+    }
+    int stopped = reader->stopped;
+    pthread_mutex_unlock(&reader->lock);
+    if (stopped) break;
+
+    int res = read_chunk(reader, chunk);
+    pthread_mutex_lock(&reader->lock);
+    if (res < 0) reader->failed = 1;
+    else reader->filled = chunk + 1U;
+    pthread_cond_broadcast(&reader->changed);
+    pthread_mutex_unlock(&reader->lock);
+    if (res < 0) break;
+  }
+  return NULL;
+}
+
+static int open_file(const char *filename, int *direct) {
+  int fd = open(filename, O_RDONLY | O_DIRECT);
+  *direct = fd >= 0;
+  if (fd < 0 && errno == EINVAL) fd = open(filename, O_RDONLY);
+  if (fd < 0) perror(filename);
+  return fd;
+}
+
+ht_direct_reader_t *ht_direct_open(const char *filename, int *total_blocks) {
+  ht_direct_reader_t *reader = __MALLOC(1, ht_direct_reader_t);
+  if (reader == NULL) return NULL;
+  *reader = (ht_direct_reader_t) {
+          .current = NO_CHUNK,
+          .next_slot = 1U,
+          .lock = PTHREAD_MUTEX_INITIALIZER,
+          .changed = PTHREAD_COND_INITIALIZER
+  };
+  struct stat status;
+  if ((reader->fd = open_file(filename, &reader->direct)) < 0) goto __OPEN_FAILED;
+  // A header slot and at least block 0
+  if (fstat(reader->fd, &status) < 0 || status.st_size % HT_DIRECT_SLOT_SIZE != 0 ||
+      status.st_size < 2 * (off_t) HT_DIRECT_SLOT_SIZE) {
+    goto __OPEN_FAILED;
+  }
+  reader->file_size = (size_t) status.st_size;
+  reader->total_blocks = (int) (reader->file_size / HT_DIRECT_SLOT_SIZE) - 1;
+  reader->chunk_n = (reader->file_size + CHUNK_BYTES - 1U) / CHUNK_BYTES;
+#ifdef POSIX_FADV_SEQUENTIAL
+  if (!reader->direct) posix_fadvise(reader->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  reader->ring = atomic_exchange(&pooled_ring, NULL);
+  if (reader->ring == NULL && posix_memalign((void **) &reader->ring, HT_DIRECT_ALIGNMENT, RING_BYTES) != 0) {
+    reader->ring = NULL;
+    goto __OPEN_FAILED;
+  }
+  if (pthread_create(&reader->thread, NULL, read_ahead, reader) != 0) goto __OPEN_FAILED;
+  *total_blocks = reader->total_blocks;
+  return reader;
+
+__OPEN_FAILED:
+  if (reader->fd >= 0) close(reader->fd);
+  free(reader->ring);
+  free(reader);
+  return NULL;
+}
+
+int ht_direct_next(ht_direct_reader_t *reader, const char **block) {
+  if (reader->next_slot > (size_t) reader->total_blocks) return 0;
+  size_t chunk = reader->next_slot / HT_DIRECT_CHUNK_SLOTS;
+  if (chunk != reader->current) {
+    pthread_mutex_lock(&reader->lock);
+    // Blocks are handed out in order, so every chunk before this one is done with
+    reader->released = chunk;
+    pthread_cond_broadcast(&reader->changed);
+    while (reader->filled <= chunk && !reader->failed) pthread_cond_wait(&reader->changed, &reader->lock);
+    int failed = reader->filled <= chunk;
+    pthread_mutex_unlock(&reader->lock);
+    if (failed) return -1;
+    reader->current = chunk;
+  }
+  *block = reader->ring + (chunk % HT_DIRECT_RING_CHUNKS) * CHUNK_BYTES +
+           (reader->next_slot % HT_DIRECT_CHUNK_SLOTS) * HT_DIRECT_SLOT_SIZE;
+  ++reader->next_slot;
+  return 1;
+}
+
+void ht_direct_close(ht_direct_reader_t *reader) {
+  if (reader == NULL) return;
+  pthread_mutex_lock(&reader->lock);
+  reader->stopped = 1;
+  pthread_cond_broadcast(&reader->changed);
+  pthread_mutex_unlock(&reader->lock);
+  pthread_join(reader->thread, NULL);
+  pthread_mutex_destroy(&reader->lock);
+  pthread_cond_destroy(&reader->changed);
+  close(reader->fd);
+  free(atomic_exchange(&pooled_ring, reader->ring));
+  free(reader);
+}
+
+int HT_ScanFile(const char *filename, HT_scan_callback callback, void *context) {
+  // A handle cached by the catalog may hold blocks that are not on disk yet
+  if (HT_CatalogEvict(filename) < 0) return -1;
+  int total_blocks;
+  ht_direct_reader_t *reader = ht_direct_open(filename, &total_blocks);
+  if (reader == NULL) return -1;
+  const char *block;
+  size_t identifier_len = strlen(HT_FILE_IDENTIFIER);
+  if (ht_direct_next(reader, &block) != 1 || memcmp(block, HT_FILE_IDENTIFIER, identifier_len) != 0 ||
+      !ht_header_current(block, filename) || !ht_header_intact(block)) {
+    ht_direct_close(reader);
+    return -1;
+  }
+  unsigned int flags;
+  memcpy(&flags, block + identifier_len + offsetof(HT_info, flags), sizeof(unsigned int));
+
+  char expanded[HT_EXPANDED_BLOCK_SIZE];
+  int blocks_read = 0;
+  int res;
+  for (int block_id = 1; (res = ht_direct_next(reader, &block)) == 1; ++block_id) {
+    ++blocks_read;
+    if (ht_verify_checksums && !ht_block_intact(block)) {
+      fprintf(stderr, "Block %d of %s does not match its checksum\n", block_id, filename);
+      res = -1;
+      break;
+    }
+    if (((const bucket_info_t *) block)->flags & BLOCK_COMPRESSED) {
+      if (ht_expand(block, expanded) < 0) {
+        res = -1;
+        break;
+      }
+      block = expanded;
+    }
+    const bucket_info_t *bucket_info = (const bucket_info_t *) block;
+    int stop = 0;
+    for (unsigned int i = 0U; i != bucket_info->record_n && !stop; ++i) {
+      Record scratch;
+      stop = callback(block_record(block, flags, i, &scratch), block_id, context);
+    }
+    if (stop) break;
+  }
+  ht_direct_close(reader);
+  return (res < 0) ? -1 : blocks_read;
+}
@@ -0,0 +1,228 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <memory.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "../Include/export.h"
+#include "../Include/crc32c.h"
+#include "../Include/macros.h"
+
+#define EXPORT_MAGIC "HTEXPORT"
+#define EXPORT_VERSION 1U
+#define FRAME_MAGIC 0x46525448U
+#define FRAME_HEADER_SIZE 16U
+#define HEADER_SIZE (sizeof(EXPORT_MAGIC) - 1U + 5U * sizeof(uint32_t) + HT_EXPORT_NAME_SIZE + 2U * sizeof(uint32_t))
+#define FRAME_RECORDS ((HT_EXPORT_FRAME_SIZE - FRAME_HEADER_SIZE) / HT_EXPORT_RECORD_SIZE)
+
+typedef struct {
+  int fd;
+  unsigned char *frame;
+  uint32_t sequence;
+  size_t n;
+  int records;
+  int failed;
+} exporter_t;
+
+static __INLINE inline
+unsigned char *put32(unsigned char *p, uint32_t value) {
+  p[0] = (unsigned char) value;
+  p[1] = (unsigned char) (value >> 8U);
+  p[2] = (unsigned char) (value >> 16U);
+  p[3] = (unsigned char) (value >> 24U);
+  return p + sizeof(uint32_t);
+}
+
+static __INLINE inline
+uint32_t get32(const unsigned char *p) {
+  return (uint32_t) p[0] | (uint32_t) p[1] << 8U | (uint32_t) p[2] << 16U | (uint32_t) p[3] << 24U;
+}
+
+static __INLINE inline
+unsigned char *put_bytes(unsigned char *p, const void *bytes, size_t n) {
+  memcpy(p, bytes, n);
+  return p + n;
+}
+
+static int write_all(int fd, const void *buffer, size_t n) {
+  for (const char *p = buffer; n != 0U;) {
+    ssize_t bytes = write(fd, p, n);
+    if (bytes < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    p += bytes;
+    n -= (size_t) bytes;
+  }
+  return 0;
+}
+
+/* Returns 1 when the whole frame got read, 0 at the end of the file and -1 on failure or on a partial frame */
+static int read_frame(int fd, unsigned char *frame) {
+  size_t n = 0U;
+  while (n != HT_EXPORT_FRAME_SIZE) {
+    ssize_t bytes = read(fd, frame + n, HT_EXPORT_FRAME_SIZE - n);
+    if (bytes < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    if (bytes == 0) return (n == 0U) ? 0 : -1;
+    n += (size_t) bytes;
+  }
+  return 1;
+}
+
+/* Fills the frame header, checksums the frame and writes it out */
+static int flush_frame(exporter_t *exporter, uint32_t sequence) {
+  unsigned char *p = exporter->frame;
+  p = put32(p, FRAME_MAGIC);
+  p = put32(p, sequence);
+  p = put32(p, (uint32_t) exporter->n);
+  size_t payload_n = exporter->n * HT_EXPORT_RECORD_SIZE;
+  uint32_t crc = ht_crc32c(0U, exporter->frame, FRAME_HEADER_SIZE - sizeof(uint32_t));
+  put32(p, ht_crc32c(crc, exporter->frame + FRAME_HEADER_SIZE, payload_n));
+  memset(exporter->frame + FRAME_HEADER_SIZE + payload_n, 0, HT_EXPORT_FRAME_SIZE - FRAME_HEADER_SIZE - payload_n);
+  exporter->n = 0U;
+  if (write_all(exporter->fd, exporter->frame, HT_EXPORT_FRAME_SIZE) < 0) exporter->failed = 1;
+  return exporter->failed ? -1 : 0;
+}
+
+static int export_record(const Record *record, int block_id, void *context) {
+  (void) block_id;
+  exporter_t *exporter = context;
+  unsigned char *p = exporter->frame + FRAME_HEADER_SIZE + exporter->n * HT_EXPORT_RECORD_SIZE;
+  p = put32(p, (uint32_t) record->id);
+  p = put_bytes(p, record->name, sizeof(record->name));
+  p = put_bytes(p, record->surname, sizeof(record->surname));
+  put_bytes(p, record->address, sizeof(record->address));
+  ++exporter->records;
+  return ++exporter->n == FRAME_RECORDS && flush_frame(exporter, exporter->sequence++) < 0;
+}
+
+static int write_header(exporter_t *exporter, const HT_info *header_info) {
+  if (header_info->attrLength > HT_EXPORT_NAME_SIZE) return -1;
+  memset(exporter->frame, 0, HT_EXPORT_FRAME_SIZE);
+  unsigned char *p = put_bytes(exporter->frame, EXPORT_MAGIC, sizeof(EXPORT_MAGIC) - 1U);
+  p = put32(p, EXPORT_VERSION);
+  p = put32(p, HT_EXPORT_FRAME_SIZE);
+  p = put32(p, (uint32_t) (unsigned char) header_info->attrType);
+  p = put32(p, (uint32_t) header_info->attrLength);
+  memcpy(p, header_info->attrName, header_info->attrLength);
+  p += HT_EXPORT_NAME_SIZE;
+  p = put32(p, (uint32_t) header_info->numBuckets);
+  p = put32(p, header_info->flags);
+  put32(p, ht_crc32c(0U, exporter->frame, (size_t) (p - exporter->frame)));
+  return write_all(exporter->fd, exporter->frame, HT_EXPORT_FRAME_SIZE);
+}
+
+int HT_Export(HT_info *header_info, const char *filename) {
+  exporter_t exporter = {.frame = __MALLOC(HT_EXPORT_FRAME_SIZE, unsigned char)};
+  if (exporter.frame == NULL) return -1;
+  if ((exporter.fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+    perror(filename);
+    free(exporter.frame);
+    return -1;
+  }
+  int res = -1;
+  if (write_header(&exporter, header_info) < 0) goto __EXPORT_END;
+  if (HT_Scan(header_info, export_record, &exporter) < 0 || exporter.failed) goto __EXPORT_END;
+  if (exporter.n != 0U && flush_frame(&exporter, exporter.sequence++) < 0) goto __EXPORT_END;
+  // The closing frame carries no records, its sequence number counts the frames before it
+  if (flush_frame(&exporter, exporter.sequence) < 0) goto __EXPORT_END;
+  res = exporter.records;
+
+__EXPORT_END:
+  if (close(exporter.fd) < 0) res = -1;
+  free(exporter.frame);
+  return res;
+}
+
+typedef struct {
+  char type;
+  int length;
+  char name[HT_EXPORT_NAME_SIZE + 1U];
+  int buckets;
+  unsigned int flags;
+} export_header_t;
+
+static int read_header(const unsigned char *frame, export_header_t *header) {
+  const unsigned char *p = frame + sizeof(EXPORT_MAGIC) - 1U;
+  if (memcmp(frame, EXPORT_MAGIC, sizeof(EXPORT_MAGIC) - 1U) != 0 || get32(p) != EXPORT_VERSION ||
+      get32(p + 4U) != HT_EXPORT_FRAME_SIZE || get32(frame + HEADER_SIZE - sizeof(uint32_t)) !=
+      ht_crc32c(0U, frame, HEADER_SIZE - sizeof(uint32_t))) {
+    return -1;
+  }
+  header->type = (char) get32(p + 8U);
+  uint32_t length = get32(p + 12U);
+  if (length > HT_EXPORT_NAME_SIZE) return -1;
+  header->length = (int) length;
+  STR_COPY(header->name, p + 16U, length);
+  p += 16U + HT_EXPORT_NAME_SIZE;
+  header->buckets = (int) get32(p);
+  header->flags = get32(p + 4U);
+  return 0;
+}
+
+/* Checks a record frame and decodes its records. Returns the record count, or -1 when the frame is damaged */
+static int decode_frame(const unsigned char *frame, uint32_t sequence, Record *records) {
+  uint32_t n = get32(frame + 8U);
+  if (get32(frame) != FRAME_MAGIC || get32(frame + 4U) != sequence || n > FRAME_RECORDS) return -1;
+  uint32_t crc = ht_crc32c(0U, frame, FRAME_HEADER_SIZE - sizeof(uint32_t));
+  if (get32(frame + 12U) != ht_crc32c(crc, frame + FRAME_HEADER_SIZE, n * HT_EXPORT_RECORD_SIZE)) return -1;
+  const unsigned char *p = frame + FRAME_HEADER_SIZE;
+  for (uint32_t i = 0U; i != n; ++i) {
+    Record *record = &records[i];
+    record->id = (int) get32(p);
+    p += sizeof(uint32_t);
+    memcpy(record->name, p, sizeof(record->name));
+    p += sizeof(record->name);
+    memcpy(record->surname, p, sizeof(record->surname));
+    p += sizeof(record->surname);
+    memcpy(record->address, p, sizeof(record->address));
+    p += sizeof(record->address);
+  }
+  return (int) n;
+}
+
+int HT_Import(const char *filename, char *index_name, int buckets) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    perror(filename);
+    return -1;
+  }
+  unsigned char *frame = __MALLOC(HT_EXPORT_FRAME_SIZE, unsigned char);
+  Record *records = __MALLOC(FRAME_RECORDS, Record);
+  HT_info *info = NULL;
+  int created = 0;
+  int res = -1;
+  export_header_t header;
+  if (frame == NULL || records == NULL || read_frame(fd, frame) != 1 || read_header(frame, &header) < 0) {
+    goto __IMPORT_END;
+  }
+  HT_create_options options = {.flags = header.flags};
+  if (HT_CreateIndexEx(index_name, header.type, header.name, header.length,
+                       (buckets != 0) ? buckets : header.buckets, &options) < 0) {
+    goto __IMPORT_END;
+  }
+  created = 1;
+  if ((info = HT_OpenIndex(index_name)) == NULL) goto __IMPORT_END;
+
+  int total = 0;
+  for (uint32_t sequence = 0U;; ++sequence) {
+    int n;
+    if (read_frame(fd, frame) != 1 || (n = decode_frame(frame, sequence, records)) < 0) goto __IMPORT_END;
+    // Only the closing frame is empty
+    if (n == 0) break;
+    if (HT_InsertMany(info, records, (size_t) n, NULL) < 0) goto __IMPORT_END;
+    total += n;
+  }
+  res = total;
+
+__IMPORT_END:
+  if (info != NULL && HT_CloseIndex(info) < 0) res = -1;
+  if (res < 0 && created) remove(index_name);
+  close(fd);
+  free(records);
+  free(frame);
+  return res;
+}
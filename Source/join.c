@@ -0,0 +1,217 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <memory.h>
+#include "../Include/join.h"
+#include "../Include/block_io.h"
+#include "../Include/block_format.h"
+#include "../Include/macros.h"
+
+#define BF_READ_BLOCK_EMSG "Error while reading block"
+// Partitions of the fallback join, a power of two
+#define JOIN_PARTITIONS 64U
+#define NO_RECORD UINT32_MAX
+
+typedef struct {
+  size_t offset;
+  // 0 for the id, the width of the field for strings
+  size_t size;
+} join_key_t;
+
+typedef struct {
+  Record *records;
+  size_t n;
+  size_t capacity;
+} record_list_t;
+
+typedef struct {
+  const join_key_t *key;
+  HT_join_callback callback;
+  void *context;
+  int pairs;
+  int stopped;
+  // The hash table over the left records, reused from one pair of lists to the next
+  uint32_t *heads;
+  uint32_t *next;
+  size_t head_capacity;
+  size_t next_capacity;
+} join_state_t;
+
+typedef struct {
+  const join_key_t *key;
+  record_list_t *partitions;
+  int failed;
+} partitioner_t;
+
+static int resolve_key(const HT_info *info, join_key_t *key) {
+  if (info->attrType == 'i') {
+    *key = (join_key_t) {offsetof(Record, id), 0U};
+    return 0;
+  }
+  // Same matching as get_attribute_offset
+  const char *names[COMPACT_FIELD_N] = {"name", "surname", "address"};
+  for (unsigned int f = 0U; f != COMPACT_FIELD_N; ++f) {
+    if (info->attrType == 'c' && !strncmp(info->attrName, names[f], info->attrLength)) {
+      *key = (join_key_t) {record_fields[f].offset, record_fields[f].size};
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static size_t key_length(const join_key_t *key, const Record *record) {
+  if (key->size == 0U) return sizeof(int);
+  return strnlen((const char *) record + key->offset, key->size);
+}
+
+/* FNV-1a, independent of hash_function so that it still spreads the records of a single bucket */
+static uint32_t key_hash(const join_key_t *key, const Record *record) {
+  const unsigned char *bytes = (const unsigned char *) record + key->offset;
+  uint32_t hash = 2166136261U;
+  for (size_t i = 0U, n = key_length(key, record); i != n; ++i) {
+    hash = (hash ^ bytes[i]) * 16777619U;
+  }
+  return hash ^ (hash >> 16U);
+}
+
+static int keys_equal(const join_key_t *key, const Record *lhs, const Record *rhs) {
+  size_t n = key_length(key, lhs);
+  return n == key_length(key, rhs) && !memcmp((const char *) lhs + key->offset, (const char *) rhs + key->offset, n);
+}
+
+static int list_append(record_list_t *list, const Record *record) {
+  if (list->n == list->capacity) {
+    size_t capacity = list->capacity ? 2U * list->capacity : 16U;
+    Record *records = realloc(list->records, capacity * sizeof(Record));
+    if (records == NULL) return -1;
+    list->records = records;
+    list->capacity = capacity;
+  }
+  list->records[list->n++] = *record;
+  return 0;
+}
+
+/* Makes room in the hash table for n left records and empties it */
+static int reserve_table(join_state_t *state, size_t n, size_t *mask) {
+  size_t heads = 1U;
+  while (heads < n) heads <<= 1U;
+  if (heads > state->head_capacity) {
+    uint32_t *grown = realloc(state->heads, heads * sizeof(uint32_t));
+    if (grown == NULL) return -1;
+    state->heads = grown;
+    state->head_capacity = heads;
+  }
+  if (n > state->next_capacity) {
+    uint32_t *grown = realloc(state->next, n * sizeof(uint32_t));
+    if (grown == NULL) return -1;
+    state->next = grown;
+    state->next_capacity = n;
+  }
+  for (size_t i = 0U; i != heads; ++i) state->heads[i] = NO_RECORD;
+  *mask = heads - 1U;
+  return 0;
+}
+
+static int join_lists(join_state_t *state, const record_list_t *left, const record_list_t *right) {
+  if (left->n == 0U || right->n == 0U) return 0;
+  if (left->n >= NO_RECORD) return -1;
+  size_t mask;
+  if (reserve_table(state, left->n, &mask) < 0) return -1;
+  for (uint32_t i = 0U; i != left->n; ++i) {
+    uint32_t *head = &state->heads[key_hash(state->key, &left->records[i]) & mask];
+    state->next[i] = *head;
+    *head = i;
+  }
+  for (size_t j = 0U; j != right->n; ++j) {
+    const Record *probe = &right->records[j];
+    for (uint32_t i = state->heads[key_hash(state->key, probe) & mask]; i != NO_RECORD; i = state->next[i]) {
+      if (!keys_equal(state->key, &left->records[i], probe)) continue;
+      ++state->pairs;
+      if (state->callback(&left->records[i], probe, state->context)) {
+        state->stopped = 1;
+        return 0;
+      }
+    }
+  }
+  return 0;
+}
+
+/* Replaces the contents of the list with the records of a bucket chain */
+static int read_chain(HT_info *info, int bucket, record_list_t *list) {
+  list->n = 0U;
+  while (bucket != -1) {
+    void *block;
+    CHECK(ht_read_block(info->metrics, info->fileDesc, bucket, &block), BF_READ_BLOCK_EMSG, return -1);
+    const bucket_info_t *bucket_info = block;
+    for (unsigned int i = 0U; i != bucket_info->record_n; ++i) {
+      Record scratch;
+      if (list_append(list, block_record(block, info->flags, i, &scratch)) < 0) return -1;
+    }
+    bucket = bucket_info->overflow_bucket;
+  }
+  return 0;
+}
+
+static int join_buckets(join_state_t *state, HT_info *left, HT_info *right) {
+  record_list_t left_chain = {0};
+  record_list_t right_chain = {0};
+  int res = 0;
+  for (unsigned long bucket = 1U; bucket <= left->numBuckets && !state->stopped; ++bucket) {
+    if (read_chain(right, (int) bucket, &right_chain) < 0 || (right_chain.n != 0U &&
+        (read_chain(left, (int) bucket, &left_chain) < 0 || join_lists(state, &left_chain, &right_chain) < 0))) {
+      res = -1;
+      break;
+    }
+  }
+  free(left_chain.records);
+  free(right_chain.records);
+  return res;
+}
+
+static int partition_record(const Record *record, int block_id, void *context) {
+  (void) block_id;
+  partitioner_t *partitioner = context;
+  // The high bits pick the partition, join_lists uses the low ones
+  uint32_t partition = key_hash(partitioner->key, record) >> (32U - __builtin_ctz(JOIN_PARTITIONS));
+  if (list_append(&partitioner->partitions[partition], record) < 0) {
+    partitioner->failed = 1;
+    return 1;
+  }
+  return 0;
+}
+
+static int join_partitions(join_state_t *state, HT_info *left, HT_info *right) {
+  record_list_t *partitions = calloc(2U * JOIN_PARTITIONS, sizeof(record_list_t));
+  if (partitions == NULL) return -1;
+  partitioner_t left_partitioner = {state->key, partitions, 0};
+  partitioner_t right_partitioner = {state->key, partitions + JOIN_PARTITIONS, 0};
+  int res = -1;
+  if (HT_Scan(left, partition_record, &left_partitioner) < 0 || left_partitioner.failed) goto __PARTITIONS_END;
+  if (HT_Scan(right, partition_record, &right_partitioner) < 0 || right_partitioner.failed) goto __PARTITIONS_END;
+  res = 0;
+  for (unsigned int p = 0U; p != JOIN_PARTITIONS && !state->stopped; ++p) {
+    if (join_lists(state, &partitions[p], &partitions[JOIN_PARTITIONS + p]) < 0) {
+      res = -1;
+      break;
+    }
+  }
+
+__PARTITIONS_END:
+  for (unsigned int p = 0U; p != 2U * JOIN_PARTITIONS; ++p) free(partitions[p].records);
+  free(partitions);
+  return res;
+}
+
+int HT_Join(HT_info *left, HT_info *right, HT_join_callback callback, void *context) {
+  join_key_t key;
+  join_key_t right_key;
+  if (resolve_key(left, &key) < 0) return -1;
+  join_state_t state = {.key = &key, .callback = callback, .context = context};
+  // Equal keys land in the same bucket of both indexes only when both hash the same field the same way
+  int co_partitioned = resolve_key(right, &right_key) == 0 && right_key.offset == key.offset &&
+                       right->numBuckets == left->numBuckets;
+  int res = co_partitioned ? join_buckets(&state, left, right) : join_partitions(&state, left, right);
+  free(state.heads);
+  free(state.next);
+  return (res < 0) ? -1 : state.pairs;
+}
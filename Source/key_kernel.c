@@ -0,0 +1,199 @@
+#include <stdint.h>
+#include <memory.h>
+#include "../Include/key_kernel.h"
+#include "../Include/block_format.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS
+#endif
+
+/* Instruction sets the fixed block string kernels come in, the best one the CPU has gets picked */
+typedef enum {
+  ISA_SCALAR,
+  ISA_SSE2,
+  ISA_AVX2,
+  ISA_N
+} isa_t;
+
+static size_t int_key_length(const void *key) {
+  (void) key;
+  return 0U;
+}
+
+static size_t string_key_length(const void *key) {
+  return strlen(key);
+}
+
+static unsigned int find_int_fixed(const void *block, unsigned int from, const void *key, size_t key_len) {
+  (void) key_len;
+  const bucket_info_t *bucket_info = block;
+  const int id = *(const int *) key;
+  const Record *records = fixed_record(block, 0U);
+  for (unsigned int i = from; i != bucket_info->record_n; ++i) {
+    if (records[i].id == id) return i;
+  }
+  return bucket_info->record_n;
+}
+
+static unsigned int find_int_compact(const void *block, unsigned int from, const void *key, size_t key_len) {
+  (void) key_len;
+  const bucket_info_t *bucket_info = block;
+  const int id = *(const int *) key;
+  for (unsigned int i = from; i != bucket_info->record_n; ++i) {
+    int entry_id;
+    memcpy(&entry_id, (const char *) block + *compact_slot(block, i), sizeof(int));
+    if (entry_id == id) return i;
+  }
+  return bucket_info->record_n;
+}
+
+/*
+ * Keys of 8 bytes or more get their first word compared before the memcmp,
+ * which rejects almost every entry of a bucket with a single load and compare.
+ */
+static __INLINE inline
+int prefix_matches(const char *field, const char *key, size_t key_len, uint64_t key_word) {
+  if (key_len >= sizeof(uint64_t)) {
+    uint64_t field_word;
+    memcpy(&field_word, field, sizeof(uint64_t));
+    if (field_word != key_word) return 0;
+  }
+  return !memcmp(field, key, key_len);
+}
+
+static __INLINE inline
+uint64_t first_word(const char *key, size_t key_len) {
+  uint64_t word = 0U;
+  if (key_len >= sizeof(uint64_t)) memcpy(&word, key, sizeof(uint64_t));
+  return word;
+}
+
+/* The field offset and size are constants of each instantiation */
+#define DEFINE_STRING_KERNELS(field, field_index) \
+static unsigned int find_##field##_fixed_scalar(const void *block, unsigned int from, const void *key, size_t key_len) { \
+  const bucket_info_t *bucket_info = block; \
+  if (key_len > sizeof(((Record *) 0)->field)) return bucket_info->record_n; \
+  const Record *records = fixed_record(block, 0U); \
+  uint64_t key_word = first_word(key, key_len); \
+  for (unsigned int i = from; i != bucket_info->record_n; ++i) { \
+    if (prefix_matches(records[i].field, key, key_len, key_word)) return i; \
+  } \
+  return bucket_info->record_n; \
+} \
+\
+static unsigned int find_##field##_compact(const void *block, unsigned int from, const void *key, size_t key_len) { \
+  const bucket_info_t *bucket_info = block; \
+  for (unsigned int i = from; i != bucket_info->record_n; ++i) { \
+    const unsigned char *p = (const unsigned char *) block + *compact_slot(block, i) + sizeof(int); \
+    for (unsigned int f = 0U; f != (field_index); ++f) p += *p + 1U; \
+    if (*p >= key_len && !memcmp(p + 1, key, key_len)) return i; \
+  } \
+  return bucket_info->record_n; \
+}
+
+DEFINE_STRING_KERNELS(name, 0U)
+DEFINE_STRING_KERNELS(surname, 1U)
+DEFINE_STRING_KERNELS(address, 2U)
+
+#ifdef HAVE_X86_KERNELS
+/*
+ * A 512 byte bucket holds only a handful of fixed records, so rather than spreading a key over
+ * several records the SIMD kernels compare a whole field, or its first 16 or 32 bytes, in one
+ * instruction: the field is compared byte by byte with the zero padded key and the bitmask of
+ * equal bytes is tested against the prefix mask of the key. Only keys longer than the vector
+ * get the rest compared with memcmp.
+ * The wide load may run past the field, but never past its Record, as every string field starts
+ * at least 32 bytes before the end of a Record.
+ */
+static __INLINE inline
+unsigned int find_fixed_sse2(const void *block, unsigned int from, const char *key, size_t key_len,
+                             size_t field_offset) {
+  const bucket_info_t *bucket_info = block;
+  const char *fields = (const char *) fixed_record(block, 0U) + field_offset;
+  char padded[16] = {0};
+  size_t head_len = (key_len < sizeof(padded)) ? key_len : sizeof(padded);
+  memcpy(padded, key, head_len);
+  const __m128i needle = _mm_loadu_si128((const __m128i *) padded);
+  const uint32_t mask = (uint32_t) ((1ULL << head_len) - 1U);
+  for (unsigned int i = from; i != bucket_info->record_n; ++i) {
+    const char *field = fields + (size_t) i * sizeof(Record);
+    __m128i bytes = _mm_loadu_si128((const __m128i *) field);
+    uint32_t equal = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, needle));
+    if ((equal & mask) == mask && !memcmp(field + head_len, key + head_len, key_len - head_len)) return i;
+  }
+  return bucket_info->record_n;
+}
+
+__attribute__((target("avx2"))) static __INLINE inline
+unsigned int find_fixed_avx2(const void *block, unsigned int from, const char *key, size_t key_len,
+                             size_t field_offset) {
+  const bucket_info_t *bucket_info = block;
+  const char *fields = (const char *) fixed_record(block, 0U) + field_offset;
+  char padded[32] = {0};
+  size_t head_len = (key_len < sizeof(padded)) ? key_len : sizeof(padded);
+  memcpy(padded, key, head_len);
+  const __m256i needle = _mm256_loadu_si256((const __m256i *) padded);
+  const uint32_t mask = (uint32_t) ((1ULL << head_len) - 1U);
+  for (unsigned int i = from; i != bucket_info->record_n; ++i) {
+    const char *field = fields + (size_t) i * sizeof(Record);
+    __m256i bytes = _mm256_loadu_si256((const __m256i *) field);
+    uint32_t equal = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, needle));
+    if ((equal & mask) == mask && !memcmp(field + head_len, key + head_len, key_len - head_len)) return i;
+  }
+  return bucket_info->record_n;
+}
+
+#define DEFINE_SIMD_KERNELS(field) \
+static unsigned int find_##field##_fixed_sse2(const void *block, unsigned int from, const void *key, size_t key_len) { \
+  if (key_len > sizeof(((Record *) 0)->field)) return ((const bucket_info_t *) block)->record_n; \
+  return find_fixed_sse2(block, from, key, key_len, offsetof(Record, field)); \
+} \
+\
+__attribute__((target("avx2"))) \
+static unsigned int find_##field##_fixed_avx2(const void *block, unsigned int from, const void *key, size_t key_len) { \
+  if (key_len > sizeof(((Record *) 0)->field)) return ((const bucket_info_t *) block)->record_n; \
+  return find_fixed_avx2(block, from, key, key_len, offsetof(Record, field)); \
+}
+
+DEFINE_SIMD_KERNELS(name)
+DEFINE_SIMD_KERNELS(surname)
+DEFINE_SIMD_KERNELS(address)
+
+_Static_assert(offsetof(Record, address) + 32U <= sizeof(Record), "the SIMD kernels load 32 bytes of a field");
+
+#define STRING_FIXED(field, isa) find_##field##_fixed_##isa
+#else
+#define STRING_FIXED(field, isa) find_##field##_fixed_scalar
+#endif
+
+#define KERNEL_ROW(isa) { \
+  {{find_int_fixed, int_key_length}, {find_int_compact, int_key_length}}, \
+  {{STRING_FIXED(name, isa), string_key_length}, {find_name_compact, string_key_length}}, \
+  {{STRING_FIXED(surname, isa), string_key_length}, {find_surname_compact, string_key_length}}, \
+  {{STRING_FIXED(address, isa), string_key_length}, {find_address_compact, string_key_length}} \
+}
+
+// Indexed by instruction set, by key and then by whether the blocks are compact
+static const ht_key_kernel_t kernels[ISA_N][4][2] = {KERNEL_ROW(scalar), KERNEL_ROW(sse2), KERNEL_ROW(avx2)};
+
+static isa_t detect_isa(void) {
+#ifdef HAVE_X86_KERNELS
+  return __builtin_cpu_supports("avx2") ? ISA_AVX2 : ISA_SSE2;
+#else
+  return ISA_SCALAR;
+#endif
+}
+
+const ht_key_kernel_t *ht_select_key_kernel(char attribute_type, const char *attribute_name, size_t len,
+                                            unsigned int flags) {
+  size_t compact = (flags & HT_FLAG_COMPACT) ? 1U : 0U;
+  const ht_key_kernel_t (*isa_kernels)[2] = kernels[detect_isa()];
+  if (attribute_type == 'i') return &isa_kernels[0][compact];
+  if (attribute_type != 'c' || attribute_name == NULL) return NULL;
+  // Same matching as get_attribute_offset
+  if (!strncmp(attribute_name, "name", len)) return &isa_kernels[1][compact];
+  if (!strncmp(attribute_name, "surname", len)) return &isa_kernels[2][compact];
+  if (!strncmp(attribute_name, "address", len)) return &isa_kernels[3][compact];
+  return NULL;
+}
@@ -0,0 +1,275 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <memory.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "../Include/loader.h"
+#include "../Include/macros.h"
+
+typedef struct {
+  int fd;
+  char *buffer;
+  size_t capacity;
+  size_t begin;
+  size_t end;
+  int eof;
+} chunk_reader_t;
+
+typedef struct {
+  chunk_reader_t reader;
+  size_t batch_size;
+  size_t max_records;
+  HT_loader_stats stats;
+} record_parser_t;
+
+/* Two batches, so that one gets parsed while the sink consumes the other */
+typedef struct {
+  record_parser_t *parser;
+  Record *batches[2];
+  size_t counts[2];
+  int full[2];
+  int failed;
+  int stopped;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+} pipeline_t;
+
+/*
+ * Hands out the next line of the file in [*line, *line_end), without the newline.
+ * The line lives in the reader buffer and is only valid until the next call.
+ * Returns 1 when there is a line, 0 at the end of the file and -1 on failure.
+ */
+static int next_line(chunk_reader_t *reader, const char **line, const char **line_end) {
+  while (1U) {
+    char *start = reader->buffer + reader->begin;
+    size_t available = reader->end - reader->begin;
+    char *newline = memchr(start, '\n', available);
+    if (newline != NULL) {
+      *line = start;
+      *line_end = newline;
+      reader->begin += (size_t) (newline - start) + 1U;
+      return 1;
+    }
+    if (reader->eof) {
+      if (available == 0U) return 0;
+      *line = start;
+      *line_end = start + available;
+      reader->begin = reader->end;
+      return 1;
+    }
+    // Keep the partial line and read the next chunk right behind it
+    memmove(reader->buffer, start, available);
+    reader->begin = 0U;
+    reader->end = available;
+    if (available == reader->capacity) {
+      char *buffer = realloc(reader->buffer, 2U * reader->capacity);
+      if (buffer == NULL) return -1;
+      reader->buffer = buffer;
+      reader->capacity *= 2U;
+    }
+    ssize_t bytes = read(reader->fd, reader->buffer + reader->end, reader->capacity - reader->end);
+    if (bytes < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    if (bytes == 0) reader->eof = 1;
+    reader->end += (size_t) bytes;
+  }
+}
+
+static __INLINE inline
+int is_blank(char c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+static __INLINE inline
+const char *skip_blanks(const char *p, const char *end) {
+  while (p != end && is_blank(*p)) ++p;
+  return p;
+}
+
+static const char *parse_id(const char *p, const char *end, int *id) {
+  int negative = p != end && *p == '-';
+  if (negative || (p != end && *p == '+')) ++p;
+  const char *digits = p;
+  long long value = 0;
+  for (; p != end && *p >= '0' && *p <= '9'; ++p) {
+    value = value * 10 + (*p - '0');
+    if (value > (long long) INT_MAX + 1) return NULL;
+  }
+  if (p == digits) return NULL;
+  if (negative) value = -value;
+  if (value > INT_MAX || value < INT_MIN) return NULL;
+  *id = (int) value;
+  return p;
+}
+
+/* Copies [begin, end) into a Record field without the surrounding blanks and quotes and zeroes the rest of it */
+static void copy_field(char *field, size_t field_size, const char *begin, const char *end, HT_loader_stats *stats) {
+  begin = skip_blanks(begin, end);
+  while (end != begin && is_blank(end[-1])) --end;
+  if (end - begin >= 2 && *begin == '"' && end[-1] == '"') {
+    ++begin;
+    --end;
+  }
+  size_t len = (size_t) (end - begin);
+  if (len >= field_size) {
+    len = field_size - 1U;
+    ++stats->truncated;
+  }
+  memcpy(field, begin, len);
+  memset(field + len, 0, field_size - len);
+}
+
+/* Returns 1 when the line holds a record, 0 when it is blank and -1 when it is malformed */
+static int parse_record(const char *p, const char *end, Record *record, HT_loader_stats *stats) {
+  p = skip_blanks(p, end);
+  if (p == end) return 0;
+  if (*p++ != '{') return -1;
+  p = parse_id(skip_blanks(p, end), end, &record->id);
+  if (p == NULL) return -1;
+  p = skip_blanks(p, end);
+  if (p == end || *p++ != ',') return -1;
+
+  const char *comma = memchr(p, ',', (size_t) (end - p));
+  if (comma == NULL) return -1;
+  copy_field(record->name, sizeof(record->name), p, comma, stats);
+  p = comma + 1;
+  comma = memchr(p, ',', (size_t) (end - p));
+  if (comma == NULL) return -1;
+  copy_field(record->surname, sizeof(record->surname), p, comma, stats);
+  p = comma + 1;
+
+  const char *close = end;
+  while (close != p && is_blank(close[-1])) --close;
+  if (close == p || close[-1] != '}') return -1;
+  copy_field(record->address, sizeof(record->address), p, close - 1, stats);
+  return 1;
+}
+
+/* Parses up to batch_size records into batch. Returns the number of records parsed or -1 on failure */
+static long fill_batch(record_parser_t *parser, Record *batch) {
+  size_t count = 0U;
+  while (count != parser->batch_size &&
+         (parser->max_records == 0U || parser->stats.records != parser->max_records)) {
+    const char *line;
+    const char *line_end;
+    int res = next_line(&parser->reader, &line, &line_end);
+    if (res < 0) return -1;
+    if (res == 0) break;
+    ++parser->stats.lines;
+    res = parse_record(line, line_end, &batch[count], &parser->stats);
+    if (res < 0) {
+      ++parser->stats.malformed;
+    } else if (res > 0) {
+      ++count;
+      ++parser->stats.records;
+    }
+  }
+  return (long) count;
+}
+
+static void *parse_worker(void *argument) {
+  pipeline_t *pipeline = argument;
+  for (int slot = 0;; slot ^= 1) {
+    pthread_mutex_lock(&pipeline->lock);
+    while (pipeline->full[slot] && !pipeline->stopped) pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+    int stopped = pipeline->stopped;
+    pthread_mutex_unlock(&pipeline->lock);
+    if (stopped) break;
+
+    long count = fill_batch(pipeline->parser, pipeline->batches[slot]);
+    pthread_mutex_lock(&pipeline->lock);
+    // An empty batch tells the consumer that the file is over
+    pipeline->counts[slot] = count < 0 ? 0U : (size_t) count;
+    pipeline->failed = count < 0;
+    pipeline->full[slot] = 1;
+    pthread_cond_broadcast(&pipeline->changed);
+    pthread_mutex_unlock(&pipeline->lock);
+    if (count <= 0) break;
+  }
+  return NULL;
+}
+
+static int load_parallel(record_parser_t *parser, Record *batches, HT_loader_sink sink, void *context) {
+  pipeline_t pipeline = {
+          .parser = parser,
+          .batches = {batches, batches + parser->batch_size},
+          .lock = PTHREAD_MUTEX_INITIALIZER,
+          .changed = PTHREAD_COND_INITIALIZER
+  };
+  pthread_t thread_id;
+  if (pthread_create(&thread_id, NULL, parse_worker, &pipeline) != 0) return -1;
+  int res = 0;
+  for (int slot = 0;; slot ^= 1) {
+    pthread_mutex_lock(&pipeline.lock);
+    while (!pipeline.full[slot]) pthread_cond_wait(&pipeline.changed, &pipeline.lock);
+    size_t count = pipeline.counts[slot];
+    if (pipeline.failed) res = -1;
+    pthread_mutex_unlock(&pipeline.lock);
+    if (count == 0U) break;
+
+    if (sink(pipeline.batches[slot], count, context) < 0) res = -1;
+    pthread_mutex_lock(&pipeline.lock);
+    pipeline.full[slot] = 0;
+    pipeline.stopped = res < 0;
+    pthread_cond_broadcast(&pipeline.changed);
+    pthread_mutex_unlock(&pipeline.lock);
+    if (res < 0) break;
+  }
+  pthread_join(thread_id, NULL);
+  pthread_mutex_destroy(&pipeline.lock);
+  pthread_cond_destroy(&pipeline.changed);
+  return res;
+}
+
+static int load_sequential(record_parser_t *parser, Record *batch, HT_loader_sink sink, void *context) {
+  while (1U) {
+    long count = fill_batch(parser, batch);
+    if (count < 0) return -1;
+    if (count == 0) return 0;
+    if (sink(batch, (size_t) count, context) < 0) return -1;
+  }
+}
+
+int HT_LoadRecords(const char *filename, const HT_loader_options *options, HT_loader_sink sink,
+                   void *context, HT_loader_stats *stats) {
+  HT_loader_options defaults = {0};
+  if (options == NULL) options = &defaults;
+  record_parser_t parser = {
+          .reader = {.capacity = HT_LOADER_CHUNK_SIZE},
+          .batch_size = options->batchSize ? options->batchSize : HT_LOADER_DEFAULT_BATCH,
+          .max_records = options->maxRecords
+  };
+  if ((parser.reader.fd = open(filename, O_RDONLY)) < 0) {
+    perror(filename);
+    return -1;
+  }
+#ifdef POSIX_FADV_SEQUENTIAL
+  posix_fadvise(parser.reader.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  size_t batch_n = options->parallel ? 2U : 1U;
+  parser.reader.buffer = __MALLOC(parser.reader.capacity, char);
+  Record *batches = __MALLOC(batch_n * parser.batch_size, Record);
+  int res = -1;
+  if (parser.reader.buffer != NULL && batches != NULL) {
+    res = options->parallel ? load_parallel(&parser, batches, sink, context)
+                            : load_sequential(&parser, batches, sink, context);
+  }
+  free(batches);
+  free(parser.reader.buffer);
+  close(parser.reader.fd);
+  if (stats != NULL) *stats = parser.stats;
+  return res;
+}
+
+static int insert_batch(const Record *records, size_t n, void *context) {
+  return HT_InsertMany(context, records, n, NULL);
+}
+
+int HT_LoadIndex(HT_info *header_info, const char *filename, const HT_loader_options *options,
+                 HT_loader_stats *stats) {
+  return HT_LoadRecords(filename, options, insert_batch, header_info, stats);
+}
@@ -0,0 +1,128 @@
+#include <stdint.h>
+#include <memory.h>
+#include "../Include/lz.h"
+
+#define MIN_MATCH 4U
+#define MAX_OFFSET 65535U
+#define HASH_BITS 12U
+#define LENGTH_MASK 15U
+
+static __INLINE inline
+uint32_t read32(const uint8_t *p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(uint32_t));
+  return value;
+}
+
+static __INLINE inline
+uint32_t hash4(uint32_t sequence) {
+  return (sequence * 2654435761U) >> (32U - HASH_BITS);
+}
+
+/* Writes the bytes that extend a length that did not fit in its 4 bit token field */
+static uint8_t *write_length(uint8_t *op, const uint8_t *op_end, size_t length) {
+  for (; length >= 255U; length -= 255U) {
+    if (op == op_end) return NULL;
+    *op++ = 255U;
+  }
+  if (op == op_end) return NULL;
+  *op++ = (uint8_t) length;
+  return op;
+}
+
+/* Emits the literals followed by a match. The last sequence of a block has match_n 0 and no offset */
+static uint8_t *emit_sequence(uint8_t *op, const uint8_t *op_end, const uint8_t *literals, size_t literal_n,
+                              size_t offset, size_t match_n) {
+  if (op == op_end) return NULL;
+  uint8_t *token = op++;
+  size_t literal_field = literal_n < LENGTH_MASK ? literal_n : LENGTH_MASK;
+  if (literal_field == LENGTH_MASK && (op = write_length(op, op_end, literal_n - LENGTH_MASK)) == NULL) return NULL;
+  if ((size_t) (op_end - op) < literal_n) return NULL;
+  memcpy(op, literals, literal_n);
+  op += literal_n;
+  size_t match_field = 0U;
+  if (match_n != 0U) {
+    if (op_end - op < 2) return NULL;
+    *op++ = (uint8_t) offset;
+    *op++ = (uint8_t) (offset >> 8U);
+    match_field = (match_n - MIN_MATCH < LENGTH_MASK) ? match_n - MIN_MATCH : LENGTH_MASK;
+    if (match_field == LENGTH_MASK && (op = write_length(op, op_end, match_n - MIN_MATCH - LENGTH_MASK)) == NULL) {
+      return NULL;
+    }
+  }
+  *token = (uint8_t) (literal_field << 4U | match_field);
+  return op;
+}
+
+int ht_lz_compress(const void *src, size_t n, void *dst, size_t capacity) {
+  if (n > MAX_OFFSET) return -1;
+  const uint8_t *in = src;
+  const uint8_t *in_end = in + n;
+  const uint8_t *ip = in;
+  const uint8_t *anchor = in;
+  uint8_t *op = dst;
+  const uint8_t *op_end = op + capacity;
+  // Positions fit in 16 bits and 0xFFFF marks an empty slot, n being at most MAX_OFFSET
+  uint16_t table[1U << HASH_BITS];
+  memset(table, 0xFF, sizeof(table));
+  while (in_end - ip >= (ptrdiff_t) MIN_MATCH) {
+    uint32_t sequence = read32(ip);
+    uint32_t h = hash4(sequence);
+    uint16_t candidate = table[h];
+    table[h] = (uint16_t) (ip - in);
+    if (candidate == 0xFFFFU || read32(in + candidate) != sequence) {
+      ++ip;
+      continue;
+    }
+    const uint8_t *match = in + candidate;
+    size_t match_n = MIN_MATCH;
+    while (ip + match_n != in_end && match[match_n] == ip[match_n]) ++match_n;
+    op = emit_sequence(op, op_end, anchor, (size_t) (ip - anchor), (size_t) (ip - match), match_n);
+    if (op == NULL) return -1;
+    ip += match_n;
+    anchor = ip;
+  }
+  op = emit_sequence(op, op_end, anchor, (size_t) (in_end - anchor), 0U, 0U);
+  return (op == NULL) ? -1 : (int) (op - (uint8_t *) dst);
+}
+
+static const uint8_t *read_length(const uint8_t *ip, const uint8_t *ip_end, size_t *length) {
+  uint8_t byte;
+  do {
+    if (ip == ip_end) return NULL;
+    byte = *ip++;
+    *length += byte;
+  } while (byte == 255U);
+  return ip;
+}
+
+int ht_lz_decompress(const void *src, size_t n, void *dst, size_t capacity) {
+  const uint8_t *ip = src;
+  const uint8_t *ip_end = ip + n;
+  uint8_t *op = dst;
+  uint8_t *op_end = op + capacity;
+  while (ip != ip_end) {
+    unsigned int token = *ip++;
+    size_t literal_n = token >> 4U;
+    if (literal_n == LENGTH_MASK && (ip = read_length(ip, ip_end, &literal_n)) == NULL) return -1;
+    if ((size_t) (ip_end - ip) < literal_n || (size_t) (op_end - op) < literal_n) return -1;
+    memcpy(op, ip, literal_n);
+    ip += literal_n;
+    op += literal_n;
+    if (ip == ip_end) break;
+
+    if (ip_end - ip < 2) return -1;
+    size_t offset = (size_t) ip[0] | (size_t) ip[1] << 8U;
+    ip += 2;
+    if (offset == 0U || offset > (size_t) (op - (uint8_t *) dst)) return -1;
+    size_t match_n = token & LENGTH_MASK;
+    if (match_n == LENGTH_MASK && (ip = read_length(ip, ip_end, &match_n)) == NULL) return -1;
+    match_n += MIN_MATCH;
+    if ((size_t) (op_end - op) < match_n) return -1;
+    // The match may overlap the bytes it produces, so it gets copied byte by byte
+    const uint8_t *match = op - offset;
+    for (size_t i = 0U; i != match_n; ++i) op[i] = match[i];
+    op += match_n;
+  }
+  return (int) (op - (uint8_t *) dst);
+}
@@ -3,6 +3,7 @@
 #include <memory.h>
 #include "../Include/BF.h"
 #include "../Include/HT.h"
+#include "../Include/loader.h"
 #include "../Include/macros.h"
 
 #define RECORD_FILE_15K "../record_examples/records15K.txt"
@@ -56,15 +57,6 @@ int main(int argc, char **argv) {
   while (--argc){
     max_records = atoi(argv[argc]);
   }
-  FILE *record_file = fopen(RECORD_FILE_15K, "r");
-  char *line = NULL;
-  size_t len = 0;
-  int i = 0;
-  int id; char* name; char* surname; char* address;
-  name = __MALLOC(15, char);
-  surname = __MALLOC(20, char);
-  address = __MALLOC(40, char);
-
 
   // Create HT.
   char filename[] = "test.ht";
@@ -79,16 +71,16 @@ int main(int argc, char **argv) {
     exit(EXIT_FAILURE);
   }
 
-  while (getline(&line, &len, record_file) != EOF && i++ < max_records) {
-    sscanf(line, "{ %lu , %[^,] , %[^,] , %[^}] ", &id, name, surname, address);
-    Record record = {.id = id};
-    snprintf(record.name, sizeof(record.name), "%s", name);
-    snprintf(record.surname, sizeof(record.surname), "%s", surname);
-    snprintf(record.address, sizeof(record.address), "%s", address);
-    HT_InsertEntry(*info, record);
+  HT_loader_stats stats = {0};
+  // A limit of 0 or less loads nothing, while the loader takes 0 as the whole file
+  if (max_records > 0) {
+    HT_loader_options options = {.maxRecords = (size_t) max_records, .parallel = 1};
+    if (HT_LoadIndex(info, RECORD_FILE_15K, &options, &stats) < 0) {
+      fprintf(stderr, "Error loading %s\n", RECORD_FILE_15K);
+      exit(EXIT_FAILURE);
+    }
   }
-
-  free(name); free(surname); free(address);
+  printf("Loaded %zu records, skipped %zu malformed lines\n", stats.records, stats.malformed);
 
   printf("Searching for id: 1001\n");
   int search_criteria = 1001;
@@ -99,7 +91,7 @@ int main(int argc, char **argv) {
   err = SHT_CreateSecondaryIndex(secondaryIndex, "name", 4, 1000, filename);
   SHT_info *sht_info = SHT_OpenSecondaryIndex(secondaryIndex);
   int count = 0;
-  Record record = {.id = id};
+  Record record = {.id = (int) stats.records};
   snprintf(record.name, sizeof(record.name), "%s", "john");
   snprintf(record.surname, sizeof(record.surname), "%s", "doe");
   snprintf(record.address, sizeof(record.address), "%s", "Athens");
@@ -12,7 +12,7 @@ Record create_record(int id, const char *restrict name, const char *restrict con
   return record;
 }
 
-void print_record(Record *record) {
+void print_record(const Record *record) {
   printf("ID: %d, Name: %s, Surname: %s, Address: %s\n",
          record->id, record->name, record->surname, record->address);
 }
\ No newline at end of file
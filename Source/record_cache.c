@@ -0,0 +1,232 @@
+#include <stdint.h>
+#include <memory.h>
+#include <stdlib.h>
+#include "../Include/record_cache.h"
+
+#define SKETCH_ROWS 4U
+#define SKETCH_MIN_WIDTH 64U
+#define SKETCH_MAX_COUNT 15U
+// Lookups per sketch counter between two halvings
+#define SKETCH_SAMPLE_FACTOR 10U
+#define NO_ENTRY (-1)
+
+typedef struct {
+  int id;
+  // Next entry of the same hash chain, or of the free list
+  int32_t hash_next;
+  int32_t newer;
+  int32_t older;
+  size_t count;
+  Record *records;
+} cache_entry_t;
+
+struct ht_record_cache {
+  size_t budget;
+  size_t used;
+  size_t n;
+  cache_entry_t *entries;
+  int32_t free_entries;
+  int32_t *heads;
+  uint32_t head_mask;
+  int32_t newest;
+  int32_t oldest;
+  uint8_t *sketch;
+  uint32_t sketch_mask;
+  unsigned long accesses;
+  unsigned long sample_size;
+  HT_cache_stats stats;
+};
+
+static const uint32_t row_seeds[SKETCH_ROWS] = {0x9E3779B9U, 0x85EBCA6BU, 0xC2B2AE35U, 0x27D4EB2FU};
+
+static uint32_t mix(int id, uint32_t seed) {
+  uint32_t x = (uint32_t) id ^ seed;
+  x ^= x >> 16U;
+  x *= 0x7FEB352DU;
+  x ^= x >> 15U;
+  x *= 0x846CA68BU;
+  x ^= x >> 16U;
+  return x;
+}
+
+static uint32_t round_up_pow2(size_t n) {
+  uint32_t pow2 = 1U;
+  while (pow2 < n) pow2 <<= 1U;
+  return pow2;
+}
+
+static size_t entry_cost(size_t count) {
+  return sizeof(cache_entry_t) + count * sizeof(Record);
+}
+
+static unsigned int sketch_estimate(const struct ht_record_cache *cache, int id) {
+  unsigned int estimate = SKETCH_MAX_COUNT;
+  for (uint32_t row = 0U; row != SKETCH_ROWS; ++row) {
+    uint8_t count = cache->sketch[row * (cache->sketch_mask + 1U) + (mix(id, row_seeds[row]) & cache->sketch_mask)];
+    if (count < estimate) estimate = count;
+  }
+  return estimate;
+}
+
+static void sketch_increment(struct ht_record_cache *cache, int id) {
+  size_t width = cache->sketch_mask + 1U;
+  for (uint32_t row = 0U; row != SKETCH_ROWS; ++row) {
+    uint8_t *count = &cache->sketch[row * width + (mix(id, row_seeds[row]) & cache->sketch_mask)];
+    if (*count < SKETCH_MAX_COUNT) ++*count;
+  }
+  if (++cache->accesses < cache->sample_size) return;
+  for (size_t i = 0U; i != SKETCH_ROWS * width; ++i) cache->sketch[i] >>= 1U;
+  cache->accesses /= 2U;
+}
+
+static int32_t find_entry(const struct ht_record_cache *cache, int id) {
+  int32_t i = cache->heads[mix(id, 0U) & cache->head_mask];
+  while (i != NO_ENTRY && cache->entries[i].id != id) i = cache->entries[i].hash_next;
+  return i;
+}
+
+static void unlink_lru(struct ht_record_cache *cache, int32_t i) {
+  cache_entry_t *entry = &cache->entries[i];
+  if (entry->newer != NO_ENTRY) cache->entries[entry->newer].older = entry->older;
+  else cache->newest = entry->older;
+  if (entry->older != NO_ENTRY) cache->entries[entry->older].newer = entry->newer;
+  else cache->oldest = entry->newer;
+}
+
+static void push_newest(struct ht_record_cache *cache, int32_t i) {
+  cache_entry_t *entry = &cache->entries[i];
+  entry->newer = NO_ENTRY;
+  entry->older = cache->newest;
+  if (cache->newest != NO_ENTRY) cache->entries[cache->newest].newer = i;
+  else cache->oldest = i;
+  cache->newest = i;
+}
+
+static void remove_entry(struct ht_record_cache *cache, int32_t i) {
+  cache_entry_t *entry = &cache->entries[i];
+  int32_t *link = &cache->heads[mix(entry->id, 0U) & cache->head_mask];
+  while (*link != i) link = &cache->entries[*link].hash_next;
+  *link = entry->hash_next;
+  unlink_lru(cache, i);
+  cache->used -= entry_cost(entry->count);
+  --cache->n;
+  free(entry->records);
+  entry->records = NULL;
+  entry->hash_next = cache->free_entries;
+  cache->free_entries = i;
+}
+
+void ht_record_cache_free(struct ht_record_cache *cache) {
+  if (cache == NULL) return;
+  if (cache->entries != NULL) {
+    for (int32_t i = cache->newest; i != NO_ENTRY; i = cache->entries[i].older) free(cache->entries[i].records);
+  }
+  free(cache->entries);
+  free(cache->heads);
+  free(cache->sketch);
+  free(cache);
+}
+
+int ht_record_cache_lookup(struct ht_record_cache *cache, int id, const Record **records, size_t *count) {
+  sketch_increment(cache, id);
+  int32_t i = find_entry(cache, id);
+  if (i == NO_ENTRY) {
+    ++cache->stats.misses;
+    return 0;
+  }
+  ++cache->stats.hits;
+  unlink_lru(cache, i);
+  push_newest(cache, i);
+  *records = cache->entries[i].records;
+  *count = cache->entries[i].count;
+  return 1;
+}
+
+void ht_record_cache_admit(struct ht_record_cache *cache, int id, const Record *records, size_t count) {
+  size_t cost = entry_cost(count);
+  if (find_entry(cache, id) != NO_ENTRY) return;
+  if (cost > cache->budget) {
+    ++cache->stats.rejections;
+    return;
+  }
+  // Copied before anything gets evicted, so that a failed allocation leaves the cache as it was
+  Record *copy = NULL;
+  if (count != 0U) {
+    if ((copy = malloc(count * sizeof(Record))) == NULL) return;
+    memcpy(copy, records, count * sizeof(Record));
+  }
+  // The candidate has to be more popular than every entry it pushes out
+  unsigned int estimate = sketch_estimate(cache, id);
+  while (cache->free_entries == NO_ENTRY || cache->used + cost > cache->budget) {
+    if (estimate <= sketch_estimate(cache, cache->entries[cache->oldest].id)) {
+      ++cache->stats.rejections;
+      free(copy);
+      return;
+    }
+    remove_entry(cache, cache->oldest);
+    ++cache->stats.evictions;
+  }
+  int32_t i = cache->free_entries;
+  cache_entry_t *entry = &cache->entries[i];
+  cache->free_entries = entry->hash_next;
+  int32_t *head = &cache->heads[mix(id, 0U) & cache->head_mask];
+  *entry = (cache_entry_t) {.id = id, .hash_next = *head, .count = count, .records = copy};
+  *head = i;
+  push_newest(cache, i);
+  cache->used += cost;
+  ++cache->n;
+  ++cache->stats.admissions;
+}
+
+void ht_record_cache_invalidate(struct ht_record_cache *cache, int id) {
+  int32_t i = find_entry(cache, id);
+  if (i == NO_ENTRY) return;
+  remove_entry(cache, i);
+  ++cache->stats.invalidations;
+}
+
+int HT_EnableRecordCache(HT_info *header_info, size_t budget) {
+  if (header_info->attrType != 'i') return -1;
+  // Room for entries of a single record each, the usual case for an index on the id
+  size_t capacity = budget / entry_cost(1U);
+  if (capacity == 0U || capacity > INT32_MAX) return -1;
+  struct ht_record_cache *cache = calloc(1U, sizeof(struct ht_record_cache));
+  if (cache == NULL) return -1;
+  uint32_t heads = round_up_pow2(capacity);
+  uint32_t width = round_up_pow2((capacity < SKETCH_MIN_WIDTH) ? SKETCH_MIN_WIDTH : capacity);
+  cache->entries = malloc(capacity * sizeof(cache_entry_t));
+  cache->heads = malloc(heads * sizeof(int32_t));
+  cache->sketch = calloc(SKETCH_ROWS * (size_t) width, sizeof(uint8_t));
+  if (cache->entries == NULL || cache->heads == NULL || cache->sketch == NULL) {
+    ht_record_cache_free(cache);
+    return -1;
+  }
+  cache->budget = budget;
+  cache->head_mask = heads - 1U;
+  cache->sketch_mask = width - 1U;
+  cache->sample_size = SKETCH_SAMPLE_FACTOR * (unsigned long) width;
+  cache->newest = cache->oldest = NO_ENTRY;
+  for (uint32_t i = 0U; i != heads; ++i) cache->heads[i] = NO_ENTRY;
+  for (size_t i = 0U; i != capacity; ++i) {
+    cache->entries[i].records = NULL;
+    cache->entries[i].hash_next = (i + 1U != capacity) ? (int32_t) (i + 1U) : NO_ENTRY;
+  }
+  cache->free_entries = 0;
+  ht_record_cache_free(header_info->cache);
+  header_info->cache = cache;
+  return 0;
+}
+
+void HT_DisableRecordCache(HT_info *header_info) {
+  ht_record_cache_free(header_info->cache);
+  header_info->cache = NULL;
+}
+
+int HT_GetRecordCacheStats(const HT_info *header_info, HT_cache_stats *stats) {
+  const struct ht_record_cache *cache = header_info->cache;
+  if (cache == NULL) return -1;
+  *stats = cache->stats;
+  stats->entries = cache->n;
+  stats->bytes = cache->used;
+  return 0;
+}
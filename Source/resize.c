@@ -0,0 +1,83 @@
+#include <memory.h>
+#include <stdio.h>
+#include "../Include/HT.h"
+#include "../Include/BF.h"
+#include "../Include/bucket.h"
+#include "../Include/statistics.h"
+#include "../Include/catalog.h"
+#include "../Include/macros.h"
+
+#define RESIZE_SUFFIX ".resize"
+#define RESIZE_BATCH 4096U
+// The BF layer caps a file at 8192 blocks and the overflow blocks need some of them too
+#define RESIZE_MAX_BUCKETS 4096
+
+typedef struct {
+  HT_info *target;
+  Record *batch;
+  size_t n;
+  int failed;
+} resize_context_t;
+
+static int flush_batch(resize_context_t *resize) {
+  if (resize->n != 0U && HT_InsertMany(resize->target, resize->batch, resize->n, NULL) < 0) resize->failed = 1;
+  resize->n = 0U;
+  return resize->failed ? -1 : 0;
+}
+
+static int resize_record(const Record *record, int block_id, void *context) {
+  (void) block_id;
+  resize_context_t *resize = context;
+  resize->batch[resize->n++] = *record;
+  return resize->n == RESIZE_BATCH && flush_batch(resize) < 0;
+}
+
+int HT_SuggestBuckets(char *index_name) {
+  HT_statistics stats;
+  if (HT_CollectStatistics(index_name, 0U, &stats) < 0) return -1;
+  int is_secondary = stats.isSecondary;
+  // What the records take, compressed or compact encodings included
+  double payload = (double) (BLOCK_SIZE - sizeof(bucket_info_t));
+  double used = (double) (stats.totalBlocks - 1) * payload - (double) stats.freeBytes;
+  double records = (double) stats.totalRecords;
+  HT_FreeStatistics(&stats);
+  if (is_secondary) return -1;
+  double bytes_per_record = (records > 0.0 && used > 0.0) ? used / records : (double) sizeof(Record);
+  double buckets = records * bytes_per_record / (payload * HT_RESIZE_TARGET_FILL);
+  if (buckets >= RESIZE_MAX_BUCKETS) return RESIZE_MAX_BUCKETS;
+  // Rounded up, an index always keeps at least one bucket
+  int whole = (int) buckets;
+  return (whole == 0 || buckets > whole) ? whole + 1 : whole;
+}
+
+int HT_Resize(char *index_name, int new_buckets) {
+  // A handle cached by the catalog would outlive the file it reads
+  if (HT_CatalogEvict(index_name) < 0) return -1;
+  if (new_buckets == HT_RESIZE_AUTO) new_buckets = HT_SuggestBuckets(index_name);
+  if (new_buckets <= 0 || new_buckets > RESIZE_MAX_BUCKETS) return -1;
+  char *resize_name = __MALLOC(strlen(index_name) + sizeof(RESIZE_SUFFIX), char);
+  if (resize_name == NULL) return -1;
+  sprintf(resize_name, "%s%s", index_name, RESIZE_SUFFIX);
+
+  resize_context_t resize = {.batch = __MALLOC(RESIZE_BATCH, Record)};
+  HT_info *source = HT_OpenIndex(index_name);
+  int res = -1;
+  if (source == NULL || resize.batch == NULL) goto __RESIZE_END;
+  HT_create_options options = {.flags = source->flags};
+  if (HT_CreateIndexEx(resize_name, source->attrType, source->attrName, (int) source->attrLength, new_buckets,
+                       &options) < 0 || (resize.target = HT_OpenIndex(resize_name)) == NULL) {
+    goto __RESIZE_END;
+  }
+  // The scan reads the old file in block order, and the batches write every new block once
+  if (HT_Scan(source, resize_record, &resize) >= 0 && !resize.failed && flush_batch(&resize) == 0) res = 0;
+
+__RESIZE_END:
+  if (resize.target != NULL && HT_CloseIndex(resize.target) < 0) res = -1;
+  if (source != NULL && HT_CloseIndex(source) < 0) res = -1;
+  // rename replaces the index in one step, readers see either the old file or the new one
+  if (res == 0 && rename(resize_name, index_name) < 0) res = -1;
+  if (res < 0) remove(resize_name);
+  free(resize_name);
+  free(resize.batch);
+  return (res < 0) ? -1 : new_buckets;
+}
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include "../Include/snapshot.h"
+#include "../Include/block_format.h"
+#include "../Include/macros.h"
+
+#define BF_READ_BLOCK_EMSG "Error while reading block"
+#define BF_GET_BLOCK_COUNTER_EMSG "Error while getting block counter"
+
+typedef struct {
+  // The snapshots holding this copy
+  unsigned int holders;
+  char data[BLOCK_SIZE];
+} block_version_t;
+
+struct ht_snapshot {
+  int fileDesc;
+  unsigned int flags;
+  int blockN;
+  // Indexed by block id, NULL while the live block is still the one of the snapshot
+  block_version_t **versions;
+  HT_snapshot *next;
+};
+
+HT_snapshot *ht_snapshots = NULL;
+
+HT_snapshot *HT_OpenSnapshot(HT_info *header_info) {
+  int block_n;
+  CHECK(block_n = BF_GetBlockCounter(header_info->fileDesc), BF_GET_BLOCK_COUNTER_EMSG, return NULL);
+  HT_snapshot *snapshot = __MALLOC(1, HT_snapshot);
+  if (snapshot == NULL) return NULL;
+  snapshot->versions = calloc((size_t) block_n, sizeof(block_version_t *));
+  if (snapshot->versions == NULL) {
+    free(snapshot);
+    return NULL;
+  }
+  snapshot->fileDesc = header_info->fileDesc;
+  snapshot->flags = header_info->flags;
+  snapshot->blockN = block_n;
+  snapshot->next = ht_snapshots;
+  ht_snapshots = snapshot;
+  return snapshot;
+}
+
+void HT_CloseSnapshot(HT_snapshot *snapshot) {
+  HT_snapshot **link = &ht_snapshots;
+  while (*link != snapshot) link = &(*link)->next;
+  *link = snapshot->next;
+  for (int i = 0; i != snapshot->blockN; ++i) {
+    block_version_t *version = snapshot->versions[i];
+    if (version != NULL && --version->holders == 0U) free(version);
+  }
+  free(snapshot->versions);
+  free(snapshot);
+}
+
+int ht_snapshot_copy_block(int file_desc, int block_id) {
+  block_version_t *version = NULL;
+  for (HT_snapshot *snapshot = ht_snapshots; snapshot != NULL; snapshot = snapshot->next) {
+    if (snapshot->fileDesc != file_desc || block_id >= snapshot->blockN || snapshot->versions[block_id] != NULL) {
+      continue;
+    }
+    if (version == NULL) {
+      void *block;
+      CHECK(BF_ReadBlock(file_desc, block_id, &block), BF_READ_BLOCK_EMSG, return -1);
+      if ((version = __MALLOC(1, block_version_t)) == NULL) return -1;
+      memcpy(version->data, block, BLOCK_SIZE);
+      version->holders = 0U;
+    }
+    snapshot->versions[block_id] = version;
+    ++version->holders;
+  }
+  return 0;
+}
+
+int ht_snapshot_read_block(const HT_snapshot *snapshot, int block_id, void *block) {
+  if (snapshot->fileDesc < 0 || block_id < 0 || block_id >= snapshot->blockN) return -1;
+  const block_version_t *version = snapshot->versions[block_id];
+  if (version != NULL) {
+    memcpy(block, version->data, BLOCK_SIZE);
+    return 0;
+  }
+  void *live;
+  CHECK(BF_ReadBlock(snapshot->fileDesc, block_id, &live), BF_READ_BLOCK_EMSG, return -1);
+  memcpy(block, live, BLOCK_SIZE);
+  return 0;
+}
+
+int ht_snapshot_blocks(const HT_snapshot *snapshot) {
+  return snapshot->blockN;
+}
+
+void ht_snapshot_detach(int file_desc) {
+  for (HT_snapshot *snapshot = ht_snapshots; snapshot != NULL; snapshot = snapshot->next) {
+    if (snapshot->fileDesc == file_desc) snapshot->fileDesc = -1;
+  }
+}
+
+int HT_SnapshotScan(HT_snapshot *snapshot, HT_scan_callback callback, void *context) {
+  char stored[BLOCK_SIZE];
+  char expanded[HT_EXPANDED_BLOCK_SIZE];
+  int blocks_read = 0;
+  for (int block_id = 1; block_id < snapshot->blockN; ++block_id) {
+    if (ht_snapshot_read_block(snapshot, block_id, stored) < 0) return -1;
+    ++blocks_read;
+    if (ht_verify_checksums && !ht_block_intact(stored)) return ht_checksum_failure(snapshot->fileDesc, block_id);
+    const char *block = stored;
+    if (((const bucket_info_t *) stored)->flags & BLOCK_COMPRESSED) {
+      if (ht_expand(stored, expanded) < 0) return -1;
+      block = expanded;
+    }
+    const bucket_info_t *bucket_info = (const bucket_info_t *) block;
+    for (unsigned int i = 0U; i != bucket_info->record_n; ++i) {
+      Record scratch;
+      if (callback(block_record(block, snapshot->flags, i, &scratch), block_id, context)) return blocks_read;
+    }
+  }
+  return blocks_read;
+}
@@ -0,0 +1,479 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <memory.h>
+#include <stdio.h>
+#include "../Include/statistics.h"
+#include "../Include/HT.h"
+#include "../Include/BF.h"
+#include "../Include/bucket.h"
+#include "../Include/block_format.h"
+#include "../Include/block_io.h"
+#include "../Include/secondary_format.h"
+#include "../Include/snapshot.h"
+#include "../Include/direct_io.h"
+#include "../Include/catalog.h"
+#include "../Include/macros.h"
+
+#define BF_OPEN_EMSG "Error while opening file"
+#define BF_GET_BLOCK_COUNTER_EMSG "Error while getting block counter"
+#define BF_READ_BLOCK_EMSG "Error while reading block"
+#define BF_CLOSE_EMSG "Error while closing file"
+
+#define PAYLOAD_SIZE (BLOCK_SIZE - sizeof(bucket_info_t))
+
+typedef struct {
+  const char *blocks;
+  int total_blocks;
+  unsigned long buckets;
+  int is_secondary;
+  unsigned int flags;
+  atomic_ulong *owner;
+  double *fill;
+} scan_shared_t;
+
+typedef struct {
+  scan_shared_t *shared;
+  int first_block;
+  int last_block;
+  unsigned long first_bucket;
+  unsigned long last_bucket;
+  HT_statistics partial;
+} scan_worker_t;
+
+/*
+ * Returns the end offset of the entries of an SHT block, or 0 when an entry does not fit in the block
+ * or its id list does not decode.
+ */
+static size_t secondary_entries_end(const char *block, const bucket_info_t *bucket_info) {
+  if (bucket_info->flags & BLOCK_POSTINGS) {
+    if (bucket_info->next_record < (int) SHT_POSTINGS_START || bucket_info->next_record > BLOCK_SIZE) return 0U;
+    size_t list_bytes = (size_t) bucket_info->next_record - SHT_POSTINGS_START;
+    if (sht_decode_ids((const uint8_t *) block + SHT_POSTINGS_START, list_bytes, bucket_info->record_n, NULL) < 0) {
+      return 0U;
+    }
+    return (size_t) bucket_info->next_record;
+  }
+  size_t offset = sizeof(bucket_info_t);
+  for (unsigned int i = 0U; i != bucket_info->record_n; ++i) {
+    sht_entry_t entry;
+    if (sht_entry_parse(block, offset, BLOCK_SIZE, &entry) < 0 ||
+        sht_decode_ids((const uint8_t *) block + entry.list, entry.list_bytes, entry.count, NULL) < 0) {
+      return 0U;
+    }
+    offset = entry.end;
+  }
+  return offset;
+}
+
+static void check_block(scan_worker_t *worker, int block_id) {
+  scan_shared_t *shared = worker->shared;
+  HT_statistics *stats = &worker->partial;
+  const char *block = shared->blocks + (size_t) block_id * BLOCK_SIZE;
+  bucket_info_t bucket_info = *(const bucket_info_t *) block;
+
+  size_t entries_end;
+  size_t padding = 0U;
+  // The slot directory of compact blocks counts as used space
+  size_t directory = 0U;
+  int consistent;
+  size_t used;
+  if (!shared->is_secondary && (bucket_info.flags & BLOCK_COMPRESSED)) {
+    // Compressed blocks are full by definition, what they use is their compressed size
+    char expanded[HT_EXPANDED_BLOCK_SIZE];
+    uint16_t compressed_n;
+    memcpy(&compressed_n, block + sizeof(bucket_info_t), sizeof(uint16_t));
+    consistent = !(shared->flags & HT_FLAG_COMPACT) && ht_expand(block, expanded) == 0 &&
+                 bucket_info.free_space == 0 &&
+                 block_entries_end(expanded, shared->flags, HT_EXPANDED_BLOCK_SIZE, &padding) ==
+                 (size_t) bucket_info.next_record;
+    used = consistent ? sizeof(uint16_t) + compressed_n : PAYLOAD_SIZE;
+    padding = 0U;
+    ++stats->compressedBlocks;
+  } else {
+    if (shared->is_secondary) {
+      entries_end = secondary_entries_end(block, &bucket_info);
+    } else {
+      entries_end = block_entries_end(block, shared->flags, BLOCK_SIZE, &padding);
+      if (shared->flags & HT_FLAG_COMPACT) directory = (size_t) bucket_info.record_n * COMPACT_SLOT_SIZE;
+    }
+    consistent = entries_end != 0U && bucket_info.next_record == (int) entries_end &&
+                 bucket_info.free_space == BLOCK_SIZE - bucket_info.next_record - (int) directory;
+    used = consistent ? entries_end - sizeof(bucket_info_t) + directory : PAYLOAD_SIZE;
+  }
+  if (!consistent) ++stats->inconsistentHeaders;
+  if (!ht_block_intact(block)) ++stats->checksumErrors;
+
+  int overflow = bucket_info.overflow_bucket;
+  if (overflow != -1 && (overflow <= (int) shared->buckets || overflow >= shared->total_blocks)) {
+    ++stats->invalidPointers;
+  }
+
+  shared->fill[block_id - 1] = (double) used / (double) PAYLOAD_SIZE;
+  stats->freeBytes += PAYLOAD_SIZE - used;
+  stats->wastedBytes += PAYLOAD_SIZE - used;
+  if (consistent) stats->wastedBytes += padding;
+}
+
+/* Marks a block as part of a chain. Returns 0 when another chain, or this one already, has it */
+static int claim_block(scan_worker_t *worker, unsigned long bucket, int block_id) {
+  unsigned long owner = 0U;
+  // A block claimed by this very chain means a cycle, one claimed by another chain means they are joined
+  if (atomic_compare_exchange_strong(&worker->shared->owner[block_id], &owner, bucket)) return 1;
+  if (owner == bucket) ++worker->partial.cycles;
+  else ++worker->partial.sharedBlocks;
+  return 0;
+}
+
+/* Claims the posting blocks of the key entries of an SHT block, returns the ids of the entries */
+static unsigned int claim_postings(scan_worker_t *worker, unsigned long bucket, const char *block) {
+  scan_shared_t *shared = worker->shared;
+  const bucket_info_t *bucket_info = (const bucket_info_t *) block;
+  unsigned int ids = 0U;
+  size_t offset = sizeof(bucket_info_t);
+  // A broken entry has already been counted by check_block
+  for (unsigned int i = 0U; i != bucket_info->record_n; ++i) {
+    sht_entry_t entry;
+    if (sht_entry_parse(block, offset, BLOCK_SIZE, &entry) < 0) break;
+    ids += entry.count;
+    for (int postings = entry.postings; postings != -1;) {
+      if (postings <= (int) shared->buckets || postings >= shared->total_blocks) {
+        ++worker->partial.invalidPointers;
+        break;
+      }
+      if (!claim_block(worker, bucket, postings)) break;
+      const bucket_info_t *posting = (const bucket_info_t *) (shared->blocks + (size_t) postings * BLOCK_SIZE);
+      ids += posting->record_n;
+      postings = posting->overflow_bucket;
+    }
+    offset = entry.end;
+  }
+  return ids;
+}
+
+static void walk_chain(scan_worker_t *worker, unsigned long bucket) {
+  scan_shared_t *shared = worker->shared;
+  HT_statistics *stats = &worker->partial;
+  if (bucket >= (unsigned long) shared->total_blocks) {
+    ++stats->invalidPointers;
+    return;
+  }
+  unsigned long chain_length = 0U;
+  unsigned int records = 0U;
+  unsigned int bucket_block_records = 0U;
+  int block_id = (int) bucket;
+  while (claim_block(worker, bucket, block_id)) {
+    const char *block = shared->blocks + (size_t) block_id * BLOCK_SIZE;
+    const bucket_info_t *bucket_info = (const bucket_info_t *) block;
+    // The bucket block alone counts its entries, whatever the file
+    if (chain_length == 0U) bucket_block_records = bucket_info->record_n;
+    ++chain_length;
+    // The records of an SHT are the ids of its entries, posting blocks included
+    records += shared->is_secondary ? claim_postings(worker, bucket, block) : bucket_info->record_n;
+    block_id = bucket_info->overflow_bucket;
+    if (block_id <= (int) shared->buckets || block_id >= shared->total_blocks) break;
+  }
+  if (chain_length == 0U) return;
+  stats->totalRecords += records;
+  if (records < stats->minRecords) stats->minRecords = records;
+  if (records > stats->maxRecords) stats->maxRecords = records;
+  stats->bucketBlockRecords += bucket_block_records;
+  if (bucket_block_records < stats->minBucketBlockRecords) stats->minBucketBlockRecords = bucket_block_records;
+  if (bucket_block_records > stats->maxBucketBlockRecords) stats->maxBucketBlockRecords = bucket_block_records;
+  if (chain_length > 1U) {
+    ++stats->bucketsWithOverflow;
+    stats->overflowBlocks += chain_length - 1U;
+  }
+  stats->bucketOverflowBlocks[bucket - 1U] = (unsigned int) (chain_length - 1U);
+  ++stats->chainHistogram[(chain_length < HT_STATS_MAX_CHAIN) ? chain_length : HT_STATS_MAX_CHAIN];
+}
+
+static void *scan_worker(void *argument) {
+  scan_worker_t *worker = argument;
+  for (int block_id = worker->first_block; block_id != worker->last_block; ++block_id) {
+    check_block(worker, block_id);
+  }
+  for (unsigned long bucket = worker->first_bucket; bucket <= worker->last_bucket; ++bucket) {
+    walk_chain(worker, bucket);
+  }
+  return NULL;
+}
+
+static void merge_statistics(HT_statistics *stats, const HT_statistics *partial) {
+  stats->totalRecords += partial->totalRecords;
+  if (partial->minRecords < stats->minRecords) stats->minRecords = partial->minRecords;
+  if (partial->maxRecords > stats->maxRecords) stats->maxRecords = partial->maxRecords;
+  stats->bucketBlockRecords += partial->bucketBlockRecords;
+  if (partial->minBucketBlockRecords < stats->minBucketBlockRecords) {
+    stats->minBucketBlockRecords = partial->minBucketBlockRecords;
+  }
+  if (partial->maxBucketBlockRecords > stats->maxBucketBlockRecords) {
+    stats->maxBucketBlockRecords = partial->maxBucketBlockRecords;
+  }
+  stats->bucketsWithOverflow += partial->bucketsWithOverflow;
+  stats->overflowBlocks += partial->overflowBlocks;
+  for (size_t i = 0U; i <= HT_STATS_MAX_CHAIN; ++i) {
+    stats->chainHistogram[i] += partial->chainHistogram[i];
+  }
+  stats->freeBytes += partial->freeBytes;
+  stats->wastedBytes += partial->wastedBytes;
+  stats->compressedBlocks += partial->compressedBlocks;
+  stats->inconsistentHeaders += partial->inconsistentHeaders;
+  stats->invalidPointers += partial->invalidPointers;
+  stats->cycles += partial->cycles;
+  stats->sharedBlocks += partial->sharedBlocks;
+  stats->checksumErrors += partial->checksumErrors;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double lhs = *(const double *) a;
+  double rhs = *(const double *) b;
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+static double percentile(const double *sorted, size_t n, double p) {
+  return n ? sorted[(size_t) (p * (double) (n - 1U))] : 0.0;
+}
+
+/*
+ * The workers need every block, so the blocks are copied out sequentially first, straight from the file
+ * through a direct reader rather than through the BF layer, which is not reentrant.
+ * An index file is at most a few MB since the BF layer caps it at 8192 blocks.
+ */
+static char *read_all_blocks(char *filename, int *total_blocks) {
+  ht_direct_reader_t *reader = ht_direct_open(filename, total_blocks);
+  if (reader == NULL) return NULL;
+  char *blocks = __MALLOC((size_t) *total_blocks * BLOCK_SIZE, char);
+  if (blocks == NULL) {
+    ht_direct_close(reader);
+    return NULL;
+  }
+  for (int i = 0; i != *total_blocks; ++i) {
+    const char *block;
+    if (ht_direct_next(reader, &block) != 1) {
+      free(blocks);
+      ht_direct_close(reader);
+      return NULL;
+    }
+    memcpy(blocks + (size_t) i * BLOCK_SIZE, block, BLOCK_SIZE);
+  }
+  ht_direct_close(reader);
+  return blocks;
+}
+
+/* Copies the blocks out through the BF layer, which also holds the writes of open handles not on disk yet */
+static char *read_buffered_blocks(char *filename, int *total_blocks) {
+  int fd;
+  CHECK(fd = BF_OpenFile(filename), BF_OPEN_EMSG, return NULL);
+  CHECK(*total_blocks = BF_GetBlockCounter(fd), BF_GET_BLOCK_COUNTER_EMSG, {
+    BF_CloseFile(fd);
+    return NULL;
+  });
+  char *blocks = (*total_blocks > 0) ? malloc((size_t) *total_blocks * BLOCK_SIZE) : NULL;
+  if (blocks == NULL) {
+    BF_CloseFile(fd);
+    return NULL;
+  }
+  for (int i = 0; i != *total_blocks; ++i) {
+    void *block;
+    CHECK(BF_ReadBlock(fd, i, &block), BF_READ_BLOCK_EMSG, {
+      free(blocks);
+      BF_CloseFile(fd);
+      return NULL;
+    });
+    memcpy(blocks + (size_t) i * BLOCK_SIZE, block, BLOCK_SIZE);
+  }
+  CHECK(BF_CloseFile(fd), BF_CLOSE_EMSG, {
+    free(blocks);
+    return NULL;
+  });
+  return blocks;
+}
+
+static char *read_snapshot_blocks(const HT_snapshot *snapshot, int *total_blocks) {
+  *total_blocks = ht_snapshot_blocks(snapshot);
+  char *blocks = (*total_blocks > 0) ? malloc((size_t) *total_blocks * BLOCK_SIZE) : NULL;
+  if (blocks == NULL) return NULL;
+  for (int i = 0; i != *total_blocks; ++i) {
+    if (ht_snapshot_read_block(snapshot, i, blocks + (size_t) i * BLOCK_SIZE) < 0) {
+      free(blocks);
+      return NULL;
+    }
+  }
+  return blocks;
+}
+
+/* Examines the blocks of a whole file and frees them. The name only goes into the error messages */
+static int collect_statistics(const char *name, char *blocks, int total_blocks, unsigned int threads,
+                              HT_statistics *stats) {
+  memset(stats, 0, sizeof(HT_statistics));
+  if (threads == 0U) threads = HT_STATS_DEFAULT_THREADS;
+
+  size_t ht_file_id_len = strlen(HT_FILE_IDENTIFIER);
+  size_t sht_file_id_len = strlen(SHT_FILE_IDENTIFIER);
+  if (!memcmp(blocks, HT_FILE_IDENTIFIER, ht_file_id_len)) {
+    stats->numBuckets = ((HT_info *) (blocks + ht_file_id_len))->numBuckets;
+    stats->flags = ((HT_info *) (blocks + ht_file_id_len))->flags;
+  } else if (!memcmp(blocks, SHT_FILE_IDENTIFIER, sht_file_id_len)) {
+    stats->isSecondary = 1;
+    stats->numBuckets = ((SHT_info *) (blocks + sht_file_id_len))->numBuckets;
+  } else {
+    free(blocks);
+    return -1;
+  }
+  if (!ht_header_current(blocks, name)) {
+    free(blocks);
+    return -1;
+  }
+  stats->totalBlocks = total_blocks;
+  stats->minRecords = UINT32_MAX;
+  stats->minBucketBlockRecords = UINT32_MAX;
+  if (!ht_header_intact(blocks)) ++stats->checksumErrors;
+
+  scan_shared_t shared = {
+          .blocks = blocks,
+          .total_blocks = total_blocks,
+          .buckets = stats->numBuckets,
+          .is_secondary = stats->isSecondary,
+          .flags = stats->flags,
+          .owner = calloc((size_t) total_blocks, sizeof(atomic_ulong)),
+          .fill = __MALLOC((size_t) total_blocks, double)
+  };
+  scan_worker_t *workers = calloc(threads, sizeof(scan_worker_t));
+  pthread_t *thread_ids = __MALLOC(threads, pthread_t);
+  stats->bucketOverflowBlocks = calloc(stats->numBuckets ? stats->numBuckets : 1U, sizeof(unsigned int));
+  int res = -1;
+  if (shared.owner == NULL || shared.fill == NULL || workers == NULL || thread_ids == NULL ||
+      stats->bucketOverflowBlocks == NULL) {
+    goto __STATISTICS_END;
+  }
+
+  // Every worker checks a contiguous range of blocks and walks a contiguous range of bucket chains
+  int data_blocks = total_blocks - 1;
+  unsigned int started = 0U;
+  for (unsigned int t = 0U; t != threads; ++t) {
+    scan_worker_t *worker = &workers[t];
+    worker->shared = &shared;
+    worker->first_block = 1 + (int) ((size_t) data_blocks * t / threads);
+    worker->last_block = 1 + (int) ((size_t) data_blocks * (t + 1U) / threads);
+    worker->first_bucket = 1U + stats->numBuckets * t / threads;
+    worker->last_bucket = stats->numBuckets * (t + 1U) / threads;
+    worker->partial.minRecords = UINT32_MAX;
+    worker->partial.minBucketBlockRecords = UINT32_MAX;
+    worker->partial.bucketOverflowBlocks = stats->bucketOverflowBlocks;
+    if (pthread_create(&thread_ids[t], NULL, scan_worker, worker) != 0) break;
+    ++started;
+  }
+  for (unsigned int t = 0U; t != started; ++t) {
+    pthread_join(thread_ids[t], NULL);
+    merge_statistics(stats, &workers[t].partial);
+  }
+  if (started != threads) goto __STATISTICS_END;
+
+  for (int block_id = 1; block_id < total_blocks; ++block_id) {
+    if (atomic_load(&shared.owner[block_id]) == 0U) ++stats->orphanBlocks;
+  }
+  if (stats->minRecords == UINT32_MAX) stats->minRecords = 0U;
+  if (stats->minBucketBlockRecords == UINT32_MAX) stats->minBucketBlockRecords = 0U;
+  qsort(shared.fill, (size_t) data_blocks, sizeof(double), compare_doubles);
+  stats->fillP50 = percentile(shared.fill, (size_t) data_blocks, 0.50);
+  stats->fillP90 = percentile(shared.fill, (size_t) data_blocks, 0.90);
+  stats->fillP99 = percentile(shared.fill, (size_t) data_blocks, 0.99);
+  res = 0;
+
+__STATISTICS_END:
+  free(blocks);
+  free((void *) shared.owner);
+  free(shared.fill);
+  free(workers);
+  free(thread_ids);
+  if (res < 0) HT_FreeStatistics(stats);
+  return res;
+}
+
+int HT_CollectStatistics(char *filename, unsigned int threads, HT_statistics *stats) {
+  // The blocks get read from disk, which a handle cached by the catalog may not have written back yet
+  if (HT_CatalogEvict(filename) < 0) return -1;
+  int total_blocks;
+  char *blocks = read_all_blocks(filename, &total_blocks);
+  if (blocks == NULL) return -1;
+  return collect_statistics(filename, blocks, total_blocks, threads, stats);
+}
+
+int HT_CollectSnapshotStatistics(HT_snapshot *snapshot, unsigned int threads, HT_statistics *stats) {
+  int total_blocks;
+  char *blocks = read_snapshot_blocks(snapshot, &total_blocks);
+  if (blocks == NULL) return -1;
+  return collect_statistics("The snapshot", blocks, total_blocks, threads, stats);
+}
+
+void HT_FreeStatistics(HT_statistics *stats) {
+  free(stats->bucketOverflowBlocks);
+  stats->bucketOverflowBlocks = NULL;
+}
+
+void HT_PrintStatisticsJSON(const HT_statistics *stats, FILE *out) {
+  int data_blocks = stats->totalBlocks - 1;
+  fprintf(out, "{\"type\":\"%s\",\"compact\":%s,\"blocks\":%d,\"buckets\":%lu,\"records\":%lu,"
+               "\"min_records\":%u,\"max_records\":%u,\"min_bucket_block_records\":%u,"
+               "\"max_bucket_block_records\":%u,\"buckets_with_overflow\":%lu,\"overflow_blocks\":%lu,"
+               "\"compressed_blocks\":%lu,",
+          stats->isSecondary ? "SHT" : "HT", (stats->flags & HT_FLAG_COMPACT) ? "true" : "false",
+          stats->totalBlocks, stats->numBuckets, stats->totalRecords, stats->minRecords, stats->maxRecords,
+          stats->minBucketBlockRecords, stats->maxBucketBlockRecords,
+          stats->bucketsWithOverflow, stats->overflowBlocks, stats->compressedBlocks);
+  fprintf(out, "\"chain_histogram\":{");
+  const char *separator = "";
+  for (size_t i = 1U; i <= HT_STATS_MAX_CHAIN; ++i) {
+    if (!stats->chainHistogram[i]) continue;
+    fprintf(out, "%s\"%zu%s\":%lu", separator, i, (i == HT_STATS_MAX_CHAIN) ? "+" : "", stats->chainHistogram[i]);
+    separator = ",";
+  }
+  fprintf(out, "},\"fill_factor\":{\"p50\":%.4f,\"p90\":%.4f,\"p99\":%.4f},"
+               "\"free_bytes\":%lu,\"wasted_bytes_per_block\":%.2f,",
+          stats->fillP50, stats->fillP90, stats->fillP99, stats->freeBytes,
+          data_blocks > 0 ? (double) stats->wastedBytes / data_blocks : 0.0);
+  int valid = !(stats->inconsistentHeaders || stats->invalidPointers || stats->cycles ||
+                stats->sharedBlocks || stats->orphanBlocks || stats->checksumErrors);
+  fprintf(out, "\"integrity\":{\"valid\":%s,\"inconsistent_headers\":%lu,\"invalid_pointers\":%lu,"
+               "\"cycles\":%lu,\"shared_blocks\":%lu,\"orphan_blocks\":%lu,\"checksum_errors\":%lu}}\n",
+          valid ? "true" : "false", stats->inconsistentHeaders, stats->invalidPointers,
+          stats->cycles, stats->sharedBlocks, stats->orphanBlocks, stats->checksumErrors);
+}
+
+int HashStatistics(char *filename) {
+  HT_statistics stats;
+  int total_blocks;
+  // Unlike HT_CollectStatistics the file may be open, so it gets read through the BF layer as it always was
+  char *blocks = read_buffered_blocks(filename, &total_blocks);
+  if (blocks == NULL || collect_statistics(filename, blocks, total_blocks, 0U, &stats) < 0) return -1;
+  printf("\n================================= HASH STATISTICS =================================\n");
+  // The bucket lines count the bucket blocks alone and the file blocks header included, as they always did
+  printf("\tFile Blocks: %d\n"
+         "\tMinimum Records in a bucket: %u\n"
+         "\tMaximum Records in a bucket: %u\n"
+         "\tAverage Records in a bucket: %.2f\n"
+         "\tAverage number of Blocks per bucket: %.2f\n"
+         "\tNumber of buckets with overflow blocks: %lu\n"
+         "\tMinimum Records in a bucket chain: %u\n"
+         "\tMaximum Records in a bucket chain: %u\n"
+         "\tAverage Records in a bucket chain: %.2f\n"
+         "\tAverage number of data Blocks per bucket chain: %.2f\n",
+         stats.totalBlocks, stats.minBucketBlockRecords, stats.maxBucketBlockRecords,
+         (float) stats.bucketBlockRecords / (float) stats.numBuckets,
+         (float) stats.totalBlocks / (float) stats.numBuckets,
+         stats.bucketsWithOverflow, stats.minRecords, stats.maxRecords,
+         (float) stats.totalRecords / (float) stats.numBuckets,
+         (float) (stats.totalBlocks - 1) / (float) stats.numBuckets);
+  if (stats.bucketsWithOverflow) {
+    printf("Overflow Blocks in buckets:\n");
+    for (size_t i = 0U; i != stats.numBuckets; ++i) {
+      if (stats.bucketOverflowBlocks[i]) {
+        printf("\tBucket[%zu]: %u\n", i + 1, stats.bucketOverflowBlocks[i]);
+      }
+    }
+  }
+  HT_FreeStatistics(&stats);
+  return 0;
+}
@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <time.h>
+#include "../Include/trace.h"
+#include "../Include/block_format.h"
+#include "../Include/macros.h"
+
+#define TRACE_BUFFER_SIZE (1U << 20U)
+#define MAX_VARINT_SIZE 10U
+// An event header: the operation and five varints
+#define EVENT_HEADER_SIZE (1U + 5U * MAX_VARINT_SIZE)
+
+struct ht_tracer {
+  FILE *file;
+  uint64_t base;
+  uint64_t previous_start;
+  int failed;
+  /* The event being built: its header fields, then the payload */
+  uint8_t header[EVENT_HEADER_SIZE];
+  size_t header_size;
+  uint8_t *payload;
+  size_t payload_size;
+  size_t payload_capacity;
+};
+
+struct ht_trace_reader {
+  FILE *file;
+  uint64_t previous_start;
+  uint8_t *payload;
+  size_t payload_capacity;
+};
+
+ht_tracer_t *ht_tracer = NULL;
+
+static uint64_t zigzag(int64_t value) {
+  return ((uint64_t) value << 1U) ^ (uint64_t) -(int64_t) ((uint64_t) value >> 63U);
+}
+
+static int64_t unzigzag(uint64_t value) {
+  return (int64_t) ((value >> 1U) ^ -(value & 1U));
+}
+
+static size_t varint_put(uint8_t *out, uint64_t value) {
+  size_t size = 0U;
+  for (; value >= 0x80U; value >>= 7U) out[size++] = (uint8_t) (value | 0x80U);
+  out[size++] = (uint8_t) value;
+  return size;
+}
+
+uint64_t ht_trace_clock(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000U + (uint64_t) ts.tv_nsec;
+}
+
+int HT_StartTrace(const char *filename) {
+  if (ht_tracer != NULL) return -1;
+  ht_tracer_t *tracer = calloc(1U, sizeof(ht_tracer_t));
+  if (tracer == NULL) return -1;
+  if ((tracer->file = fopen(filename, "wb")) == NULL) {
+    perror(filename);
+    free(tracer);
+    return -1;
+  }
+  setvbuf(tracer->file, NULL, _IOFBF, TRACE_BUFFER_SIZE);
+  if (fwrite(HT_TRACE_MAGIC, 1U, strlen(HT_TRACE_MAGIC), tracer->file) != strlen(HT_TRACE_MAGIC)) {
+    fclose(tracer->file);
+    free(tracer);
+    return -1;
+  }
+  tracer->base = ht_trace_clock();
+  tracer->previous_start = 0U;
+  ht_tracer = tracer;
+  return 0;
+}
+
+int HT_StopTrace(void) {
+  ht_tracer_t *tracer = ht_tracer;
+  if (tracer == NULL) return -1;
+  ht_tracer = NULL;
+  int res = (fclose(tracer->file) != 0 || tracer->failed) ? -1 : 0;
+  free(tracer->payload);
+  free(tracer);
+  return res;
+}
+
+/* Makes room for size more payload bytes */
+static uint8_t *payload_reserve(ht_tracer_t *tracer, size_t size) {
+  if (tracer->payload_size + size > tracer->payload_capacity) {
+    size_t capacity = tracer->payload_capacity ? 2U * tracer->payload_capacity : 256U;
+    while (capacity < tracer->payload_size + size) capacity *= 2U;
+    uint8_t *payload = realloc(tracer->payload, capacity);
+    if (payload == NULL) {
+      tracer->failed = 1;
+      return NULL;
+    }
+    tracer->payload = payload;
+    tracer->payload_capacity = capacity;
+  }
+  return tracer->payload + tracer->payload_size;
+}
+
+void ht_trace_begin(HT_trace_op op, uint64_t start, int handle, int result) {
+  ht_tracer_t *tracer = ht_tracer;
+  uint64_t now = ht_trace_clock();
+  // A call that started before the trace did counts from the start of the trace
+  uint64_t offset = (start > tracer->base) ? start - tracer->base : 0U;
+  uint64_t duration = (start > tracer->base) ? now - start : now - tracer->base;
+  uint8_t *p = tracer->header;
+  *p++ = (uint8_t) op;
+  // Calls made from callbacks of traced calls return first, so the starts are not always increasing
+  p += varint_put(p, zigzag((int64_t) (offset - tracer->previous_start)));
+  p += varint_put(p, duration);
+  p += varint_put(p, zigzag(handle));
+  p += varint_put(p, zigzag(result));
+  tracer->header_size = (size_t) (p - tracer->header);
+  tracer->previous_start = offset;
+  tracer->payload_size = 0U;
+}
+
+void ht_trace_put_int(long value) {
+  uint8_t *p = payload_reserve(ht_tracer, MAX_VARINT_SIZE);
+  if (p != NULL) ht_tracer->payload_size += varint_put(p, zigzag(value));
+}
+
+void ht_trace_put_string(const char *string, size_t max_len) {
+  size_t len = strnlen(string, max_len);
+  uint8_t *p = payload_reserve(ht_tracer, MAX_VARINT_SIZE + len);
+  if (p == NULL) return;
+  size_t size = varint_put(p, len);
+  memcpy(p + size, string, len);
+  ht_tracer->payload_size += size + len;
+}
+
+void ht_trace_put_record(const Record *record) {
+  ht_trace_put_int(record->id);
+  for (unsigned int f = 0U; f != COMPACT_FIELD_N; ++f) {
+    ht_trace_put_string((const char *) record + record_fields[f].offset, record_fields[f].size);
+  }
+}
+
+void ht_trace_put_key(char attribute_type, const void *key) {
+  if (attribute_type == 'i') ht_trace_put_int(*(const int *) key);
+  else ht_trace_put_string(key, sizeof(Record));
+}
+
+void ht_trace_end(void) {
+  ht_tracer_t *tracer = ht_tracer;
+  uint8_t size[MAX_VARINT_SIZE];
+  size_t size_len = varint_put(size, tracer->payload_size);
+  if (tracer->failed || fwrite(tracer->header, 1U, tracer->header_size, tracer->file) != tracer->header_size ||
+      fwrite(size, 1U, size_len, tracer->file) != size_len ||
+      fwrite(tracer->payload, 1U, tracer->payload_size, tracer->file) != tracer->payload_size) {
+    tracer->failed = 1;
+  }
+}
+
+HT_trace_reader *HT_OpenTrace(const char *filename) {
+  HT_trace_reader *reader = calloc(1U, sizeof(HT_trace_reader));
+  if (reader == NULL) return NULL;
+  char magic[sizeof(HT_TRACE_MAGIC)] = {0};
+  if ((reader->file = fopen(filename, "rb")) == NULL) {
+    perror(filename);
+    free(reader);
+    return NULL;
+  }
+  if (fread(magic, 1U, strlen(HT_TRACE_MAGIC), reader->file) != strlen(HT_TRACE_MAGIC) ||
+      strcmp(magic, HT_TRACE_MAGIC) != 0) {
+    HT_CloseTrace(reader);
+    return NULL;
+  }
+  return reader;
+}
+
+/* Returns 0, or -1 at the end of the file or when the varint is too long */
+static int read_varint(FILE *file, uint64_t *value) {
+  *value = 0U;
+  for (unsigned int shift = 0U; shift < 7U * MAX_VARINT_SIZE; shift += 7U) {
+    int byte = getc(file);
+    if (byte == EOF) return -1;
+    *value |= (uint64_t) (byte & 0x7F) << shift;
+    if (!(byte & 0x80)) return 0;
+  }
+  return -1;
+}
+
+int HT_NextTraceEvent(HT_trace_reader *reader, HT_trace_event *event) {
+  int op = getc(reader->file);
+  if (op == EOF) return 0;
+  uint64_t start_delta, duration, handle, result, payload_size;
+  if (op >= HT_TRACE_OP_N || read_varint(reader->file, &start_delta) < 0 || read_varint(reader->file, &duration) < 0 ||
+      read_varint(reader->file, &handle) < 0 || read_varint(reader->file, &result) < 0 ||
+      read_varint(reader->file, &payload_size) < 0) {
+    return -1;
+  }
+  if (payload_size > reader->payload_capacity) {
+    uint8_t *payload = realloc(reader->payload, payload_size);
+    if (payload == NULL) return -1;
+    reader->payload = payload;
+    reader->payload_capacity = payload_size;
+  }
+  if (fread(reader->payload, 1U, payload_size, reader->file) != payload_size) return -1;
+  reader->previous_start += (uint64_t) unzigzag(start_delta);
+  *event = (HT_trace_event) {
+          .op = (HT_trace_op) op,
+          .start = reader->previous_start,
+          .duration = duration,
+          .handle = (int) unzigzag(handle),
+          .result = (int) unzigzag(result),
+          .payload = reader->payload,
+          .payloadSize = payload_size
+  };
+  return 1;
+}
+
+void HT_CloseTrace(HT_trace_reader *reader) {
+  if (reader == NULL) return;
+  fclose(reader->file);
+  free(reader->payload);
+  free(reader);
+}
+
+static int get_varint(HT_trace_event *event, uint64_t *value) {
+  *value = 0U;
+  for (size_t size = 0U; size != MAX_VARINT_SIZE && size != event->payloadSize; ++size) {
+    *value |= (uint64_t) (event->payload[size] & 0x7FU) << (7U * size);
+    if (!(event->payload[size] & 0x80U)) {
+      event->payload += size + 1U;
+      event->payloadSize -= size + 1U;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+int HT_TraceGetInt(HT_trace_event *event, long *value) {
+  uint64_t raw;
+  if (get_varint(event, &raw) < 0) return -1;
+  *value = (long) unzigzag(raw);
+  return 0;
+}
+
+int HT_TraceGetString(HT_trace_event *event, char *buffer, size_t size) {
+  uint64_t len;
+  if (get_varint(event, &len) < 0 || len >= size || len > event->payloadSize) return -1;
+  memcpy(buffer, event->payload, len);
+  buffer[len] = '\0';
+  event->payload += len;
+  event->payloadSize -= len;
+  return 0;
+}
+
+int HT_TraceGetRecord(HT_trace_event *event, Record *record) {
+  long id;
+  if (HT_TraceGetInt(event, &id) < 0) return -1;
+  memset(record, 0, sizeof(Record));
+  record->id = (int) id;
+  for (unsigned int f = 0U; f != COMPACT_FIELD_N; ++f) {
+    // Full width strings get their terminator in the scratch cell and lose it in the record
+    char field[sizeof(Record)];
+    if (HT_TraceGetString(event, field, record_fields[f].size + 1U) < 0) return -1;
+    memcpy((char *) record + record_fields[f].offset, field, strnlen(field, record_fields[f].size));
+  }
+  return 0;
+}
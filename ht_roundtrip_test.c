@@ -0,0 +1,192 @@
+/*H**********************************************************************
+* FILENAME : ht_roundtrip_test.c
+*
+* DESCRIPTION :
+*       Round trip checks of the block codec and of the export format.
+*
+* NOTES :
+*       The function includes 4 tests and returns non zero when one of them fails.
+*		1) ht_lz_compress and ht_lz_decompress give back the input, and refuse output that does not fit.
+*		2) HT_Export of an index with compressed cold blocks followed by HT_Import keeps every record.
+*		3) The imported index passes the integrity checks of HT_CollectStatistics.
+*		4) Updates that make compressed blocks incompressible keep every record and the chains intact.
+* PARAMETERS:
+*		1) Number of records for test.
+* EXAMPLE:
+		ht_roundtrip_test 1000
+*H*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "Include/BF.h"
+#include "Include/HT.h"
+#include "Include/lz.h"
+#include "Include/export.h"
+#include "Include/statistics.h"
+
+#define LZ_MAX_INPUT (4U * BLOCK_SIZE)
+
+typedef struct {
+  char *seen;
+  int record_n;
+  int mismatches;
+} scan_context_t;
+
+static Record make_record(int id) {
+  Record record;
+  memset(&record, 0, sizeof(Record));
+  record.id = id;
+  // Few distinct values, so that the cold blocks compress
+  sprintf(record.name, "name_%d", id % 7);
+  sprintf(record.surname, "surname_%d", id % 5);
+  sprintf(record.address, "address_%d", id % 3);
+  return record;
+}
+
+static int lz_roundtrip(const char *input, size_t n) {
+  char compressed[LZ_MAX_INPUT + LZ_MAX_INPUT / 255U + 16U];
+  char output[LZ_MAX_INPUT];
+  int compressed_n = ht_lz_compress(input, n, compressed, sizeof(compressed));
+  if (compressed_n < 0 || ht_lz_decompress(compressed, (size_t) compressed_n, output, n) != (int) n) return -1;
+  if (memcmp(input, output, n) != 0) return -1;
+  // Capacities one byte short get refused
+  if (compressed_n > 0 && ht_lz_compress(input, n, compressed, (size_t) compressed_n - 1U) != -1) return -1;
+  if (n > 0U && ht_lz_decompress(compressed, (size_t) compressed_n, output, n - 1U) != -1) return -1;
+  return 0;
+}
+
+static int check_lz(void) {
+  char input[LZ_MAX_INPUT];
+  unsigned int state = 1U;
+  int failures = 0;
+  for (size_t n = 0U; n <= LZ_MAX_INPUT; n += 61U) {
+    // Zeros, a short repeating pattern, random bytes, and random runs of repeated bytes
+    memset(input, 0, n);
+    failures += lz_roundtrip(input, n) < 0;
+    for (size_t i = 0U; i != n; ++i) input[i] = (char) ('a' + i % 13U);
+    failures += lz_roundtrip(input, n) < 0;
+    for (size_t i = 0U; i != n; ++i) {
+      state = state * 1103515245U + 12345U;
+      input[i] = (char) (state >> 16U);
+    }
+    failures += lz_roundtrip(input, n) < 0;
+    for (size_t i = 0U; i != n; ++i) {
+      if (i % 9U == 0U) state = state * 1103515245U + 12345U;
+      input[i] = (char) (state >> 16U);
+    }
+    failures += lz_roundtrip(input, n) < 0;
+  }
+  return failures;
+}
+
+/* Fills every field with random letters, so that the block of the record stops compressing */
+static void scramble_record(Record *record, void *context) {
+  unsigned int *state = context;
+  char *fields[] = {record->name, record->surname, record->address};
+  size_t sizes[] = {sizeof(record->name), sizeof(record->surname), sizeof(record->address)};
+  for (size_t f = 0U; f != 3U; ++f) {
+    for (size_t i = 0U; i + 1U < sizes[f]; ++i) {
+      *state = *state * 1103515245U + 12345U;
+      fields[f][i] = (char) ('!' + (*state >> 16U) % 90U);
+    }
+    fields[f][sizes[f] - 1U] = '\0';
+  }
+}
+
+static int integrity_violations(const HT_statistics *stats) {
+  return stats->inconsistentHeaders != 0U || stats->invalidPointers != 0U || stats->cycles != 0U ||
+         stats->sharedBlocks != 0U || stats->orphanBlocks != 0U || stats->checksumErrors != 0U;
+}
+
+static int collect_record(const Record *record, int block_id, void *context) {
+  (void) block_id;
+  scan_context_t *scan = context;
+  if (record->id < 0 || record->id >= scan->record_n || scan->seen[record->id]) {
+    ++scan->mismatches;
+    return 0;
+  }
+  scan->seen[record->id] = 1;
+  Record expected = make_record(record->id);
+  if (strncmp(record->name, expected.name, sizeof(record->name)) != 0 ||
+      strncmp(record->surname, expected.surname, sizeof(record->surname)) != 0 ||
+      strncmp(record->address, expected.address, sizeof(record->address)) != 0) {
+    ++scan->mismatches;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  int testRecordsNumber = (argc > 1) ? atoi(argv[1]) : 1000;
+  int failed = 0;
+  BF_Init();
+  char *fileName = "roundtrip.index";
+  char *importName = "roundtrip_import.index";
+  char *exportName = "roundtrip.export";
+  // The name gets copied with the attribute length
+  char attrName[sizeof(int)] = "id";
+  remove(fileName);
+  remove(importName);
+  remove(exportName);
+
+  printf("@Checkpoint 1: LZ round trip\n");
+  int lzFailures = check_lz();
+  printf("Checkpoint Result 1: %s\n", (lzFailures == 0) ? "SUCCESS" : "FAIL");
+  failed |= lzFailures != 0;
+
+  printf("@Checkpoint 2: Export and import\n");
+  // Few buckets and cold compression, so that the export reads compressed overflow blocks
+  HT_create_options options = {.flags = HT_FLAG_COMPRESS_COLD};
+  int ch2 = HT_CreateIndexEx(fileName, 'i', attrName, sizeof(int), 3, &options) < 0;
+  HT_info *hi = ch2 ? NULL : HT_OpenIndex(fileName);
+  ch2 |= hi == NULL;
+  for (int i = 0; !ch2 && i < testRecordsNumber; i++) ch2 |= HT_InsertEntry(*hi, make_record(i)) < 0;
+  ch2 |= hi == NULL || HT_Export(hi, exportName) != testRecordsNumber;
+  if (hi != NULL) ch2 |= HT_CloseIndex(hi) < 0;
+  ch2 |= HT_Import(exportName, importName, 0) != testRecordsNumber;
+
+  scan_context_t scan = {
+          .seen = calloc((size_t) testRecordsNumber + 1U, sizeof(char)),
+          .record_n = testRecordsNumber,
+          .mismatches = 0
+  };
+  HT_info *imported = ch2 ? NULL : HT_OpenIndex(importName);
+  ch2 |= scan.seen == NULL || imported == NULL || HT_Scan(imported, collect_record, &scan) < 0;
+  if (imported != NULL) {
+    ch2 |= imported->flags != options.flags;
+    ch2 |= HT_CloseIndex(imported) < 0;
+  }
+  for (int i = 0; !ch2 && i < testRecordsNumber; i++) ch2 |= !scan.seen[i];
+  ch2 |= scan.mismatches != 0;
+  free(scan.seen);
+  printf("Checkpoint Result 2: %s\n", ch2 ? "FAIL" : "SUCCESS");
+  failed |= ch2;
+
+  printf("@Checkpoint 3: Imported index integrity\n");
+  HT_statistics stats;
+  int ch3 = HT_CollectStatistics(importName, 0U, &stats) < 0;
+  if (!ch3) {
+    ch3 = stats.totalRecords != (unsigned long) testRecordsNumber || stats.compressedBlocks == 0U ||
+          integrity_violations(&stats);
+    HT_FreeStatistics(&stats);
+  }
+  printf("Checkpoint Result 3: %s\n", ch3 ? "FAIL" : "SUCCESS");
+  failed |= ch3;
+
+  printf("@Checkpoint 4: Update compressed records\n");
+  unsigned int state = 1U;
+  hi = HT_OpenIndex(importName);
+  int ch4 = hi == NULL;
+  for (int i = 0; !ch4 && i < testRecordsNumber; i++) ch4 |= HT_Update(hi, &i, scramble_record, &state) < 0;
+  if (hi != NULL) ch4 |= HT_CloseIndex(hi) < 0;
+  if (!ch4) {
+    ch4 = HT_CollectStatistics(importName, 0U, &stats) < 0;
+    if (!ch4) {
+      ch4 = stats.totalRecords != (unsigned long) testRecordsNumber || integrity_violations(&stats);
+      HT_FreeStatistics(&stats);
+    }
+  }
+  printf("Checkpoint Result 4: %s\n", ch4 ? "FAIL" : "SUCCESS");
+  failed |= ch4;
+
+  return failed;
+}